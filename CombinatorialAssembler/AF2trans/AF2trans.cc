@@ -1,9 +1,18 @@
-#include "Atom.h"
-#include "Match.h"
-#include "Molecule.h"
+#include "AF2trans.h"
+#include "ModelsTrans.h"
 
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/program_options.hpp>
@@ -38,8 +47,9 @@ double getTempPercentile(Molecule<Atom> &mol1, Molecule<Atom> &mol2, float perce
 
 Match calculateTrans(Molecule<Atom> &origMol, Molecule<Atom> &transMol) {
     if ((origMol.size() != transMol.size()) || (origMol.size() == 0)) {
-        std::cerr << "different molecules " << origMol.size() << " " << transMol.size() << std::endl;
-        exit(1);
+        std::stringstream message;
+        message << "different molecules " << origMol.size() << " " << transMol.size();
+        throw std::runtime_error(message.str());
     }
     Match match;
     float tempThreshold = std::min(80.0, getTempPercentile(origMol, transMol, 0.5));
@@ -53,13 +63,11 @@ Match calculateTrans(Molecule<Atom> &origMol, Molecule<Atom> &transMol) {
     return match;
 }
 
-Molecule<Atom> readMolecule(std::string molName, bool all_atoms) {
-    Molecule<Atom> mol;
+// returns false if the file can't be opened
+bool readMolecule(std::string molName, bool all_atoms, Molecule<Atom> &mol) {
     std::ifstream molFile(molName);
-    if (!molFile) {
-        std::cerr << "Can't open file " << molName << std::endl;
-        exit(0);
-    }
+    if (!molFile)
+        return false;
 
     if (!all_atoms) {
         mol.readPDBfile(molFile, PDB::CAlphaSelector());
@@ -78,10 +86,167 @@ Molecule<Atom> readMolecule(std::string molName, bool all_atoms) {
         mol.readAllPDBfile(molFile);
     }
     molFile.close();
+    return true;
+}
 
+Molecule<Atom> readMolecule(std::string molName, bool all_atoms) {
+    Molecule<Atom> mol;
+    if (!readMolecule(molName, all_atoms, mol)) {
+        std::cerr << "Can't open file " << molName << std::endl;
+        exit(0);
+    }
     return mol;
 }
 
+// the output line of one receptor/ligand model pair, without the line number
+std::string transLine(Molecule<Atom> &receptorRef, Molecule<Atom> &ligandRef, Molecule<Atom> &receptorAF2,
+                      Molecule<Atom> &ligandAF2, const std::string &receptorFile, const std::string &ligandFile) {
+    Match m1 = calculateTrans(receptorRef, receptorAF2);
+    Match m2 = calculateTrans(ligandRef, ligandAF2);
+    RigidTrans3 T = m1.rigidTrans() * (!m2.rigidTrans());
+    std::stringstream line;
+    line.precision(4);
+    line << m1.rmsd() << "_" << receptorFile << " | " << m2.rmsd() << "_" << ligandFile << " | " << T;
+    return line.str();
+}
+
+// Reference molecules read once and shared by all the jobs of a batch. Jobs that ask for a file that is being read
+// wait for it.
+class MoleculeCache {
+  public:
+    MoleculeCache(bool all_atoms) : all_atoms_(all_atoms) {}
+
+    // NULL if the file can't be opened
+    std::shared_ptr<Molecule<Atom>> get(const std::string &molName) {
+        std::promise<std::shared_ptr<Molecule<Atom>>> promise;
+        std::shared_future<std::shared_ptr<Molecule<Atom>>> future;
+        bool found = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = molecules_.find(molName);
+            found = it != molecules_.end();
+            if (found)
+                future = it->second;
+            else
+                molecules_[molName] = promise.get_future().share();
+        }
+        if (found)
+            return future.get();
+
+        std::shared_ptr<Molecule<Atom>> mol = std::make_shared<Molecule<Atom>>();
+        if (!readMolecule(molName, all_atoms_, *mol))
+            mol.reset();
+        promise.set_value(mol);
+        return mol;
+    }
+
+  private:
+    bool all_atoms_;
+    std::mutex mutex_;
+    std::map<std::string, std::shared_future<std::shared_ptr<Molecule<Atom>>>> molecules_;
+};
+
+// Runs the jobs of jobsFile ("-" for stdin), one "receptorRef ligandRef receptorAF2 ligandAF2" job per line, on
+// threadsNum threads. Jobs start while the list is still being read, and each job prints one line as soon as the jobs
+// before it were printed: "<job number> | <line as in the single mode>" or "<job number> | error: <reason>".
+int runBatch(const std::string &jobsFile, unsigned int threadsNum, bool all_atoms) {
+    std::ifstream jobsStream;
+    std::istream *in = &std::cin;
+    if (jobsFile != "-") {
+        jobsStream.open(jobsFile);
+        if (!jobsStream) {
+            std::cerr << "Can't open jobs file " << jobsFile << std::endl;
+            return 1;
+        }
+        in = &jobsStream;
+    }
+    if (threadsNum == 0)
+        threadsNum = std::max(1u, std::thread::hardware_concurrency());
+
+    MoleculeCache references(all_atoms);
+    std::mutex mutex;
+    std::condition_variable jobsReady;
+    std::deque<std::pair<unsigned int, std::string>> jobs;
+    bool allRead = false;
+    std::map<unsigned int, std::string> done;
+    unsigned int nextToPrint = 1;
+
+    auto runJob = [&](const std::string &job) -> std::string {
+        std::stringstream fields(job);
+        std::vector<std::string> files;
+        std::string file;
+        while (fields >> file)
+            files.push_back(file);
+        if (files.size() != 4)
+            return "error: expected 4 files, got " + std::to_string(files.size());
+
+        std::shared_ptr<Molecule<Atom>> receptorRef = references.get(files[0]);
+        std::shared_ptr<Molecule<Atom>> ligandRef = references.get(files[1]);
+        Molecule<Atom> receptorAF2, ligandAF2;
+        for (int i = 0; i < 2; i++) {
+            if (!(i == 0 ? receptorRef : ligandRef))
+                return "error: can't open file " + files[i];
+        }
+        if (!readMolecule(files[2], all_atoms, receptorAF2))
+            return "error: can't open file " + files[2];
+        if (!readMolecule(files[3], all_atoms, ligandAF2))
+            return "error: can't open file " + files[3];
+        try {
+            return transLine(*receptorRef, *ligandRef, receptorAF2, ligandAF2, files[2], files[3]);
+        } catch (std::runtime_error &e) {
+            return std::string("error: ") + e.what();
+        }
+    };
+
+    auto worker = [&]() {
+        while (true) {
+            std::pair<unsigned int, std::string> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobsReady.wait(lock, [&]() { return !jobs.empty() || allRead; });
+                if (jobs.empty())
+                    return;
+                job = jobs.front();
+                jobs.pop_front();
+            }
+            std::string result = runJob(job.second);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            done[job.first] = result;
+            for (auto it = done.find(nextToPrint); it != done.end(); it = done.find(nextToPrint)) {
+                std::cout << nextToPrint << " | " << it->second << std::endl;
+                done.erase(it);
+                nextToPrint++;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threadsNum; t++)
+        workers.emplace_back(worker);
+
+    std::string line;
+    unsigned int jobsNum = 0;
+    while (getline(*in, line)) {
+        boost::trim(line);
+        // skip empty lines and comments
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::make_pair(++jobsNum, line));
+        jobsReady.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        allRead = true;
+    }
+    jobsReady.notify_all();
+    for (std::thread &t : workers)
+        t.join();
+    std::cerr << jobsNum << " jobs done" << std::endl;
+    return 0;
+}
+
 int main(int argc, char **argv) {
     // output arguments
     for (int i = 0; i < argc; i++)
@@ -91,11 +256,24 @@ int main(int argc, char **argv) {
     bool all_atoms = false;
     po::options_description desc(
         "Usage: AF2trans <receptorRef> <ligandRef> <receptorAF2_1> <ligandAF2_1> <receptorAF2_2> <ligandAF2_2> ...\n "
-        "translates AF2 complexes into transformations of the ligandRef onto the receptorRef\n");
+        "       AF2trans --jobs <jobsFile or - for stdin>\n "
+        "       AF2trans --subunits <subunits.json> --models <modelsFolder> --representatives <outFolder> "
+        "--transformations <outFolder>\n "
+        "translates AF2 complexes into transformations of the ligandRef onto the receptorRef\n"
+        "in batch mode each line of the jobs file is a job: <receptorRef> <ligandRef> <receptorAF2> <ligandAF2>\n"
+        "in models mode the representative subunits and the transformation files of all the subunit pairs are "
+        "extracted from a folder of multimer models\n");
     desc.add_options()("help",
                        "AF2mer2trans - produces ligand onto receptor docking like transformations from AF2 models\n")(
         "input-files", po::value<std::vector<std::string>>(), "input files")("all,a",
-                                                                             "all atoms rmsd (default = false)");
+                                                                             "all atoms rmsd (default = false)")(
+        "jobs", po::value<std::string>(), "batch mode, read the jobs from this file (- for stdin)")(
+        "threads", po::value<unsigned int>()->default_value(0),
+        "number of threads in batch and models modes (default=0, all cores)")(
+        "models", po::value<std::string>(), "models mode, folder of multimer models (.pdb or .cif)")(
+        "subunits", po::value<std::string>(), "models mode, subunits.json of the complex")(
+        "representatives", po::value<std::string>(), "models mode, output folder of the representative subunits")(
+        "transformations", po::value<std::string>(), "models mode, output folder of the transformation files");
 
     po::positional_options_description p;
     p.add("input-files", -1);
@@ -107,13 +285,24 @@ int main(int argc, char **argv) {
     if (vm.count("input-files")) {
         files = vm["input-files"].as<std::vector<std::string>>();
     }
+    if (vm.count("all_atoms")) {
+        all_atoms = true;
+    }
+    if (vm.count("models") && !vm.count("help")) {
+        if (!vm.count("subunits") || !vm.count("representatives") || !vm.count("transformations")) {
+            std::cout << desc << "\n";
+            return 1;
+        }
+        return extractModelsTrans(vm["subunits"].as<std::string>(), vm["models"].as<std::string>(),
+                                  vm["representatives"].as<std::string>(), vm["transformations"].as<std::string>(),
+                                  vm["threads"].as<unsigned int>());
+    }
+    if (vm.count("jobs") && !vm.count("help"))
+        return runBatch(vm["jobs"].as<std::string>(), vm["threads"].as<unsigned int>(), all_atoms);
     if (vm.count("help") || files.size() < 4) {
         std::cout << desc << "\n";
         return 0;
     }
-    if (vm.count("all_atoms")) {
-        all_atoms = true;
-    }
 
     Molecule<Atom> receptorRef = readMolecule(files[0], all_atoms);
     Molecule<Atom> ligandRef = readMolecule(files[1], all_atoms);
@@ -122,11 +311,14 @@ int main(int argc, char **argv) {
     for (unsigned int i = 2; i < files.size(); i += 2) {
         Molecule<Atom> receptorAF2 = readMolecule(files[i], all_atoms);
         Molecule<Atom> ligandAF2 = readMolecule(files[i + 1], all_atoms);
-        Match m1 = calculateTrans(receptorRef, receptorAF2);
-        Match m2 = calculateTrans(ligandRef, ligandAF2);
-        RigidTrans3 T = m1.rigidTrans() * (!m2.rigidTrans());
-        std::cout << i / 2 << " | " << m1.rmsd() << "_" << files[i] << " | " << m2.rmsd() << "_" << files[i + 1]
-                  << " | " << T << std::endl;
+        try {
+            std::cout << i / 2 << " | "
+                      << transLine(receptorRef, ligandRef, receptorAF2, ligandAF2, files[i], files[i + 1])
+                      << std::endl;
+        } catch (std::runtime_error &e) {
+            std::cerr << e.what() << std::endl;
+            exit(1);
+        }
         //    std::cout << rms << std::endl;
     }
 
@@ -0,0 +1,12 @@
+#ifndef AF2TRANS_H
+#define AF2TRANS_H
+
+#include "Atom.h"
+#include "Match.h"
+#include "Molecule.h"
+
+// Matches the i-th atom of origMol to the i-th atom of transMol, skipping low confidence atoms, and fits transMol
+// onto origMol. Throws std::runtime_error if the molecules can't be matched
+Match calculateTrans(Molecule<Atom> &origMol, Molecule<Atom> &transMol);
+
+#endif /* AF2TRANS_H */
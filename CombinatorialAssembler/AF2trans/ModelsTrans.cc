@@ -0,0 +1,508 @@
+#include "ModelsTrans.h"
+#include "AF2trans.h"
+
+#include <Parallel.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+namespace {
+// as INTERFACE_MIN_ATOM_DIST in scripts/libs/utils_classes.py
+const float INTERFACE_MIN_ATOM_DIST = 8.0;
+
+struct Subunit {
+    std::string name_;
+    std::vector<std::string> chainNames_;
+    int startRes_;
+    // without the unstructured X residues
+    std::string sequence_;
+
+    std::string chainedName(unsigned int i) const { return name_ + "_" + chainNames_[i]; }
+};
+
+struct Residue {
+    int id_;
+    char iCode_;
+    // atoms [firstAtom_, endAtom_) of the model
+    unsigned int firstAtom_, endAtom_;
+    // -1 if the residue has no CA
+    int ca_;
+};
+
+struct Chain {
+    char id_;
+    std::vector<Residue> residues_;
+    // one letter codes of the residues, X residues are skipped
+    std::string sequence_;
+    std::vector<int> sequenceResidueIds_;
+};
+
+struct Model {
+    std::string fileName_;
+    Molecule<Atom> atoms_;
+    std::vector<Chain> chains_;
+
+    const Chain *chain(char id) const {
+        for (const Chain &chain : chains_) {
+            if (chain.id_ == id)
+                return &chain;
+        }
+        return NULL;
+    }
+
+    Chain *chain(char id) { return (Chain *)((const Model *)this)->chain(id); }
+};
+
+// residues [startResidueId_, endResidueId_] of a model chain, which are the subunit sequence starting at
+// subunitStartSequenceId_ (see PartialSubunit of run_on_pdbs.py)
+struct PartialSubunit {
+    unsigned int subunit_;
+    unsigned int model_;
+    char chainId_;
+    int startResidueId_, endResidueId_;
+    int subunitStartSequenceId_;
+};
+
+struct Transformation {
+    unsigned int partial1_, partial2_;
+    bool found_;
+    double score_;
+    // "<score> | <description> | <transformation>"
+    std::string line_;
+    std::string message_;
+};
+
+std::vector<Subunit> readSubunits(const std::string &fileName) {
+    std::vector<Subunit> subunits;
+    try {
+        boost::property_tree::ptree tree;
+        boost::property_tree::read_json(fileName, tree);
+        for (const auto &entry : tree) {
+            Subunit subunit;
+            subunit.name_ = entry.second.get<std::string>("name");
+            for (const auto &chainName : entry.second.get_child("chain_names"))
+                subunit.chainNames_.push_back(chainName.second.data());
+            subunit.startRes_ = entry.second.get<int>("start_res");
+            for (char c : entry.second.get<std::string>("sequence")) {
+                if (c != 'X')
+                    subunit.sequence_ += c;
+            }
+            subunits.push_back(subunit);
+        }
+    } catch (boost::property_tree::ptree_error &e) {
+        std::cerr << "Can't read subunits file " << fileName << ": " << e.what() << std::endl;
+        exit(1);
+    }
+    return subunits;
+}
+
+// the .pdb and .cif files of the folder, sorted by name
+std::vector<std::string> listModels(const std::string &modelsDir) {
+    std::vector<std::string> fileNames;
+    DIR *dir = opendir(modelsDir.c_str());
+    if (dir == NULL) {
+        std::cerr << "Can't open models folder " << modelsDir << std::endl;
+        exit(1);
+    }
+    for (struct dirent *entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+        std::string fileName = entry->d_name;
+        if (fileName.size() > 4 &&
+            (fileName.compare(fileName.size() - 4, 4, ".pdb") == 0 ||
+             fileName.compare(fileName.size() - 4, 4, ".cif") == 0))
+            fileNames.push_back(fileName);
+    }
+    closedir(dir);
+    std::sort(fileNames.begin(), fileNames.end());
+    return fileNames;
+}
+
+// creates the folder and its missing parents
+void makeDirs(const std::string &dirName) {
+    for (size_t pos = dirName.find('/', 1); pos != std::string::npos; pos = dirName.find('/', pos + 1))
+        mkdir(dirName.substr(0, pos).c_str(), 0755);
+    mkdir(dirName.c_str(), 0755);
+}
+
+bool isCAlpha(const Atom &atom) {
+    std::stringstream line;
+    line << atom;
+    return PDB::CAlphaSelector()(line.str().c_str());
+}
+
+// reads the atoms and splits them to chains and residues
+bool readModel(const std::string &path, Model &model) {
+    if (model.atoms_.readAllPDBfile(path) <= 0)
+        return false;
+    for (unsigned int i = 0; i < model.atoms_.size(); i++) {
+        const Atom &atom = model.atoms_[i];
+        Chain *chain = model.chain(atom.chainId());
+        if (chain == NULL) {
+            model.chains_.push_back(Chain());
+            chain = &model.chains_.back();
+            chain->id_ = atom.chainId();
+        }
+        const Residue *last = chain->residues_.empty() ? NULL : &chain->residues_.back();
+        if (last == NULL || last->endAtom_ != i || last->id_ != atom.residueIndex() ||
+            last->iCode_ != atom.residueICode()) {
+            Residue residue = {atom.residueIndex(), atom.residueICode(), i, i, -1};
+            chain->residues_.push_back(residue);
+            if (atom.residueType() != 'X') {
+                chain->sequence_ += atom.residueType();
+                chain->sequenceResidueIds_.push_back(atom.residueIndex());
+            }
+        }
+        Residue &residue = chain->residues_.back();
+        residue.endAtom_ = i + 1;
+        if (residue.ca_ < 0 && isCAlpha(atom))
+            residue.ca_ = i;
+    }
+    return true;
+}
+
+// maps the chains of the model to the subunits by sequence, as get_pdb_to_partial_subunits of run_on_pdbs.py
+void findPartialSubunits(const std::vector<Subunit> &subunits, const std::vector<Model> &models,
+                         unsigned int modelIndex, std::vector<PartialSubunit> &partials) {
+    const Model &model = models[modelIndex];
+    std::vector<PartialSubunit> found;
+    for (const Chain &chain : model.chains_) {
+        const std::string &chainSeq = chain.sequence_;
+        if (chainSeq.empty())
+            continue;
+        const std::vector<int> &ids = chain.sequenceResidueIds_;
+        int minId = *std::min_element(ids.begin(), ids.end());
+        int maxId = *std::max_element(ids.begin(), ids.end());
+        for (unsigned int s = 0; s < subunits.size(); s++) {
+            const std::string &subunitSeq = subunits[s].sequence_;
+            const std::string &name = subunits[s].name_;
+            size_t pos = chainSeq.find(subunitSeq);
+            if (pos != std::string::npos) {
+                std::cout << "found full " << name << " in " << model.fileName_ << " chain " << chain.id_
+                          << std::endl;
+                found.push_back({s, modelIndex, chain.id_, ids[pos], ids[pos] + (int)subunitSeq.size() - 1, 0});
+            } else if ((pos = subunitSeq.find(chainSeq)) != std::string::npos) {
+                std::cout << "found partial " << name << " in " << model.fileName_ << " chain " << chain.id_ << " "
+                          << (maxId - minId + 1) << "/" << subunitSeq.size() << std::endl;
+                found.push_back({s, modelIndex, chain.id_, minId, maxId, (int)pos});
+            } else {
+                // check if part of subunit is in start/end of the chain (to catch small overlaps)
+                size_t start = chainSeq.find(subunitSeq.substr(0, 10));
+                if (start != std::string::npos &&
+                    subunitSeq.compare(0, chainSeq.size() - start, chainSeq, start) == 0) {
+                    std::cout << "found partial " << name << " in " << model.fileName_ << " chain " << chain.id_
+                              << " starting at index " << start << " " << (maxId - ids[start] + 1) << "/"
+                              << subunitSeq.size() << std::endl;
+                    found.push_back({s, modelIndex, chain.id_, ids[start], maxId, 0});
+                }
+                size_t tailSize = std::min((size_t)10, subunitSeq.size());
+                size_t tail = chainSeq.find(subunitSeq.substr(subunitSeq.size() - tailSize));
+                if (tail != std::string::npos) {
+                    size_t end = tail + 10 - 1;
+                    if (end < chainSeq.size() && end + 1 <= subunitSeq.size() &&
+                        subunitSeq.compare(subunitSeq.size() - end - 1, end + 1, chainSeq, 0, end + 1) == 0) {
+                        std::cout << "found partial " << name << " in " << model.fileName_ << " chain " << chain.id_
+                                  << " ending at index " << end << " " << (ids[end] - minId) << "/"
+                                  << subunitSeq.size() << std::endl;
+                        found.push_back(
+                            {s, modelIndex, chain.id_, minId, ids[end], (int)(subunitSeq.size() - end - 1)});
+                    }
+                }
+            }
+        }
+    }
+    std::sort(found.begin(), found.end(), [&](const PartialSubunit &p1, const PartialSubunit &p2) {
+        return std::make_tuple(subunits[p1.subunit_].name_, p1.chainId_, p1.startResidueId_) <
+               std::make_tuple(subunits[p2.subunit_].name_, p2.chainId_, p2.startResidueId_);
+    });
+    partials.insert(partials.end(), found.begin(), found.end());
+}
+
+// the residues of a chain with ids in [from, to]
+std::vector<const Residue *> residuesInRange(const Model &model, char chainId, int from, int to) {
+    std::vector<const Residue *> residues;
+    const Chain *chain = model.chain(chainId);
+    for (const Residue &residue : chain->residues_) {
+        if (from <= residue.id_ && residue.id_ <= to)
+            residues.push_back(&residue);
+    }
+    return residues;
+}
+
+// the value of the decimal the float was read from, as python would parse it
+double decimalValue(float value) {
+    char buffer[32];
+    std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    double decimal = value;
+    std::from_chars(buffer, result.ptr, decimal);
+    return decimal;
+}
+
+// formats like python's str(float)
+std::string pythonFloat(double value) {
+    char buffer[64];
+    double magnitude = std::fabs(value);
+    std::chars_format format = (magnitude != 0 && (magnitude < 1e-4 || magnitude >= 1e16))
+                                   ? std::chars_format::scientific
+                                   : std::chars_format::fixed;
+    std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value, format);
+    std::string text(buffer, result.ptr);
+    if (text.find_first_of(".en") == std::string::npos)
+        text += ".0";
+    return text;
+}
+
+// mean CA pLDDT of the residues of both partial subunits that have a CA closer than INTERFACE_MIN_ATOM_DIST to a
+// CA of the other, as score_transformation of run_on_pdbs.py. Returns false if they don't interact
+bool interfaceScore(const Model &model, const PartialSubunit &p1, const PartialSubunit &p2, double &score) {
+    std::vector<const Residue *> residues1 =
+        residuesInRange(model, p1.chainId_, p1.startResidueId_, p1.endResidueId_);
+    std::vector<const Residue *> residues2 =
+        residuesInRange(model, p2.chainId_, p2.startResidueId_, p2.endResidueId_);
+    std::set<unsigned int> interface1, interface2;
+    float maxDist2 = INTERFACE_MIN_ATOM_DIST * INTERFACE_MIN_ATOM_DIST;
+    for (unsigned int i = 0; i < residues1.size(); i++) {
+        if (residues1[i]->ca_ < 0)
+            continue;
+        const Atom &ca1 = model.atoms_[residues1[i]->ca_];
+        for (unsigned int j = 0; j < residues2.size(); j++) {
+            if (residues2[j]->ca_ >= 0 && ca1.dist2(model.atoms_[residues2[j]->ca_]) < maxDist2) {
+                interface1.insert(i);
+                interface2.insert(j);
+            }
+        }
+    }
+    if (interface1.empty())
+        return false;
+
+    double sum = 0;
+    for (unsigned int i : interface1)
+        sum += decimalValue(model.atoms_[residues1[i]->ca_].getTempFactor());
+    for (unsigned int j : interface2)
+        sum += decimalValue(model.atoms_[residues2[j]->ca_].getTempFactor());
+    score = sum / (interface1.size() + interface2.size());
+    return true;
+}
+
+// the atoms AF2trans would read from the residues [from, to] of the chain: CA, else P, else all the atoms
+Molecule<Atom> fitAtoms(const Model &model, char chainId, int from, int to) {
+    std::vector<const Residue *> residues = residuesInRange(model, chainId, from, to);
+    Molecule<Atom> atoms;
+    for (int pass = 0; pass < 3 && atoms.size() == 0; pass++) {
+        for (const Residue *residue : residues) {
+            for (unsigned int i = residue->firstAtom_; i < residue->endAtom_; i++) {
+                const Atom &atom = model.atoms_[i];
+                std::stringstream line;
+                line << atom;
+                if (pass == 2 || (atom.getAtomEntryType() == ATOM &&
+                                  (pass == 0 ? PDB::CAlphaSelector()(line.str().c_str())
+                                             : PDB::PSelector()(line.str().c_str()))))
+                    atoms.add(atom);
+            }
+        }
+    }
+    return atoms;
+}
+
+// the rmsd as it goes through the AF2trans output and python
+std::string rmsdText(float rmsd) {
+    std::stringstream text;
+    text.precision(4);
+    text << rmsd;
+    double value = rmsd;
+    std::string s = text.str();
+    std::from_chars(s.data(), s.data() + s.size(), value);
+    return pythonFloat(value);
+}
+
+bool writeRepresentative(const Model &model, const PartialSubunit &rep, const Subunit &subunit, unsigned int chain,
+                         const std::string &fileName) {
+    std::ofstream out(fileName);
+    if (!out)
+        return false;
+    for (const Residue *residue : residuesInRange(model, rep.chainId_, rep.startResidueId_, rep.endResidueId_)) {
+        for (unsigned int i = residue->firstAtom_; i < residue->endAtom_; i++) {
+            Atom atom = model.atoms_[i];
+            atom.setChainId(subunit.chainNames_[chain][0]);
+            atom.setResidueIndex(residue->id_ + subunit.startRes_ - rep.startResidueId_);
+            out << atom << std::endl;
+        }
+    }
+    out << "TER" << std::endl << "END" << std::endl;
+    out.close();
+    return (bool)out;
+}
+} // namespace
+
+int extractModelsTrans(const std::string &subunitsFile, const std::string &modelsDir,
+                       const std::string &representativesDir, const std::string &transformationsDir,
+                       unsigned int threadsNum) {
+    std::vector<Subunit> subunits = readSubunits(subunitsFile);
+    std::vector<std::string> fileNames = listModels(modelsDir);
+    makeDirs(representativesDir);
+    makeDirs(transformationsDir);
+
+    std::vector<Model> models(fileNames.size());
+    // char and not bool, the elements of std::vector<bool> share words and are written by different threads
+    std::vector<char> read(fileNames.size());
+    parallelFor(fileNames.size(), threadsNum, [&](unsigned int i) {
+        models[i].fileName_ = fileNames[i];
+        read[i] = readModel(modelsDir + "/" + fileNames[i], models[i]);
+    });
+    std::vector<PartialSubunit> partials;
+    // partials of model m are [modelPartials[m], modelPartials[m + 1])
+    std::vector<unsigned int> modelPartials;
+    for (unsigned int m = 0; m < models.size(); m++) {
+        modelPartials.push_back(partials.size());
+        if (!read[m]) {
+            std::cerr << "Can't read model " << fileNames[m] << std::endl;
+            continue;
+        }
+        findPartialSubunits(subunits, models, m, partials);
+    }
+    modelPartials.push_back(partials.size());
+
+    // representatives: the full length partial subunit of best mean CA pLDDT
+    std::vector<int> reps(subunits.size(), -1);
+    std::vector<double> repScores(subunits.size(), -1);
+    for (unsigned int p = 0; p < partials.size(); p++) {
+        const PartialSubunit &partial = partials[p];
+        if ((int)subunits[partial.subunit_].sequence_.size() !=
+            partial.endResidueId_ - partial.startResidueId_ + 1)
+            continue;
+        const Model &model = models[partial.model_];
+        double sum = 0;
+        unsigned int num = 0;
+        for (const Residue *residue :
+             residuesInRange(model, partial.chainId_, partial.startResidueId_, partial.endResidueId_)) {
+            if (residue->ca_ >= 0) {
+                sum += decimalValue(model.atoms_[residue->ca_].getTempFactor());
+                num++;
+            }
+        }
+        if (num > 0 && repScores[partial.subunit_] < sum / num) {
+            repScores[partial.subunit_] = sum / num;
+            reps[partial.subunit_] = p;
+        }
+    }
+    std::string missing;
+    for (unsigned int s = 0; s < subunits.size(); s++) {
+        if (reps[s] < 0)
+            missing += " " + subunits[s].name_;
+    }
+    if (!missing.empty()) {
+        std::cerr << "missing rep subunits for" << missing << std::endl;
+        return 1;
+    }
+    for (unsigned int s = 0; s < subunits.size(); s++) {
+        std::cout << "rep " << subunits[s].name_ << " has plddt score " << pythonFloat(repScores[s]) << std::endl;
+        const PartialSubunit &rep = partials[reps[s]];
+        for (unsigned int c = 0; c < subunits[s].chainNames_.size(); c++) {
+            std::string repFileName = representativesDir + "/" + subunits[s].chainedName(c) + ".pdb";
+            if (!writeRepresentative(models[rep.model_], rep, subunits[s], c, repFileName)) {
+                std::cerr << "Can't write " << repFileName << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    // one transformation for each pair of partial subunits of a model
+    std::vector<Transformation> transformations;
+    for (unsigned int m = 0; m < models.size(); m++) {
+        for (unsigned int i = modelPartials[m]; i < modelPartials[m + 1]; i++) {
+            for (unsigned int j = i + 1; j < modelPartials[m + 1]; j++) {
+                Transformation t;
+                t.partial1_ = i;
+                t.partial2_ = j;
+                t.found_ = false;
+                transformations.push_back(t);
+            }
+        }
+    }
+    parallelFor(transformations.size(), threadsNum, [&](unsigned int k) {
+        Transformation &t = transformations[k];
+        const PartialSubunit &p1 = partials[t.partial1_], &p2 = partials[t.partial2_];
+        const Model &model = models[p1.model_];
+        std::string pairName = subunits[p1.subunit_].name_ + " chain " + p1.chainId_ + " and " +
+                               subunits[p2.subunit_].name_ + " chain " + p2.chainId_ + " in " + model.fileName_;
+        if (!interfaceScore(model, p1, p2, t.score_)) {
+            t.message_ = "Skipping transformation, missing interface between " + pairName;
+            return;
+        }
+
+        Molecule<Atom> refs[2], samples[2];
+        for (int side = 0; side < 2; side++) {
+            const PartialSubunit &p = side == 0 ? p1 : p2;
+            const PartialSubunit &rep = partials[reps[p.subunit_]];
+            int repStart = rep.startResidueId_ + p.subunitStartSequenceId_;
+            refs[side] = fitAtoms(models[rep.model_], rep.chainId_, repStart,
+                                  repStart + p.endResidueId_ - p.startResidueId_);
+            samples[side] = fitAtoms(model, p.chainId_, p.startResidueId_, p.endResidueId_);
+        }
+        try {
+            Match m1 = calculateTrans(refs[0], samples[0]);
+            Match m2 = calculateTrans(refs[1], samples[1]);
+            RigidTrans3 T = m1.rigidTrans() * (!m2.rigidTrans());
+            std::stringstream line;
+            line.precision(4);
+            line << pythonFloat(t.score_) << " | " << rmsdText(m1.rmsd()) << "_" << rmsdText(m2.rmsd()) << "_"
+                 << p1.chainId_ << "_" << p2.chainId_ << "_" << model.fileName_ << " | " << T;
+            t.line_ = line.str();
+            t.found_ = true;
+        } catch (std::runtime_error &e) {
+            t.message_ = "Skipping transformation between " + pairName + ": " + e.what();
+        }
+    });
+
+    // group by subunit pair, in order of appearance
+    std::vector<std::pair<unsigned int, unsigned int>> pairs;
+    std::map<std::pair<unsigned int, unsigned int>, std::vector<const Transformation *>> pairTransformations;
+    for (const Transformation &t : transformations) {
+        if (!t.message_.empty())
+            std::cout << t.message_ << std::endl;
+        if (!t.found_)
+            continue;
+        std::pair<unsigned int, unsigned int> pair(partials[t.partial1_].subunit_, partials[t.partial2_].subunit_);
+        if (pairTransformations.find(pair) == pairTransformations.end())
+            pairs.push_back(pair);
+        pairTransformations[pair].push_back(&t);
+    }
+    for (const auto &pair : pairs) {
+        const Subunit &subunit1 = subunits[pair.first], &subunit2 = subunits[pair.second];
+        std::vector<const Transformation *> &pairList = pairTransformations[pair];
+        std::cout << "found " << pairList.size() << " transformations between " << subunit1.name_ << " and "
+                  << subunit2.name_ << std::endl;
+        std::stable_sort(pairList.begin(), pairList.end(), [](const Transformation *t1, const Transformation *t2) {
+            return t1->score_ > t2->score_;
+        });
+        std::stringstream content;
+        for (unsigned int i = 0; i < pairList.size(); i++)
+            content << i + 1 << " | " << pairList[i]->line_ << std::endl;
+
+        for (unsigned int c1 = 0; c1 < subunit1.chainNames_.size(); c1++) {
+            unsigned int startFrom = pair.first == pair.second ? c1 + 1 : 0;
+            for (unsigned int c2 = startFrom; c2 < subunit2.chainNames_.size(); c2++) {
+                std::string fileName =
+                    transformationsDir + "/" + subunit1.chainedName(c1) + "_plus_" + subunit2.chainedName(c2);
+                std::ofstream out(fileName);
+                out << content.str();
+                out.close();
+                if (!out) {
+                    std::cerr << "Can't write " << fileName << std::endl;
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
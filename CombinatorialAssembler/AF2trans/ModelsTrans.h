@@ -0,0 +1,25 @@
+/**
+ * Builds the unified representation of a complex straight from a folder of multimer models (.pdb or .cif), the
+ * native counterpart of the subunit search, representative extraction and transformation extraction steps of
+ * scripts/run_on_pdbs.py:
+ * - the chains of each model are mapped to the subunits of subunits.json by sequence, fully or partially
+ * - the representative of each subunit is its full length chain of best mean CA pLDDT, it is written to
+ *   <representativesDir>/<subunit>_<chain>.pdb for each chain name of the subunit, renumbered from the subunit
+ *   start residue
+ * - each pair of subunits that interact in a model (CA closer than 8A) gives one transformation of the second
+ *   representative onto the first one, scored by the mean CA pLDDT of the interface
+ * - the transformations of each subunit pair are written sorted by score to the files
+ *   <transformationsDir>/<A>_plus_<B> of all its chain aliases
+ * The models are read and the transformations computed on threadsNum threads (0 means all cores).
+ */
+#ifndef MODELSTRANS_H
+#define MODELSTRANS_H
+
+#include <string>
+
+// returns 0 on success, 1 on error (after printing it)
+int extractModelsTrans(const std::string &subunitsFile, const std::string &modelsDir,
+                       const std::string &representativesDir, const std::string &transformationsDir,
+                       unsigned int threadsNum);
+
+#endif /* MODELSTRANS_H */
@@ -1,47 +1,58 @@
 #include "BB.h"
 
-#include <Common.h>
+#include <ContentHash.h>
 #include <connolly_surface.h>
 
+#include <sstream>
+
+namespace {
+// connolly surface density and probe radius
+const float SURFACE_DENSITY = 10;
+const float PROBE_RADIUS = 1.8;
+// radius added to atoms when marking the residues grid
+const float RADIUS_ADDITION = 1.5;
+} // namespace
+
 BB::BB(int id, const std::string pdbFileName, int groupID, const ChemLib &lib, float gridResolution, float gridMargins,
-       float minTempFactor)
+       float minTempFactor, const BBCache *cache, BBGeometryStore *geometries, unsigned int threadsNum,
+       bool exactDistGrid)
     : id_(id), groupId_(groupID), pdbFileName_(pdbFileName) {
-    // read atoms
-    Common::readChemMolecule(pdbFileName_, allAtoms_, lib);
-    std::cout << "Done reading ChemMolecule " << allAtoms_.size() << std::endl;
-    // read backbone atoms
-    std::ifstream pdb2(pdbFileName_);
-    backBone_.readPDBfile(pdb2, PDB::BBSelector());
-    pdb2.close();
-    cm_ = backBone_.centroid();
-    numOfAtoms_ = allAtoms_.size();
+    // BBs are built in parallel, the messages are printed by BBContainer in the order of the BBs
+    std::ostringstream log;
 
-    // read CA atoms
-    std::ifstream pdb3(pdbFileName_);
-    caAtoms_.readPDBfile(pdb3, PDB::CAlphaSelector());
-    pdb3.close();
+    // read all, backbone and CA atoms
+    readAtoms(lib, cache, log);
+    log << "Done reading ChemMolecule " << allAtoms_.size() << std::endl;
+    numOfAtoms_ = allAtoms_.size();
 
-    // compute ms surface
-    msSurface_ = get_connolly_surface(allAtoms_, 10, 1.8);
-    std::cout << "Surface size " << msSurface_.size() << std::endl;
+    ContentHash hash;
+    hash.update(numOfAtoms_);
+    for (ChemMolecule::const_iterator it = allAtoms_.begin(); it != allAtoms_.end(); it++) {
+        for (int k = 0; k < 3; k++)
+            hash.update(it->position()[k] + 0.0f); // adding 0 turns -0 into 0, they are equal positions
+    }
+    coordinatesHash_ = hash.value();
 
-    // compute grid
-    grid_ = new BBGrid(msSurface_, gridResolution, gridMargins, 1.5);
-    grid_->computeDistFromSurface(msSurface_);
-    grid_->markTheInside(allAtoms_);
-    grid_->markResidues(backBone_);
-    std::cout << "Done compute grid " << pdbFileName_ << std::endl;
+    uint64_t key = geometryKey(gridResolution, gridMargins, exactDistGrid);
+    if (geometries != NULL)
+        geometry_ = geometries->get(key, [&]() {
+            return computeGeometry(key, gridResolution, gridMargins, cache, threadsNum, exactDistGrid, log);
+        });
+    else
+        geometry_ = computeGeometry(key, gridResolution, gridMargins, cache, threadsNum, exactDistGrid, log);
+    grid_ = geometry_->grid_.get();
 
-    std::vector<Atom *> atomsMap;
-    atomsMap.push_back(&(*allAtoms_.begin()));
-    for (ChemMolecule::iterator i = allAtoms_.begin(); i != allAtoms_.end(); i++) {
-        atomsMap.push_back(&(*i));
-    }
+    cm_ = backBone_.centroid();
 
-    computeFragments(minTempFactor); // get the endpoints
+    computeFragments(minTempFactor, log); // get the endpoints
 
-    for (Molecule<Atom>::const_iterator it = caAtoms_.begin(); it != caAtoms_.end(); it++) {
-        resIndexToCAAtom[it->residueIndex()] = *it;
+    for (unsigned int i = 0; i < caAtoms_.size(); i++) {
+        int resIndex = caAtoms_[i].residueIndex();
+        if (resIndex < 0)
+            continue;
+        if ((unsigned int)resIndex >= resIndexToCAIndex_.size())
+            resIndexToCAIndex_.resize(resIndex + 1, -1);
+        resIndexToCAIndex_[resIndex] = i;
     }
 
     maxRadius_ = 0.0;
@@ -50,12 +61,153 @@ BB::BB(int id, const std::string pdbFileName, int groupID, const ChemLib &lib, f
         if (r > maxRadius_)
             maxRadius_ = r;
     }
-    std::cout << "Max radius: " << maxRadius_ << std::endl;
+    log << "Max radius: " << maxRadius_ << std::endl;
+
+    log << " done reading BB " << pdbFileName_.c_str() << std::endl;
+    buildLog_ = log.str();
+}
+
+void BB::readAtoms(const ChemLib &lib, const BBCache *cache, std::ostream &log) {
+    // the file is read once and each record is offered to the selectors of all the views, as the separate
+    // loadMolecule (ATOM and HETATM records) and readPDBfile (ATOM records) calls would
+    std::ifstream pdb(pdbFileName_);
+    if (!pdb)
+        throw std::runtime_error("Can't open file: " + pdbFileName_);
+    std::stringstream contents;
+    contents << pdb.rdbuf();
+    pdb.close();
+
+    // the atoms depend only on the file bytes, the chemical data is assigned from lib
+    uint64_t key = 0;
+    if (cache != NULL) {
+        ContentHash hash;
+        hash.update(contents.str());
+        key = hash.value();
+        if (cache->loadAtoms(key, allAtoms_, backBone_, caAtoms_)) {
+            log << "Loaded atoms from cache " << pdbFileName_ << std::endl;
+            allAtoms_.assignChemLib(lib);
+            return;
+        }
+    }
+
+    bool cif = CIF::readAtomSiteTable(contents);
+    contents.clear();
+    contents.seekg(0);
+
+    PDB::WaterHydrogenUnSelector allSelector;
+    PDB::BBSelector backBoneSelector;
+    PDB::CAlphaSelector caSelector;
+    std::string line, record;
+    while (getline(contents, line)) {
+        bool isAtom, isHetAtom;
+        if (cif) {
+            isAtom = CIF::isATOMrec(line);
+            isHetAtom = CIF::isHETATMrec(line);
+            if (!isAtom && !isHetAtom)
+                continue;
+            // selectors work on PDB records
+            std::stringstream os;
+            os << ChemAtom(line, true);
+            record = os.str();
+        } else {
+            isAtom = PDB::isATOMrec(line);
+            isHetAtom = PDB::isHETATMrec(line);
+            if (!isAtom && !isHetAtom)
+                continue;
+            record = line;
+        }
+        if (allSelector(record.c_str()))
+            allAtoms_.add(ChemAtom(line, cif));
+        if (isAtom && backBoneSelector(record.c_str()))
+            backBone_.add(ChemAtom(line, cif));
+        if (isAtom && caSelector(record.c_str()))
+            caAtoms_.add(Atom(line, cif));
+    }
+    if (cache != NULL)
+        cache->storeAtoms(key, allAtoms_, backBone_, caAtoms_);
+    allAtoms_.assignChemLib(lib);
+}
+
+uint64_t BB::geometryKey(float gridResolution, float gridMargins, bool exactDistGrid) const {
+    ContentHash hash;
+    hash.update(SURFACE_DENSITY);
+    hash.update(PROBE_RADIUS);
+    hash.update(RADIUS_ADDITION);
+    hash.update(gridResolution);
+    hash.update(gridMargins);
+    hash.update(exactDistGrid);
+    // the surface and the inside of the grid depend on the atoms, the residues grid on the backbone atoms
+    hash.update(coordinatesHash_);
+    for (ChemMolecule::const_iterator it = allAtoms_.begin(); it != allAtoms_.end(); it++)
+        hash.update(it->getRadius());
+    hash.update(backBone_.size());
+    for (ChemMolecule::const_iterator it = backBone_.begin(); it != backBone_.end(); it++) {
+        for (int k = 0; k < 3; k++)
+            hash.update(it->position()[k] + 0.0f);
+        hash.update(it->getRadius());
+        hash.update(it->residueIndex());
+    }
+    return hash.value();
+}
+
+std::shared_ptr<const BBGeometry> BB::computeGeometry(uint64_t key, float gridResolution, float gridMargins,
+                                                      const BBCache *cache, unsigned int threadsNum,
+                                                      bool exactDistGrid, std::ostream &log) const {
+    std::shared_ptr<BBGeometry> geometry = std::make_shared<BBGeometry>();
+    if (cache != NULL && cache->load(key, *geometry, RADIUS_ADDITION)) {
+        log << "Loaded surface and grid from cache " << pdbFileName_ << std::endl;
+        return geometry;
+    }
+
+    // compute ms surface
+    geometry->msSurface_ = get_connolly_surface(allAtoms_, SURFACE_DENSITY, PROBE_RADIUS, threadsNum);
+    log << "Surface size " << geometry->msSurface_.size() << std::endl;
+
+    // compute grid
+    geometry->grid_.reset(new BBGrid(geometry->msSurface_, gridResolution, gridMargins, RADIUS_ADDITION));
+    if (exactDistGrid)
+        geometry->grid_->computeExactDistFromSurface(geometry->msSurface_, threadsNum);
+    else
+        geometry->grid_->computeDistFromSurface(geometry->msSurface_);
+    geometry->grid_->markTheInside(allAtoms_);
+    geometry->grid_->markResidues(backBone_, threadsNum);
+    log << "Done compute grid " << pdbFileName_ << std::endl;
+
+    if (cache != NULL)
+        cache->store(key, *geometry);
+    return geometry;
+}
 
-    std::cout << " done reading BB " << pdbFileName_.c_str() << std::endl;
+size_t BB::estimateGridMemory(const std::string pdbFileName, float gridResolution, float gridMargins) {
+    std::ifstream pdb(pdbFileName);
+    float minCoord[3] = {MAX_FLOAT, MAX_FLOAT, MAX_FLOAT};
+    float maxCoord[3] = {MIN_FLOAT, MIN_FLOAT, MIN_FLOAT};
+    bool found = false;
+    std::string line;
+    while (getline(pdb, line)) {
+        if (!PDB::isATOMrec(line))
+            continue;
+        float coords[3] = {PDB::atomXCoord(line), PDB::atomYCoord(line), PDB::atomZCoord(line)};
+        for (int k = 0; k < 3; k++) {
+            minCoord[k] = std::min(minCoord[k], coords[k]);
+            maxCoord[k] = std::max(maxCoord[k], coords[k]);
+        }
+        found = true;
+    }
+    if (!found)
+        return 0;
+
+    // the surface lies up to an atom radius + probe radius outside the atom centers, the grid adds the margins
+    const float surfaceOffset = 3.5;
+    size_t voxels = 1;
+    for (int k = 0; k < 3; k++)
+        voxels *= (size_t)((maxCoord[k] - minCoord[k] + 2 * (surfaceOffset + gridMargins)) / gridResolution + 3);
+
+    // distances and residues grids + temporary layer and weights vectors used while computing them
+    return voxels * (sizeof(float) + sizeof(int) + sizeof(int) + sizeof(float));
 }
 
-void BB::computeFragments(float minTempFactor) {
+void BB::computeFragments(float minTempFactor, std::ostream &log) {
     // calculate endpoints
     char currChain;
     int firstResIndex, prevResIndex;
@@ -90,7 +242,7 @@ void BB::computeFragments(float minTempFactor) {
     }
 
     for (int i = 0; i < (int)fragmentEndpoints_.size(); i++) {
-        std::cout << "Fragment " << i << " chainId " << fragmentEndpoints_[i].first << " range "
+        log << "Fragment " << i << " chainId " << fragmentEndpoints_[i].first << " range "
                   << fragmentEndpoints_[i].second.first << ":" << fragmentEndpoints_[i].second.second << std::endl;
     }
 }
@@ -139,6 +291,30 @@ float BB::maxPenetration(const RigidTrans3 &trans, const BB &other) const {
     return max;
 }
 
+unsigned int BB::backbonePenetrations(const RigidTrans3 &trans, const BB &other, float threshold,
+                                      float minTempFactor, unsigned int &usedAtoms) const {
+    unsigned int penetrations = 0;
+    usedAtoms = 0;
+    // TODO: maybe should save Weighted bbPen using grid_->getDist(v) as weight
+    for (Molecule<Atom>::const_iterator it = other.caAtoms_.begin(); it != other.caAtoms_.end(); it++) {
+        if (it->getTempFactor() < minTempFactor)
+            continue;
+        usedAtoms++;
+
+        Vector3 v = trans * it->position();
+        if (getDistFromSurface(v) < 0) {
+            // getResidueEntry(v) when used in BBGrid.h will return -1*res_index if res_index is backbone
+            int resEntry = grid_->getResidueEntry(v);
+            if (resEntry < 0 && grid_->getDist(v) < threshold) {
+                if (getAtomByResId(-resEntry).getTempFactor() < minTempFactor)
+                    continue;
+                penetrations++;
+            }
+        }
+    }
+    return penetrations;
+}
+
 bool BB::isIdent(const BB &otherBB) const {
     if (getNumOfAtoms() != otherBB.getNumOfAtoms()) {
         std::cout << "different num of atoms" << std::endl;
@@ -168,7 +344,7 @@ bool BB::isIdent(const BB &otherBB) const {
         }
 
         for (unsigned int j = 0; j < trans_[i].size(); j++) {
-            if (trans_[i][j]->score() != otherBB.trans_[i][j]->score()) {
+            if (trans_[i].score(j) != otherBB.trans_[i].score(j)) {
                 std::cout << "different trans score" << i << std::endl;
                 return false;
             }
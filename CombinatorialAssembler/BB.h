@@ -1,8 +1,10 @@
 #ifndef BB_H
 #define BB_H
 
+#include "BBCache.h"
+#include "BBGeometry.h"
 #include "BBGrid.h"
-#include "TransformationAndScore.h"
+#include "TransList.h"
 #include "BitId.h"
 
 #include <ChemMolecule.h>
@@ -11,6 +13,7 @@
 #include <Surface.h>
 #include <Vector3.h>
 
+#include <stdexcept>
 #include <vector>
 
 class BBConstructor {
@@ -25,8 +28,16 @@ class BB {
   public:
     friend class SuperBB;
 
+    // if cache is given, the atoms, surface and grid are loaded from it when possible, and saved to it otherwise.
+    // if geometries is given, BBs with identical atoms built with the same store share their surface and grid.
+    // the surface and grid are computed on threadsNum threads (0 - all cores). exactDistGrid computes the grid
+    // distances with the exact Euclidean distance transform instead of the layered approximation
     BB(int id, const std::string pdbFilename, int groupID, const ChemLib &lib, float gridResolution, float gridMargins,
-       float minTempFactor);
+       float minTempFactor, const BBCache *cache = NULL, BBGeometryStore *geometries = NULL,
+       unsigned int threadsNum = 1, bool exactDistGrid = false);
+
+    // rough upper bound on the memory used while constructing the BB grid, computed from the atoms bounding box
+    static size_t estimateGridMemory(const std::string pdbFilename, float gridResolution, float gridMargins);
 
     // access
     int getID() const { return id_; }
@@ -35,58 +46,79 @@ class BB {
     std::string getPDBFileName() const { return pdbFileName_; }
 
     unsigned int getNumOfAtoms() const { return numOfAtoms_; }
+
+    // the messages of building the BB, which doesn't print them since BBs are built in parallel
+    const std::string &getBuildLog() const { return buildLog_; }
+    // hash of the atom positions, BBs with equal positions have equal hashes
+    uint64_t coordinatesHash() const { return coordinatesHash_; }
     const Vector3 &getCM() const { return cm_; }
     const float getRadius() const { return maxRadius_; }
 
     const ChemAtom &getChemAtom(int atomIndex) const { return allAtoms_.getChemAtom(atomIndex); }
     const ChemAtom &getChemAtomByIndex(int atomIndex) const { return allAtoms_[atomIndex]; }
-    const Atom &getAtomByResId(unsigned int resId) const { return resIndexToCAAtom.at(resId); }
+    const Atom &getAtomByResId(unsigned int resId) const {
+        if (resId >= resIndexToCAIndex_.size() || resIndexToCAIndex_[resId] < 0)
+            throw std::out_of_range("BB::getAtomByResId: no CA atom for residue " + std::to_string(resId));
+        return caAtoms_[resIndexToCAIndex_[resId]];
+    }
 
     unsigned int getSurfaceSize() const { return surface_.size(); }
     float getDistFromSurface(const Vector3 &v) const { return grid_->getDist(v); }
 
 
     // This uses BBConstructor to make sure that only BBContainer can call this
-    void putTransWith(int bbIndex, const std::shared_ptr<TransformationAndScore> &t1, const BBConstructor &) const {
-        trans_[bbIndex].push_back(t1);
-    }
-    void initTrans(unsigned int numberOfBBs, const BBConstructor &) const {
-        trans_.insert(trans_.begin(), numberOfBBs, std::vector<std::shared_ptr<TransformationAndScore>>());
-    }
+    void putTransWith(int bbIndex, const TransList &trans, const BBConstructor &) const { trans_[bbIndex] = trans; }
+    void initTrans(unsigned int numberOfBBs, const BBConstructor &) const { trans_.assign(numberOfBBs, TransList()); }
 
     // TODO: do we still need isPenetrating/maxPenetration ?
     bool isPenetrating(const RigidTrans3 &trans, const BB &other, float threshold) const;
     float maxPenetration(const RigidTrans3 &trans, const BB &other) const;
 
+    // number of CA atoms of other, moved by trans, that are inside this BB and closer than threshold to one of its
+    // backbone residues. CA atoms and residues with a temperature factor below minTempFactor are ignored, usedAtoms
+    // is set to the number of CA atoms of other that were checked
+    unsigned int backbonePenetrations(const RigidTrans3 &trans, const BB &other, float threshold, float minTempFactor,
+                                      unsigned int &usedAtoms) const;
+
     void getChainConnectivityConstraints(const BB &bb,
                                          std::vector<std::pair<char, std::pair<int, int>>> &) const; // update
 
-    const std::vector<std::shared_ptr<TransformationAndScore>> &getTransformations(int bbIndex) const {
-        return trans_[bbIndex];
-    }
+    const TransList &getTransformations(int bbIndex) const { return trans_[bbIndex]; }
 
     bool isIdent(const BB &otherBB) const;
     
   private:
+    // read all the atoms, the backbone atoms and the CA atoms in one pass over the file, or load them from cache
+    void readAtoms(const ChemLib &lib, const BBCache *cache, std::ostream &log);
+
     // after BB is initialized, compute chains and fragment ranges
-    void computeFragments(float minTempFactor);
+    void computeFragments(float minTempFactor, std::ostream &log);
+
+    // key of the surface and grid computed from the atoms with the given grid parameters
+    uint64_t geometryKey(float gridResolution, float gridMargins, bool exactDistGrid) const;
+
+    std::shared_ptr<const BBGeometry> computeGeometry(uint64_t key, float gridResolution, float gridMargins,
+                                                      const BBCache *cache, unsigned int threadsNum,
+                                                      bool exactDistGrid, std::ostream &log) const;
 
   private:
     // surface points
     // Different methods for computing collision
     Surface surface_;                  // shuo
-    Surface msSurface_;                // connolly - dense
+    std::shared_ptr<const BBGeometry> geometry_; // connolly - dense, and the grid
 
     // BB id
     unsigned int id_;
 
     // transformations to other BBs
     // This is the edge in a graph - The result of a patch dock calculation
-    mutable std::vector<std::vector<std::shared_ptr<TransformationAndScore>>> trans_;
+    mutable std::vector<TransList> trans_;
 
     int groupId_;
     std::string pdbFileName_;
+    std::string buildLog_;
     int numOfAtoms_;
+    uint64_t coordinatesHash_;
 
     Vector3 cm_;
     float maxRadius_;
@@ -96,11 +128,11 @@ class BB {
     std::vector<std::pair<char, ResidueRange>> fragmentEndpoints_;
 
   public: // TODO
-    BBGrid *grid_;
+    const BBGrid *grid_; // owned by geometry_
     ChemMolecule backBone_;
     ChemMolecule allAtoms_;
     Molecule<Atom> caAtoms_;
-    std::map<unsigned int, Atom> resIndexToCAAtom;
+    std::vector<int> resIndexToCAIndex_; // residue index -> index in caAtoms_, -1 if there is no CA
 };
 
 #endif /* BB_H */
@@ -0,0 +1,183 @@
+#include "BBCache.h"
+#include "BBGeometry.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+const char MAGIC[8] = {'C', 'F', 'B', 'B', 'C', 'A', 'C', 'H'};
+const uint32_t VERSION = 2;
+// the entries of the atoms and of the geometry
+const std::string ATOMS_EXTENSION = ".bba";
+const std::string GEOMETRY_EXTENSION = ".bbc";
+
+// one connolly surface point
+struct SurfaceRecord {
+    float position[3];
+    float normal[3];
+    float area;
+    int atoms[3];
+};
+
+template <class T> void writeValue(std::ostream &out, const T &value) { out.write((const char *)&value, sizeof(T)); }
+
+template <class T> T readValue(const char *&buffer, const char *end) {
+    T value;
+    if (buffer + sizeof(T) > end)
+        throw std::runtime_error("BBCache: truncated entry");
+    memcpy(&value, buffer, sizeof(T));
+    buffer += sizeof(T);
+    return value;
+}
+} // namespace
+
+BBCache::BBCache(const std::string cacheDir) : cacheDir_(cacheDir) { mkdir(cacheDir_.c_str(), 0755); }
+
+std::string BBCache::fileName(uint64_t key, const std::string extension) const {
+    std::stringstream name;
+    name << cacheDir_ << "/" << std::hex << key << extension;
+    return name.str();
+}
+
+bool BBCache::readEntry(uint64_t key, const std::string extension,
+                        const std::function<void(const char *&buffer, const char *end)> &parse) const {
+    std::string inFileName = fileName(key, extension);
+    int fd = open(inFileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(MAGIC)) {
+        close(fd);
+        return false;
+    }
+    // the contents are copied out of the entry, so it is read to a buffer rather than mapped
+    std::unique_ptr<char[]> data(new char[st.st_size]);
+    off_t done = 0;
+    while (done < st.st_size) {
+        ssize_t n = read(fd, data.get() + done, st.st_size - done);
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    close(fd);
+    if (done != st.st_size)
+        return false;
+
+    const char *buffer = data.get();
+    const char *end = buffer + st.st_size;
+    try {
+        if (memcmp(buffer, MAGIC, sizeof(MAGIC)) != 0)
+            throw std::runtime_error("BBCache: not a cache file");
+        buffer += sizeof(MAGIC);
+        if (readValue<uint32_t>(buffer, end) != VERSION || readValue<uint64_t>(buffer, end) != key)
+            throw std::runtime_error("BBCache: version or key mismatch");
+        parse(buffer, end);
+    } catch (std::runtime_error &e) {
+        std::cerr << "Ignoring cache entry " << inFileName << ": " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void BBCache::writeEntry(uint64_t key, const std::string extension,
+                         const std::function<void(std::ostream &out)> &write) const {
+    std::string outFileName = fileName(key, extension);
+    // write to a temporary file and rename, so concurrent runs never see a partial entry
+    std::string tmpFileName = outFileName + "." + std::to_string(getpid()) + "_" +
+                              std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::ofstream out(tmpFileName, std::ios::binary);
+    if (!out) {
+        std::cerr << "Can't write cache file " << tmpFileName << std::endl;
+        return;
+    }
+
+    out.write(MAGIC, sizeof(MAGIC));
+    writeValue(out, VERSION);
+    writeValue(out, key);
+    write(out);
+    out.close();
+
+    if (!out || rename(tmpFileName.c_str(), outFileName.c_str()) != 0) {
+        std::cerr << "Can't write cache file " << outFileName << std::endl;
+        unlink(tmpFileName.c_str());
+    }
+}
+
+bool BBCache::loadAtoms(uint64_t key, ChemMolecule &allAtoms, ChemMolecule &backBone,
+                        Molecule<Atom> &caAtoms) const {
+    ChemMolecule loadedAllAtoms, loadedBackBone;
+    Molecule<Atom> loadedCAAtoms;
+    if (!readEntry(key, ATOMS_EXTENSION, [&](const char *&buffer, const char *end) {
+            uint64_t allAtomsSize = readValue<uint64_t>(buffer, end);
+            for (uint64_t i = 0; i < allAtomsSize; i++)
+                loadedAllAtoms.add(ChemAtom(Atom(buffer, end)));
+            uint64_t backBoneSize = readValue<uint64_t>(buffer, end);
+            for (uint64_t i = 0; i < backBoneSize; i++)
+                loadedBackBone.add(ChemAtom(Atom(buffer, end)));
+            uint64_t caAtomsSize = readValue<uint64_t>(buffer, end);
+            for (uint64_t i = 0; i < caAtomsSize; i++)
+                loadedCAAtoms.add(Atom(buffer, end));
+        }))
+        return false;
+    allAtoms = std::move(loadedAllAtoms);
+    backBone = std::move(loadedBackBone);
+    caAtoms = std::move(loadedCAAtoms);
+    return true;
+}
+
+void BBCache::storeAtoms(uint64_t key, const ChemMolecule &allAtoms, const ChemMolecule &backBone,
+                         const Molecule<Atom> &caAtoms) const {
+    writeEntry(key, ATOMS_EXTENSION, [&](std::ostream &out) {
+        writeValue<uint64_t>(out, allAtoms.size());
+        for (ChemMolecule::const_iterator it = allAtoms.begin(); it != allAtoms.end(); it++)
+            it->writeBinary(out);
+        writeValue<uint64_t>(out, backBone.size());
+        for (ChemMolecule::const_iterator it = backBone.begin(); it != backBone.end(); it++)
+            it->writeBinary(out);
+        writeValue<uint64_t>(out, caAtoms.size());
+        for (Molecule<Atom>::const_iterator it = caAtoms.begin(); it != caAtoms.end(); it++)
+            it->writeBinary(out);
+    });
+}
+
+bool BBCache::load(uint64_t key, BBGeometry &geometry, float radiusAddition) const {
+    return readEntry(key, GEOMETRY_EXTENSION, [&](const char *&buffer, const char *end) {
+        uint64_t surfaceSize = readValue<uint64_t>(buffer, end);
+        Surface surface;
+        for (uint64_t i = 0; i < surfaceSize; i++) {
+            SurfaceRecord r = readValue<SurfaceRecord>(buffer, end);
+            surface.add(SurfacePoint(Vector3(r.position[0], r.position[1], r.position[2]),
+                                     Vector3(r.normal[0], r.normal[1], r.normal[2]), r.area, r.atoms[0], r.atoms[1],
+                                     r.atoms[2]));
+        }
+        geometry.grid_.reset(new BBGrid(buffer, end, radiusAddition));
+        geometry.msSurface_ = surface;
+    });
+}
+
+void BBCache::store(uint64_t key, const BBGeometry &geometry) const {
+    writeEntry(key, GEOMETRY_EXTENSION, [&](std::ostream &out) {
+        writeValue<uint64_t>(out, geometry.msSurface_.size());
+        for (Surface::const_iterator it = geometry.msSurface_.begin(); it != geometry.msSurface_.end(); it++) {
+            SurfaceRecord r;
+            Vector3 normal = it->normal();
+            for (int k = 0; k < 3; k++) {
+                r.position[k] = it->position()[k];
+                r.normal[k] = normal[k];
+                r.atoms[k] = it->atomIndex(k);
+            }
+            r.area = it->surfaceArea();
+            writeValue(out, r);
+        }
+        geometry.grid_->writeBinary(out);
+    });
+}
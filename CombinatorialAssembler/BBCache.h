@@ -0,0 +1,55 @@
+/**
+ * On-disk cache of the preprocessing of a BB, so a warm start neither parses the PDB nor computes the geometry:
+ * - the atoms: all the atoms, the backbone and the CA atoms as read from the file. An entry is keyed by a hash of the
+ *   file bytes (see BB::readAtoms), the chemical data of the atoms is assigned from the ChemLib after loading.
+ * - the geometry: the connolly surface and the distance and residue grid. An entry is keyed by a hash of the atoms
+ *   and the preprocessing parameters (see BB::geometryKey).
+ * Editing the PDB or changing the parameters simply misses the cache. An entry is read with one read call and parsed
+ * from memory.
+ */
+#ifndef BBCACHE_H
+#define BBCACHE_H
+
+#include <ChemMolecule.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+struct BBGeometry;
+
+class BBCache {
+  public:
+    BBCache(const std::string cacheDir);
+
+    // fills the atoms, returns false if there is no valid entry for key
+    bool loadAtoms(uint64_t key, ChemMolecule &allAtoms, ChemMolecule &backBone, Molecule<Atom> &caAtoms) const;
+
+    // saves the atoms under key, without their chemical data
+    void storeAtoms(uint64_t key, const ChemMolecule &allAtoms, const ChemMolecule &backBone,
+                    const Molecule<Atom> &caAtoms) const;
+
+    // fills the surface and grid, returns false if there is no valid entry for key
+    bool load(uint64_t key, BBGeometry &geometry, float radiusAddition) const;
+
+    // saves the surface and grid under key
+    void store(uint64_t key, const BBGeometry &geometry) const;
+
+  private:
+    std::string fileName(uint64_t key, const std::string extension) const;
+
+    // calls parse with the contents of the entry after its header, returns false if there is no valid entry.
+    // parse throws std::runtime_error if the contents are invalid
+    bool readEntry(uint64_t key, const std::string extension,
+                   const std::function<void(const char *&buffer, const char *end)> &parse) const;
+
+    // writes the header and calls write for the contents, through a temporary file
+    void writeEntry(uint64_t key, const std::string extension,
+                    const std::function<void(std::ostream &out)> &write) const;
+
+  private:
+    std::string cacheDir_;
+};
+
+#endif /* BBCACHE_H */
@@ -1,4 +1,12 @@
 #include "BBContainer.h"
+#include "Trace.h"
+#include <Logger.h>
+#include <Parallel.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <unistd.h>
+
 #include <boost/algorithm/string.hpp>
 
 namespace {
@@ -7,67 +15,329 @@ std::string trim_extension(const std::string file_name) {
         return file_name.substr(0, file_name.size() - 4);
     return file_name;
 }
+
+// Limits the total (estimated) memory of the BB grids that are under construction at the same time.
+// A request is always granted when nothing else is being built, so a single huge BB can't block forever.
+class MemoryThrottle {
+  public:
+    MemoryThrottle(size_t budget) : budget_(budget), used_(0) {}
+
+    void acquire(size_t bytes) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        released_.wait(lock, [&] { return used_ == 0 || used_ + bytes <= budget_; });
+        used_ += bytes;
+    }
+
+    void release(size_t bytes) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            used_ -= bytes;
+        }
+        released_.notify_all();
+    }
+
+  private:
+    std::mutex mutex_;
+    std::condition_variable released_;
+    size_t budget_;
+    size_t used_;
+};
+
+// the result of parsing one text pair file
+struct TransFile {
+    TransFile() : opened(false), malformed(0), count(0) {}
+    bool opened;
+    unsigned int malformed;
+    size_t count;
+};
+
+std::shared_ptr<const PairTransformations> toPairTransformations(const TransDB::Record *records, size_t count) {
+    std::shared_ptr<PairTransformations> pair = std::make_shared<PairTransformations>();
+    pair->reserve(count);
+    for (size_t k = 0; k < count; k++) {
+        RigidTrans3 trans(Vector3(records[k].rotation_[0], records[k].rotation_[1], records[k].rotation_[2]),
+                          Vector3(records[k].translation_[0], records[k].translation_[1], records[k].translation_[2]));
+        pair->add(trans, records[k].score_);
+    }
+    return pair;
+}
+
+// RMSD between two placements of a set of points, computed in O(1) from the points centroid and covariance:
+// rmsd^2 = |D*c + t1 - t2|^2 + trace(D^T * D * cov) where D = R1 - R2
+class PoseDistance {
+  public:
+    PoseDistance(const Molecule<Atom> &points) : centroid_(points.centroid()) {
+        for (int a = 0; a < 3; a++)
+            for (int b = 0; b < 3; b++)
+                covariance_[a][b] = 0.0;
+        for (Molecule<Atom>::const_iterator it = points.begin(); it != points.end(); it++) {
+            Vector3 y = it->position() - centroid_;
+            for (int a = 0; a < 3; a++)
+                for (int b = 0; b < 3; b++)
+                    covariance_[a][b] += y[a] * y[b];
+        }
+        for (int a = 0; a < 3; a++)
+            for (int b = 0; b < 3; b++)
+                covariance_[a][b] /= std::max((unsigned int)points.size(), 1u);
+    }
+
+    double rmsd2(const RigidTrans3 &t1, const RigidTrans3 &t2) const {
+        Matrix3 d = t1.rotation() - t2.rotation();
+        Vector3 centroidDiff = d * centroid_ + t1.translation() - t2.translation();
+        double rmsd2 = centroidDiff * centroidDiff;
+        for (int a = 0; a < 3; a++) {
+            for (int b = 0; b < 3; b++) {
+                double dtd = 0.0;
+                for (int k = 0; k < 3; k++)
+                    dtd += d[k][a] * d[k][b];
+                rmsd2 += dtd * covariance_[a][b];
+            }
+        }
+        return rmsd2;
+    }
+
+  private:
+    Vector3 centroid_;
+    double covariance_[3][3];
+};
+
+// greedy clustering in decreasing score order: a transformation within rmsd of the ligand CA atoms from a kept one is
+// dropped. The kept transformations stay in their original order
+std::shared_ptr<const PairTransformations> clusterTransformations(const PairTransformations &pair,
+                                                                  const Molecule<Atom> &ligand, float rmsd) {
+    PoseDistance distance(ligand);
+    std::vector<size_t> order(pair.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return pair.score(a) > pair.score(b); });
+
+    std::vector<RigidTrans3> representatives;
+    std::vector<bool> kept(pair.size(), false);
+    for (size_t i : order) {
+        RigidTrans3 trans = pair.trans(i);
+        bool clustered = false;
+        for (const RigidTrans3 &representative : representatives) {
+            if (distance.rmsd2(trans, representative) <= rmsd * rmsd) {
+                clustered = true;
+                break;
+            }
+        }
+        if (!clustered) {
+            representatives.push_back(trans);
+            kept[i] = true;
+        }
+    }
+
+    std::shared_ptr<PairTransformations> clustered = std::make_shared<PairTransformations>();
+    clustered->reserve(representatives.size());
+    for (size_t i = 0; i < pair.size(); i++) {
+        if (kept[i])
+            clustered->add(pair.trans(i), pair.score(i));
+    }
+    return clustered;
+}
+
+size_t physicalMemory() {
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGE_SIZE);
+    if (pages <= 0 || pageSize <= 0)
+        return 0;
+    return (size_t)pages * (size_t)pageSize;
+}
 } // namespace
 
-BBContainer::BBContainer(const std::string SUFileName, std::string chemLibFileName, float minTempFactor) {
-    readSUFile(SUFileName);
+BBContainer::BBContainer(const std::string SUFileName, std::string chemLibFileName, float minTempFactor,
+                         unsigned int threadsNum, unsigned long maxGridMemoryMB, std::string cacheDir,
+                         bool exactDistGrid)
+    : threadsNum_(threadsNum) {
+    std::ifstream SUFile(SUFileName);
+    if (!SUFile)
+        throw std::runtime_error("Can't open SU file " + SUFileName);
+    readSUList(SUFile);
+    buildBBs(chemLibFileName, minTempFactor, maxGridMemoryMB, cacheDir, exactDistGrid);
+}
 
-    // prepare ChemLib
+BBContainer::BBContainer(std::istream &SUList, std::string chemLibFileName, float minTempFactor,
+                         unsigned int threadsNum, unsigned long maxGridMemoryMB, std::string cacheDir,
+                         bool exactDistGrid)
+    : threadsNum_(threadsNum) {
+    readSUList(SUList);
+    buildBBs(chemLibFileName, minTempFactor, maxGridMemoryMB, cacheDir, exactDistGrid);
+}
+
+void BBContainer::buildBBs(std::string chemLibFileName, float minTempFactor, unsigned long maxGridMemoryMB,
+                           std::string cacheDir, bool exactDistGrid) {
+    Trace::Span span("build BBs", "input");
+    span.arg("BBs", numOfBBs_);
+    // prepare ChemLib, which exits if it can't read the file
+    if (!std::ifstream(chemLibFileName))
+        throw std::runtime_error("Can't find library file: " + chemLibFileName);
     ChemLib chemLib(chemLibFileName);
 
-    // read the building blocks
-    bbs_.reserve(numOfBBs_);
-    for (unsigned int i = 0; i < numOfBBs_; i++) {
-        bbs_.push_back(std::make_shared<BB>(i, pdbs_[i], groupIDs_[i], chemLib, 0.5, 5.0, minTempFactor));
+    size_t gridMemoryBudget = (size_t)maxGridMemoryMB * 1024 * 1024;
+    if (gridMemoryBudget == 0)
+        gridMemoryBudget = physicalMemory() / 2;
+    MemoryThrottle throttle(gridMemoryBudget);
+    unsigned int totalThreadsNum = threadsNum_ == 0 ? defaultThreadsNum() : threadsNum_;
+    unsigned int workersNum = std::min(totalThreadsNum, numOfBBs_);
+    // with fewer BBs than threads, the remaining threads work inside the BBs
+    unsigned int bbThreadsNum = std::max(1u, totalThreadsNum / std::max(1u, workersNum));
+    std::cout << "Building " << numOfBBs_ << " BBs on " << workersNum << " threads, grid memory budget "
+              << gridMemoryBudget / (1024 * 1024) << "MB" << std::endl;
+
+    std::unique_ptr<BBCache> cache;
+    if (!cacheDir.empty())
+        cache.reset(new BBCache(cacheDir));
+
+    // read the building blocks, each BB is independent so they are built in parallel.
+    // identical copies of a subunit share their surface and grid
+    BBGeometryStore geometries;
+    bbs_.resize(numOfBBs_);
+    parallelFor(numOfBBs_, workersNum, [&](unsigned int i) {
+        size_t gridMemory = BB::estimateGridMemory(pdbs_[i], 0.5, 5.0);
+        throttle.acquire(gridMemory);
+        Trace::Span bbSpan("BB", "input");
+        bbSpan.arg("id", i);
+        try {
+            bbs_[i] = std::make_shared<BB>(i, pdbs_[i], groupIDs_[i], chemLib, 0.5, 5.0, minTempFactor,
+                                            cache.get(), &geometries, bbThreadsNum, exactDistGrid);
+        } catch (...) {
+            throttle.release(gridMemory);
+            throw;
+        }
+        throttle.release(gridMemory);
+    });
+    // the Logger is not thread safe and the output of the workers would interleave, so the messages of each BB are
+    // printed here in the order of the BBs
+    for (const std::shared_ptr<const BB> &bb : bbs_) {
+        std::cout << bb->getBuildLog();
+        Logger::infoMessage() << "Chem molecule: " << bb->getNumOfAtoms() << " atoms were read" << std::endl;
     }
+    std::cout << numOfBBs_ << " BBs share " << geometries.size() << " surfaces and grids" << std::endl;
 }
 
-void BBContainer::readTransformationFiles(std::string transFilePrefix, unsigned int transNumToRead) {
+void BBContainer::readTransformationFiles(std::string transFilePrefix, unsigned int transNumToRead,
+                                          float clusterRMSD) {
+    Trace::Span span("read transformations", "input");
+    // transformations of each pair file, indexed by i * numOfBBs_ + j for the file i_plus_j
+    std::vector<std::shared_ptr<const PairTransformations>> pairs(numOfBBs_ * numOfBBs_);
+    if (TransDB::isTransDB(transFilePrefix)) {
+        readTransDB(transFilePrefix, transNumToRead, pairs);
+    } else {
+        readTextFiles(transFilePrefix, transNumToRead, pairs);
+    }
+    setTransformations(pairs, clusterRMSD);
+}
+
+void BBContainer::setTransformations(std::vector<std::shared_ptr<const PairTransformations>> pairs,
+                                     float clusterRMSD) {
     // init transformations vector
     for (unsigned int i = 0; i < numOfBBs_; i++) {
         bbs_[i]->initTrans(numOfBBs_, {});
     }
+    pairs.resize(numOfBBs_ * numOfBBs_);
+
+    if (clusterRMSD > 0) {
+        Trace::Span span("cluster transformations", "input");
+        // the transformations of file i_plus_j move BB j, compare them by the placement of its CA atoms
+        std::vector<size_t> before(pairs.size(), 0), after(pairs.size(), 0);
+        parallelFor(pairs.size(), threadsNum_, [&](unsigned int p) {
+            if (!pairs[p])
+                return;
+            before[p] = pairs[p]->size();
+            pairs[p] = clusterTransformations(*pairs[p], bbs_[p % numOfBBs_]->caAtoms_, clusterRMSD);
+            after[p] = pairs[p]->size();
+        });
+        size_t beforeNum = 0, afterNum = 0;
+        for (size_t p = 0; p < pairs.size(); p++) {
+            beforeNum += before[p];
+            afterNum += after[p];
+        }
+        std::cerr << "Clustering transforms at " << clusterRMSD << "A kept " << afterNum << " of " << beforeNum
+                  << std::endl;
+    }
 
-    // read the files
+    // the transformations of BB i to BB j are those of file i_plus_j and the inverse of those of file j_plus_i,
+    // ordered by file, i.e. the file of the smaller BB first
     for (size_t i = 0; i < numOfBBs_; i++) {
         for (size_t j = 0; j < numOfBBs_; j++) {
             if (i == j)
                 continue;
-            std::string inFileName = transFilePrefix + trim_extension(pdbs_[i]) + "_plus_" + trim_extension(pdbs_[j]);
-            std::ifstream inS(inFileName);
-            std::cerr << "Opening transformation file " << inFileName << std::endl;
-            if (!inS) {
-                std::cerr << "Problem opening transformation file " << inFileName << std::endl;
-                continue;
-            }
+            const std::shared_ptr<const PairTransformations> &forward = pairs[i * numOfBBs_ + j];
+            const std::shared_ptr<const PairTransformations> &reverse = pairs[j * numOfBBs_ + i];
+            if (i < j)
+                bbs_[i]->putTransWith(j, TransList(forward, false, reverse, true), {});
+            else
+                bbs_[i]->putTransWith(j, TransList(reverse, true, forward, false), {});
+        }
+    }
+}
 
-            unsigned int counter = 0;
-            while (!inS.eof() && counter < transNumToRead) {
-                TransformationAndScore *t1 = new TransformationAndScore();
-                if (readTrans(*t1, inS)) {
-                    std::shared_ptr<TransformationAndScore> t2 = std::make_shared<TransformationAndScore>(*t1);
-                    t2->refFrame_ = !t2->refFrame_;
-                    bbs_[i]->putTransWith(j, std::make_shared<TransformationAndScore>(*t1), {});
-                    bbs_[j]->putTransWith(i, t2, {});
-                    counter++;
-                }
-            }
-            std::cerr << counter << " transforms were read from file " << inFileName << std::endl;
-            inS.close();
+void BBContainer::readTextFiles(std::string transFilePrefix, unsigned int transNumToRead,
+                                std::vector<std::shared_ptr<const PairTransformations>> &pairTrans) {
+    // parse the files in parallel, then log in file order
+    std::vector<std::pair<size_t, size_t>> pairs;
+    for (size_t i = 0; i < numOfBBs_; i++) {
+        for (size_t j = 0; j < numOfBBs_; j++) {
+            if (i != j)
+                pairs.push_back(std::make_pair(i, j));
+        }
+    }
+    std::vector<TransFile> files(pairs.size());
+    parallelFor(pairs.size(), threadsNum_, [&](unsigned int p) {
+        std::string inFileName =
+            transFilePrefix + trim_extension(pdbs_[pairs[p].first]) + "_plus_" + trim_extension(pdbs_[pairs[p].second]);
+        std::vector<TransDB::Record> records;
+        files[p].opened = TransDB::readTextFile(inFileName, transNumToRead, records, files[p].malformed);
+        files[p].count = records.size();
+        if (files[p].opened)
+            pairTrans[pairs[p].first * numOfBBs_ + pairs[p].second] =
+                toPairTransformations(records.data(), records.size());
+    });
+
+    for (size_t p = 0; p < pairs.size(); p++) {
+        std::string inFileName =
+            transFilePrefix + trim_extension(pdbs_[pairs[p].first]) + "_plus_" + trim_extension(pdbs_[pairs[p].second]);
+        if (!files[p].opened) {
+            std::cerr << "Problem opening transformation file " << inFileName << std::endl;
+            continue;
         }
+        std::cerr << files[p].count << " transforms were read from file " << inFileName;
+        if (files[p].malformed > 0)
+            std::cerr << ", " << files[p].malformed << " malformed lines were skipped, the format is: "
+                      << "index(int) | score(float) | comment | transformation(space seperated 6 floats)";
+        std::cerr << std::endl;
     }
 }
 
-int BBContainer::readSUFile(const std::string SUFileName) {
-    numOfBBs_ = 0;
-    std::ifstream SUFile(SUFileName);
-    if (!SUFile) {
-        std::cerr << "Can't open SU file" << SUFileName << std::endl;
-        exit(1);
+void BBContainer::readTransDB(std::string fileName, unsigned int transNumToRead,
+                              std::vector<std::shared_ptr<const PairTransformations>> &pairTrans) {
+    TransDB db(fileName);
+    unsigned int pairsNum = 0;
+    size_t transNum = 0;
+    for (size_t i = 0; i < numOfBBs_; i++) {
+        for (size_t j = 0; j < numOfBBs_; j++) {
+            if (i == j)
+                continue;
+            uint64_t count;
+            const TransDB::Record *records = db.find(trim_extension(pdbs_[i]), trim_extension(pdbs_[j]), count);
+            if (records == NULL)
+                continue;
+            count = std::min(count, (uint64_t)transNumToRead);
+            pairTrans[i * numOfBBs_ + j] = toPairTransformations(records, count);
+            pairsNum++;
+            transNum += count;
+        }
     }
-    while (!SUFile.eof()) {
+    std::cerr << transNum << " transforms of " << pairsNum << " pairs were read from " << fileName << " ("
+              << db.pairsNum() << " pairs in the file)" << std::endl;
+}
+
+int BBContainer::readSUList(std::istream &SUList) {
+    numOfBBs_ = 0;
+    while (!SUList.eof()) {
         std::string line;
-        getline(SUFile, line);
+        getline(SUList, line);
         boost::trim(line);
         if (line.length() > 0) {
             std::vector<std::string> split_results;
@@ -89,44 +359,3 @@ int BBContainer::readSUFile(const std::string SUFileName) {
     }
     return numOfBBs_;
 }
-
-bool BBContainer::readTrans(TransformationAndScore &trans, std::ifstream &transFile) {
-    std::string line;
-    if (!transFile.eof()) {
-        getline(transFile, line);
-        boost::trim(line); // remove all spaces
-        // skip comments
-        if (line[0] == '#' || line[0] == '\0')
-            return false;
-
-        std::vector<std::string> split_results;
-        boost::split(split_results, line, boost::is_any_of(":|\t"), boost::token_compress_on);
-        if (split_results.size() != 4) {
-            std::cerr << "Wrong number of fields in transformation file, should be: "
-                      << "index(int) | score(float) | comment | transformation(space seperated 6 floats)" << std::endl;
-            return false;
-        }
-
-        boost::trim(split_results[3]);
-        std::vector<std::string> splitted_transformation;
-        boost::split(splitted_transformation, split_results[3], boost::is_any_of(" "), boost::token_compress_on);
-
-        if (splitted_transformation.size() != 6)
-            return false;
-
-        // extract trans
-        RigidTrans3 tr(Vector3(std::stof(splitted_transformation[0].c_str()),
-                               std::stof(splitted_transformation[1].c_str()),
-                               std::stof(splitted_transformation[2].c_str())),
-                       Vector3(std::stof(splitted_transformation[3].c_str()),
-                               std::stof(splitted_transformation[4].c_str()),
-                               std::stof(splitted_transformation[5].c_str())));
-        trans.refFrame_ = tr;
-        trans.score_.totalScore_ = 1.0;
-        trans.dist_ = 1.0;
-
-        trans.score_.totalScore_ = std::stof(split_results[1].c_str());
-        std::cout << "loaded score: " << trans.score_.totalScore_ << std::endl;
-    }
-    return !transFile.eof();
-}
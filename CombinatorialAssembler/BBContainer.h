@@ -6,23 +6,47 @@
 #define BB_CONTAINER_H
 
 #include "BB.h"
+#include "TransDB.h"
 #include <memory>
 
 class BBContainer {
   public:
     // Constructor
-    BBContainer(std::string SUFileName, std::string chemLibFileName, float minTempFactor);
+    // BBs are built on threadsNum threads (0 - all cores), the estimated memory of the grids that are built at the
+    // same time is kept below maxGridMemoryMB (0 - half of the physical memory)
+    // if cacheDir is given, the parsed atoms and preprocessed surfaces and grids are reused from it across runs
+    // exactDistGrid computes the grid distances with the exact Euclidean distance transform
+    // throws std::runtime_error if an input file can't be read or a BB can't be built
+    BBContainer(std::string SUFileName, std::string chemLibFileName, float minTempFactor, unsigned int threadsNum = 0,
+                unsigned long maxGridMemoryMB = 0, std::string cacheDir = "", bool exactDistGrid = false);
+    // the same with the SU list given as a stream in the format of the SU file
+    BBContainer(std::istream &SUList, std::string chemLibFileName, float minTempFactor, unsigned int threadsNum = 0,
+                unsigned long maxGridMemoryMB = 0, std::string cacheDir = "", bool exactDistGrid = false);
 
     // Group: access
     std::shared_ptr<const BB> getBB(unsigned int bbIndex) const { return bbs_[bbIndex]; }
     const std::vector<std::shared_ptr<const BB>> &getBBs() const { return bbs_; }
     unsigned int getBBsNumber() const { return numOfBBs_; }
 
-    void readTransformationFiles(std::string transFilePrefix, unsigned int transNumToRead);
+    // transFilePrefix is either the prefix of the text pair files, which are parsed in parallel, or a TransDB file.
+    // at most transNumToRead transformations are read for each pair. If clusterRMSD is positive, the transformations
+    // of each pair file are clustered by the RMSD of the moved BB CA atoms and only the best scoring of each cluster
+    // is kept. Throws std::runtime_error if the TransDB file is not valid
+    void readTransformationFiles(std::string transFilePrefix, unsigned int transNumToRead, float clusterRMSD = 0);
+
+    // replaces the transformations of the BBs, pairs[i * getBBsNumber() + j] (may be NULL) holds the
+    // transformations of the pair file i_plus_j. clusterRMSD as in readTransformationFiles
+    void setTransformations(std::vector<std::shared_ptr<const PairTransformations>> pairs, float clusterRMSD = 0);
 
   private:
-    int readSUFile(const std::string SUFileName);
-    bool readTrans(TransformationAndScore &trans, std::ifstream &transFile);
+    int readSUList(std::istream &SUList);
+    void buildBBs(std::string chemLibFileName, float minTempFactor, unsigned long maxGridMemoryMB,
+                  std::string cacheDir, bool exactDistGrid);
+    // fill the transformations of each pair file i_plus_j at pairTrans[i * numOfBBs_ + j]
+    void readTextFiles(std::string transFilePrefix, unsigned int transNumToRead,
+                       std::vector<std::shared_ptr<const PairTransformations>> &pairTrans);
+    void readTransDB(std::string fileName, unsigned int transNumToRead,
+                     std::vector<std::shared_ptr<const PairTransformations>> &pairTrans);
 
   private:
     // PDB filenames
@@ -34,6 +58,8 @@ class BBContainer {
     // total bbs num
     unsigned int numOfBBs_;
 
+    unsigned int threadsNum_;
+
     // BBs can be grouped according to a number provided by the user in SUlist
     // BBs in the same group will be assembled first
     // if no number is given, all the BBs are considered a group
@@ -0,0 +1,33 @@
+#include "BBGeometry.h"
+
+std::shared_ptr<const BBGeometry> BBGeometryStore::get(uint64_t key, const Compute &compute) {
+    std::promise<std::shared_ptr<const BBGeometry>> promise;
+    std::shared_future<std::shared_ptr<const BBGeometry>> future;
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = geometries_.find(key);
+        found = it != geometries_.end();
+        if (found)
+            future = it->second;
+        else
+            geometries_[key] = promise.get_future().share();
+    }
+    if (found)
+        return future.get();
+
+    // compute outside the lock, so different geometries are computed concurrently
+    try {
+        std::shared_ptr<const BBGeometry> geometry = compute();
+        promise.set_value(geometry);
+        return geometry;
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+}
+
+unsigned int BBGeometryStore::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return geometries_.size();
+}
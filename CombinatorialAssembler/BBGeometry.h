@@ -0,0 +1,38 @@
+#ifndef BBGEOMETRY_H
+#define BBGEOMETRY_H
+
+#include "BBGrid.h"
+
+#include <Surface.h>
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// The connolly surface and the distance and residue grid of a BB. They depend only on the atom positions, radii and
+// residue numbers, so copies of a subunit (e.g. the chains of a homomer) share one immutable instance.
+struct BBGeometry {
+    Surface msSurface_;
+    std::unique_ptr<BBGrid> grid_;
+};
+
+// Hands out one geometry per key while BBs are built in parallel. The first BB asking for a key computes the
+// geometry, BBs asking for the same key later wait for it and share it.
+class BBGeometryStore {
+  public:
+    typedef std::function<std::shared_ptr<const BBGeometry>()> Compute;
+
+    std::shared_ptr<const BBGeometry> get(uint64_t key, const Compute &compute);
+
+    // number of distinct geometries
+    unsigned int size() const;
+
+  private:
+    mutable std::mutex mutex_;
+    std::map<uint64_t, std::shared_future<std::shared_ptr<const BBGeometry>>> geometries_;
+};
+
+#endif /* BBGEOMETRY_H */
@@ -16,7 +16,11 @@ class BBGrid : public ResidueGrid {
   public:
     BBGrid(const Surface &surface, const float inDelta, const float maxRadius, float radiusAdition)
         : ResidueGrid(surface, inDelta, maxRadius), radiusAdition_(radiusAdition){};
-    void markResidues(const ChemMolecule &M);
+    // load a grid that was saved with writeBinary
+    BBGrid(const char *&buffer, const char *const end, float radiusAdition)
+        : ResidueGrid(buffer, end), radiusAdition_(radiusAdition){};
+    // marks each inside voxel with the residue of the closest backbone atom, on threadsNum threads (0 - all cores)
+    void markResidues(const ChemMolecule &M, unsigned int threadsNum = 1);
 
   private:
     float radiusAdition_;
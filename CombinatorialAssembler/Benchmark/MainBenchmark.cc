@@ -0,0 +1,362 @@
+// Times the kernels that dominate the assembler profiles on the subunits and transformations of a complex (e.g. one
+// made by scripts/generate_synthetic_complex.py), and prints ns/op and throughput of each. The inputs are drawn with
+// fixed seeds, so runs on the same complex are comparable. The exact distance transform of MoleculeGrid is checked
+// against brute force before it is timed, a mismatch exits with 1.
+#include "../BBContainer.h"
+#include "../BestK.h"
+#include "../ComplexDistanceConstraint.h"
+
+#include <Match.h>
+#include <Molecule.h>
+#include <MoleculeGrid.h>
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+namespace {
+// results of the kernels are added here so the compiler keeps them
+volatile double sink = 0;
+
+std::string filter;
+double minSeconds;
+
+// calls func(), which does opsPerCall operations, until minSeconds have passed and prints the time per operation
+template <class Func> void bench(const std::string &name, size_t opsPerCall, Func func) {
+    if (name.find(filter) == std::string::npos || opsPerCall == 0)
+        return;
+    func(); // warm up
+    size_t calls = 0;
+    auto start = std::chrono::steady_clock::now();
+    double seconds = 0;
+    do {
+        func();
+        calls++;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (seconds < minSeconds);
+    double ops = (double)calls * opsPerCall;
+    std::cout << std::left << std::setw(36) << name << std::right << std::setw(14) << (size_t)ops << std::fixed
+              << std::setprecision(1) << std::setw(12) << seconds * 1e9 / ops << " ns/op" << std::setprecision(3)
+              << std::setw(12) << ops / seconds / 1e6 << " Mop/s" << std::endl;
+}
+
+RigidTrans3 randomTrans(std::mt19937 &random) {
+    std::uniform_real_distribution<float> angle(-M_PI, M_PI), shift(-50, 50);
+    return RigidTrans3(Vector3(angle(random), angle(random), angle(random)),
+                       Vector3(shift(random), shift(random), shift(random)));
+}
+
+// a MoleculeGrid whose distances can be compared with brute force
+class CheckedGrid : public MoleculeGrid {
+  public:
+    CheckedGrid(const Surface &surface, float delta, float maxRadius) : MoleculeGrid(surface, delta, maxRadius) {}
+
+    unsigned int voxelsNum() const { return maxEntry; }
+
+    // the largest difference between the grid distances and the distances from each voxel to the closest voxel of
+    // a surface point found by brute force, as computeExactDistFromSurface defines them. MAX_FLOAT if a voxel is
+    // MAX_FLOAT in only one of them
+    float maxExactDistError(const Surface &surface) const {
+        std::vector<int> surfaceVoxels;
+        for (Surface::const_iterator it = surface.begin(); it != surface.end(); it++) {
+            int index = getIndexForPoint(it->position());
+            if (isValidIndex(index))
+                surfaceVoxels.push_back(index);
+        }
+        float maxError = 0;
+        for (int i = 0; i < maxEntry; i++) {
+            long minDist2 = -1;
+            for (int s : surfaceVoxels) {
+                long dx = i % xGridNum - s % xGridNum;
+                long dy = i / xGridNum % yGridNum - s / xGridNum % yGridNum;
+                long dz = i / xyGridNum - s / xyGridNum;
+                long dist2 = dx * dx + dy * dy + dz * dz;
+                if (minDist2 < 0 || dist2 < minDist2)
+                    minDist2 = dist2;
+            }
+            bool far = minDist2 < 0 || minDist2 > (long)maxGridRadius * maxGridRadius;
+            if (far != (grid[i] == (float)MAX_FLOAT))
+                return MAX_FLOAT;
+            if (!far)
+                maxError = std::max(maxError, std::abs(grid[i] - delta * sqrtf((float)minDist2)));
+        }
+        return maxError;
+    }
+};
+
+// a SuperBB of all the BBs reachable from the first one, joined in order with random transformations of the files
+std::shared_ptr<SuperBB> randomAssembly(const std::vector<std::shared_ptr<const BB>> &bbs,
+                                        const std::vector<unsigned int> &order, std::mt19937 &random) {
+    std::shared_ptr<SuperBB> sbb = std::make_shared<SuperBB>(bbs[order[0]]);
+    for (size_t n = 1; n < order.size(); n++) {
+        SuperBB other(bbs[order[n]]);
+        // join to the first BB of the assembly that has transformations to the new one
+        for (unsigned int i = 0; i < sbb->size(); i++) {
+            const TransList &trans = sbb->bbs_[i]->getTransformations(order[n]);
+            if (trans.size() == 0)
+                continue;
+            size_t index = std::uniform_int_distribution<size_t>(0, trans.size() - 1)(random);
+            TransIterator2 it(*sbb, other, sbb->bbs_[i]->getID(), order[n]);
+            for (size_t k = 0; k < index; k++)
+                it++;
+            FoldStep step(sbb->bbs_[i]->getID(), order[n], it.getScore());
+            sbb->join(it.transformation(), other, 0, step, it.getScore());
+            break;
+        }
+    }
+    return sbb;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    std::string suFileName, transFilesPrefix, constraintsFileName;
+    unsigned int transNumToRead, bestK, samplesNum, seed;
+    float penetrationThreshold, minTemperature;
+    po::options_description desc("Usage: Benchmark <subunitsFileList> <transFilesPrefix>\n"
+                                 "times the geometry and scoring kernels of the assembler on the subunits and "
+                                 "transformations of a complex\n");
+    desc.add_options()("help,h", "Benchmark help")(
+        "transNumToRead,n", po::value<unsigned int>(&transNumToRead)->default_value(100),
+        "number of transformations read for each pair (default=100)")(
+        "constraints", po::value<std::string>(&constraintsFileName)->default_value(""),
+        "crosslinks file for getRestraintsRatio (default=none)")(
+        "bestK,k", po::value<unsigned int>(&bestK)->default_value(100),
+        "size of the BestK of the push kernels (default=100)")(
+        "samples", po::value<unsigned int>(&samplesNum)->default_value(1000),
+        "number of random inputs of each kernel (default=1000)")(
+        "penetrationThr,p", po::value<float>(&penetrationThreshold)->default_value(-1.0),
+        "penetration threshold of the penetration kernel, as for the assembler (default=-1.0)")(
+        "minTemperatureToConsiderCollision,t", po::value<float>(&minTemperature)->default_value(0),
+        "min temperature of the penetration kernel, as for the assembler (default=0)")(
+        "min-time", po::value<double>(&minSeconds)->default_value(0.5),
+        "minimal time of each kernel in seconds (default=0.5)")(
+        "filter", po::value<std::string>(&filter)->default_value(""),
+        "only run the kernels with this in their name (default=all)")(
+        "seed", po::value<unsigned int>(&seed)->default_value(1), "seed of the random inputs (default=1)");
+    po::options_description hidden("Hidden options");
+    hidden.add_options()("SUlist", po::value<std::string>(&suFileName)->required(), "SU list file name")(
+        "transFilesPrefix", po::value<std::string>(&transFilesPrefix)->required(), "Trans files prefix");
+    po::options_description cmdline_options;
+    cmdline_options.add(desc).add(hidden);
+    po::positional_options_description p;
+    p.add("SUlist", 1);
+    p.add("transFilesPrefix", 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(cmdline_options).positional(p).run(), vm);
+        if (vm.count("help")) {
+            std::cout << desc << "\n";
+            return 0;
+        }
+        po::notify(vm);
+    } catch (po::error &e) {
+        std::cout << desc << "\n";
+        return 0;
+    }
+
+    std::string argv_str(argv[0]);
+    std::string base = argv_str.substr(0, argv_str.find_last_of("/"));
+    std::unique_ptr<BBContainer> bbContainerPtr;
+    try {
+        bbContainerPtr.reset(new BBContainer(suFileName, base + "/chem_params.txt", 0));
+        bbContainerPtr->readTransformationFiles(transFilesPrefix, transNumToRead);
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        exit(1);
+    }
+    BBContainer &bbContainer = *bbContainerPtr;
+    const std::vector<std::shared_ptr<const BB>> &bbs = bbContainer.getBBs();
+    unsigned int N = bbs.size();
+
+    ComplexDistanceConstraint complexConst(bbs);
+    if (!constraintsFileName.empty())
+        complexConst.readRestraintsFile(constraintsFileName);
+
+    // BBs with the same atoms, as the ident groups of the fold
+    std::vector<std::vector<unsigned int>> identGroups;
+    std::vector<bool> grouped(N, false);
+    for (unsigned int i = 0; i < N; i++) {
+        if (grouped[i])
+            continue;
+        std::vector<unsigned int> group(1, i);
+        for (unsigned int j = i + 1; j < N; j++) {
+            if (!grouped[j] && bbs[j]->coordinatesHash() == bbs[i]->coordinatesHash()) {
+                grouped[j] = true;
+                group.push_back(j);
+            }
+        }
+        if (group.size() > 1)
+            identGroups.push_back(group);
+    }
+
+    // the BBs in the order they are reached from the first one by the transformations
+    std::vector<unsigned int> order(1, 0);
+    std::vector<bool> reached(N, false);
+    reached[0] = true;
+    for (size_t n = 0; n < order.size(); n++) {
+        for (unsigned int j = 0; j < N; j++) {
+            if (!reached[j] && bbs[order[n]]->getTransformations(j).size() > 0) {
+                reached[j] = true;
+                order.push_back(j);
+            }
+        }
+    }
+
+    // the transformations of the files, each with the pair of BBs it places
+    struct PairTrans {
+        unsigned int i_, j_;
+        RigidTrans3 trans_;
+    };
+    std::vector<PairTrans> pairTrans;
+    for (unsigned int i = 0; i < N; i++) {
+        for (unsigned int j = 0; j < N; j++) {
+            const TransList &trans = bbs[i]->getTransformations(j);
+            for (size_t t = 0; t < trans.size(); t++)
+                pairTrans.push_back({i, j, trans.trans(t)});
+        }
+    }
+
+    std::mt19937 random(seed);
+    std::vector<RigidTrans3> trans1(samplesNum), trans2(samplesNum);
+    for (unsigned int i = 0; i < samplesNum; i++) {
+        trans1[i] = randomTrans(random);
+        trans2[i] = randomTrans(random);
+    }
+    std::vector<PairTrans> placements;
+    for (unsigned int i = 0; i < samplesNum && !pairTrans.empty(); i++)
+        placements.push_back(pairTrans[std::uniform_int_distribution<size_t>(0, pairTrans.size() - 1)(random)]);
+    std::vector<std::shared_ptr<SuperBB>> assemblies;
+    for (unsigned int i = 0; i < samplesNum; i++)
+        assemblies.push_back(randomAssembly(bbs, order, random));
+    // the assemblies as candidates of a BestK, with random scores
+    std::vector<std::shared_ptr<SuperBB>> candidates;
+    std::uniform_real_distribution<float> score(0, 100.0 * order.size());
+    for (unsigned int i = 0; i < samplesNum; i++) {
+        std::shared_ptr<SuperBB> candidate = std::make_shared<SuperBB>(*assemblies[i]);
+        candidate->transScore_ = score(random);
+        candidate->setRestraintsRatio(1);
+        candidates.push_back(candidate);
+    }
+
+    // CA atoms of the first BB and a moved copy, for the best fit of matching atoms
+    Molecule<Vector3> model, scene;
+    std::normal_distribution<float> noise(0, 1);
+    for (const Atom &atom : bbs[0]->caAtoms_) {
+        model.add(atom.position());
+        scene.add(trans1[0] * atom.position() + Vector3(noise(random), noise(random), noise(random)));
+    }
+
+    std::cout << N << " subunits, " << order.size() << " in the assemblies, " << pairTrans.size()
+              << " transformations, " << identGroups.size() << " ident groups" << std::endl;
+
+    bench("RigidTrans3 compose", samplesNum, [&]() {
+        double sum = 0;
+        for (unsigned int i = 0; i < samplesNum; i++)
+            sum += (trans1[i] * trans2[i]).translation()[0];
+        sink = sink + sum;
+    });
+    bench("RigidTrans3 inverse", samplesNum, [&]() {
+        double sum = 0;
+        for (unsigned int i = 0; i < samplesNum; i++)
+            sum += (!trans1[i]).translation()[0];
+        sink = sink + sum;
+    });
+    size_t cas = 0;
+    for (const PairTrans &placement : placements)
+        cas += bbs[placement.j_]->caAtoms_.size();
+    // the kernel of HierarchicalFold::filterTrans
+    bench("BB::backbonePenetrations (per CA)", cas, [&]() {
+        unsigned int sum = 0, usedAtoms;
+        for (const PairTrans &placement : placements)
+            sum += bbs[placement.i_]->backbonePenetrations(placement.trans_, *bbs[placement.j_], penetrationThreshold,
+                                                           minTemperature, usedAtoms);
+        sink = sink + sum;
+    });
+    bench("Match::calculateBestFit (" + std::to_string(model.size()) + " CA)", 1, [&]() {
+        Match match;
+        for (unsigned int i = 0; i < model.size(); i++)
+            match.add(i, i);
+        match.calculateBestFit(model, scene);
+        sink = sink + match.rmsd();
+    });
+    bench("Match::calculateBestFit (" + std::to_string(order.size()) + " CM)", samplesNum, [&]() {
+        double sum = 0;
+        Molecule<Vector3> cm1, cm2;
+        for (unsigned int i = 0; i < order.size(); i++) {
+            cm1.add(bbs[order[i]]->getCM());
+            cm2.add(Vector3());
+        }
+        for (unsigned int s = 0; s < samplesNum; s++) {
+            for (unsigned int i = 0; i < order.size(); i++)
+                cm2[i] = assemblies[s]->trans_[i] * assemblies[s]->bbs_[i]->getCM();
+            Match match;
+            for (unsigned int i = 0; i < order.size(); i++)
+                match.add(i, i);
+            match.calculateBestFit(cm1, cm2);
+            sum += match.rmsd();
+        }
+        sink = sink + sum;
+    });
+    bench("SuperBB::calcRmsd", samplesNum, [&]() {
+        double sum = 0;
+        for (unsigned int i = 0; i < samplesNum; i++)
+            sum += assemblies[i]->calcRmsd(*assemblies[(i + 1) % samplesNum], identGroups);
+        sink = sink + sum;
+    });
+    bench("getRestraintsRatio", samplesNum, [&]() {
+        double sum = 0;
+        for (unsigned int i = 0; i < samplesNum; i++)
+            sum += complexConst.getRestraintsRatio(assemblies[i]->bbs_, assemblies[i]->trans_);
+        sink = sink + sum;
+    });
+    bench("getWeightedTransScore", samplesNum, [&]() {
+        double sum = 0;
+        for (unsigned int i = 0; i < samplesNum; i++)
+            sum += getWeightedTransScore(assemblies[i]->foldSteps(), assemblies[i]->bbs_);
+        sink = sink + sum;
+    });
+    bench("BestK::push (k=" + std::to_string(bestK) + ")", samplesNum, [&]() {
+        BestK results(bestK);
+        for (unsigned int i = 0; i < samplesNum; i++)
+            results.push(candidates[i]);
+        sink = sink + results.minScore();
+    });
+    bench("BestK::push_cluster (k=" + std::to_string(bestK) + ")", samplesNum, [&]() {
+        BestK results(bestK);
+        for (unsigned int i = 0; i < samplesNum; i++)
+            results.push_cluster(candidates[i], 1, identGroups);
+        sink = sink + results.minScore();
+    });
+
+    // the exact distance transform of a random surface, checked against brute force before it is timed
+    Surface surface;
+    std::uniform_real_distribution<float> coordinate(0, 10);
+    for (unsigned int i = 0; i < 100; i++) {
+        Vector3 position(coordinate(random), coordinate(random), coordinate(random));
+        surface.add(SurfacePoint(position, Vector3(0, 0, 1)));
+    }
+    CheckedGrid grid(surface, 0.5, 5.0);
+    std::string exactDistName = "MoleculeGrid::computeExactDistFromSurface (per voxel)";
+    if (exactDistName.find(filter) != std::string::npos) {
+        grid.computeExactDistFromSurface(surface);
+        float error = grid.maxExactDistError(surface);
+        std::cout << "exact distance transform: max error " << error << " from brute force" << std::endl;
+        if (error > 1e-4) {
+            std::cerr << "The exact distance transform differs from brute force" << std::endl;
+            return 1;
+        }
+    }
+    bench(exactDistName, grid.voxelsNum(), [&]() {
+        grid.computeExactDistFromSurface(surface);
+        sink = sink + grid.getDist(surface[0].position());
+    });
+    return 0;
+}
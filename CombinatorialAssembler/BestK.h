@@ -31,14 +31,22 @@ class BestK : public std::multiset<std::shared_ptr<SuperBB>, comp> {
 
     float score(const std::shared_ptr<SuperBB> &sbb) const { return scoreSuperBB(sbb); }
 
+    // the bound that tryToConnect prunes with, -1 until the first push_cluster or until push fills the BestK
     float minScore() const { return curMinScore; }
     float maxScore() const { 
         if (size() == 0)
             return 0;
         return score(*rbegin()); 
     }
+    // the score of the lowest result, 0 if empty
+    float lowestScore() const {
+        if (size() == 0)
+            return 0;
+        return score(*begin());
+    }
 
     void setK(int k) { k_ = k; }
+    unsigned int k() const { return k_; }
 
     bool push(std::shared_ptr<SuperBB> in);
 
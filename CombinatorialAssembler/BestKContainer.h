@@ -36,6 +36,14 @@ class BestKContainer : private std::vector<BestK *> {
         return *((std::vector<BestK *>)(*this))[index];
     }
 
+    // the sets that have a BestK, in the order they were added
+    std::vector<BitId> sets() const {
+        std::vector<BitId> sets(set2index_.size());
+        for (const auto &[set, index] : set2index_)
+            sets[index] = set;
+        return sets;
+    }
+
     // assumes BestK for set exists
     BestK &operator[](const BitId set) { return *((std::vector<BestK *>)(*this))[set2index_[set]]; }
 
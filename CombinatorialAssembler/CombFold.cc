@@ -0,0 +1,208 @@
+#include "CombFold.h"
+
+#include "BBContainer.h"
+#include "HierarchicalFold.h"
+
+#include <exception>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct cf_bbs {
+    std::unique_ptr<BBContainer> container_;
+    std::vector<std::string> names_;
+};
+
+// the results flattened into the arrays that cf_result points to
+struct cf_results {
+    struct Result {
+        cf_result fields_;
+        ResultFile::Result data_;
+        std::vector<cf_fold_step> foldSteps_;
+    };
+
+    unsigned int size_;
+    std::vector<Result> results_, clustered_;
+};
+
+namespace {
+thread_local std::string lastError;
+
+void setError(const std::string &error) { lastError = error; }
+
+// runs func, an exception is kept as the last error and returns errorValue
+template <class T, class Func> T guard(T errorValue, Func func) {
+    lastError.clear();
+    try {
+        return func();
+    } catch (std::exception &e) {
+        setError(e.what());
+    } catch (...) {
+        setError("unknown error");
+    }
+    return errorValue;
+}
+
+void flatten(const std::vector<std::shared_ptr<SuperBB>> &sbbs, std::vector<cf_results::Result> &results) {
+    results.resize(sbbs.size());
+    for (size_t k = 0; k < sbbs.size(); k++) {
+        cf_results::Result &result = results[k];
+        const ResultFile::Result &data = result.data_ = sbbs[k]->result();
+        for (const ResultFile::Step &step : data.foldSteps_)
+            result.foldSteps_.push_back({step.i_, step.j_, step.score_});
+
+        cf_result &fields = result.fields_;
+        fields.size = data.size_;
+        fields.trans_score = data.transScore_;
+        fields.weighted_trans_score = data.weightedTransScore_;
+        fields.restraints_ratio = data.restraintsRatio_;
+        fields.max_penetration = data.maxPen_;
+        fields.multiple_penetration = data.multPen_;
+        fields.single_penetration = data.singlePen_;
+        fields.backbone_penetration = data.backBonePen_;
+        fields.bb_ids = data.bbIds_.data();
+        fields.transformations = data.trans_.data();
+        fields.fold_steps_num = result.foldSteps_.size();
+        fields.fold_steps = result.foldSteps_.data();
+    }
+}
+} // namespace
+
+int cf_api_version(void) { return CF_API_VERSION; }
+
+const char *cf_last_error(void) { return lastError.c_str(); }
+
+void cf_bbs_options_init(cf_bbs_options *options) {
+    options->min_temperature = 0;
+    options->threads = 0;
+    options->max_grid_memory_mb = 0;
+    options->cache_dir = NULL;
+    options->exact_dist_grid = 0;
+}
+
+cf_bbs *cf_bbs_create(const char *su_list, size_t su_list_size, const char *chem_lib_file,
+                      const cf_bbs_options *options) {
+    return guard<cf_bbs *>(NULL, [&]() -> cf_bbs * {
+        if (su_list == NULL || chem_lib_file == NULL) {
+            setError("cf_bbs_create: no SU list or chem lib file");
+            return NULL;
+        }
+        cf_bbs_options defaults;
+        cf_bbs_options_init(&defaults);
+        if (options == NULL)
+            options = &defaults;
+
+        std::istringstream in(std::string(su_list, su_list_size));
+        std::unique_ptr<cf_bbs> bbs(new cf_bbs());
+        bbs->container_.reset(new BBContainer(in, chem_lib_file, options->min_temperature, options->threads,
+                                              options->max_grid_memory_mb,
+                                              options->cache_dir ? options->cache_dir : "",
+                                              options->exact_dist_grid != 0));
+        if (bbs->container_->getBBsNumber() == 0) {
+            setError("cf_bbs_create: no subunits in the SU list");
+            return NULL;
+        }
+        for (const std::shared_ptr<const BB> &bb : bbs->container_->getBBs())
+            bbs->names_.push_back(bb->getPDBFileName());
+        return bbs.release();
+    });
+}
+
+void cf_bbs_free(cf_bbs *bbs) { delete bbs; }
+
+unsigned int cf_bbs_count(const cf_bbs *bbs) { return bbs->container_->getBBsNumber(); }
+
+const char *cf_bbs_name(const cf_bbs *bbs, unsigned int i) {
+    return i < bbs->names_.size() ? bbs->names_[i].c_str() : NULL;
+}
+
+int cf_bbs_set_transformations(cf_bbs *bbs, const cf_pair_transformations *pairs, size_t pairs_num,
+                               float cluster_rmsd) {
+    return guard(1, [&]() {
+        unsigned int n = bbs->container_->getBBsNumber();
+        std::vector<std::shared_ptr<const PairTransformations>> pairTrans(n * n);
+        for (size_t p = 0; p < pairs_num; p++) {
+            const cf_pair_transformations &pair = pairs[p];
+            if (pair.first >= n || pair.second >= n || pair.first == pair.second) {
+                setError("cf_bbs_set_transformations: bad BB pair " + std::to_string(pair.first) + " " +
+                         std::to_string(pair.second));
+                return 1;
+            }
+            std::shared_ptr<PairTransformations> trans = std::make_shared<PairTransformations>();
+            trans->reserve(pair.count);
+            for (size_t k = 0; k < pair.count; k++) {
+                const cf_transformation &t = pair.transformations[k];
+                trans->add(RigidTrans3(Vector3(t.rotation[0], t.rotation[1], t.rotation[2]),
+                                       Vector3(t.translation[0], t.translation[1], t.translation[2])),
+                           t.score);
+            }
+            pairTrans[pair.first * n + pair.second] = trans;
+        }
+        bbs->container_->setTransformations(pairTrans, cluster_rmsd);
+        return 0;
+    });
+}
+
+int cf_bbs_read_transformations(cf_bbs *bbs, const char *trans_files_prefix, unsigned int trans_num,
+                                float cluster_rmsd) {
+    return guard(1, [&]() {
+        bbs->container_->readTransformationFiles(trans_files_prefix, trans_num, cluster_rmsd);
+        return 0;
+    });
+}
+
+void cf_fold_options_init(cf_fold_options *options) {
+    options->best_k = 100;
+    options->max_result_per_res_set = 0;
+    options->max_backbone_collision_per_chain = 0.1;
+    options->min_temperature = 0;
+    options->penetration_threshold = -1.0;
+    options->restraints_ratio = 0.1;
+}
+
+cf_results *cf_fold(cf_bbs *bbs, const char *constraints, size_t constraints_size, const cf_fold_options *options) {
+    return guard<cf_results *>(NULL, [&]() -> cf_results * {
+        cf_fold_options defaults;
+        cf_fold_options_init(&defaults);
+        if (options == NULL)
+            options = &defaults;
+        unsigned int maxResultPerResSet =
+            options->max_result_per_res_set == 0 ? options->best_k : options->max_result_per_res_set;
+
+        HierarchicalFold fold(*bbs->container_, options->best_k, maxResultPerResSet, options->min_temperature,
+                              options->max_backbone_collision_per_chain, options->penetration_threshold,
+                              options->restraints_ratio);
+        std::istringstream in(constraints ? std::string(constraints, constraints_size) : std::string());
+        fold.readConstraints(in);
+        if (!fold.checkConnectivity()) {
+            setError("cf_fold: not enough transformations between subunits, there should be one connected "
+                     "component");
+            return NULL;
+        }
+
+        FoldResults foldResults = fold.assemble();
+        std::unique_ptr<cf_results> results(new cf_results());
+        results->size_ = foldResults.size_;
+        flatten(foldResults.results_, results->results_);
+        flatten(foldResults.clustered_, results->clustered_);
+        return results.release();
+    });
+}
+
+unsigned int cf_results_size(const cf_results *results) { return results->size_; }
+
+size_t cf_results_count(const cf_results *results, int clustered) {
+    return clustered ? results->clustered_.size() : results->results_.size();
+}
+
+int cf_results_get(const cf_results *results, int clustered, size_t i, cf_result *result) {
+    const std::vector<cf_results::Result> &list = clustered ? results->clustered_ : results->results_;
+    if (i >= list.size()) {
+        setError("cf_results_get: no result " + std::to_string(i));
+        return 1;
+    }
+    *result = list[i].fields_;
+    return 0;
+}
+
+void cf_results_free(cf_results *results) { delete results; }
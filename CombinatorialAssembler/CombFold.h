@@ -0,0 +1,155 @@
+/**
+ * C API of the combinatorial assembler, built as the shared library libcombfold.so. It runs the same assembly as
+ * CombinatorialAssembler.out in-process: the subunits (BBs) are built once from an SU list and can be folded many
+ * times with different transformations and constraints. All inputs and results are passed in memory.
+ *
+ * A run:
+ *   cf_bbs *bbs = cf_bbs_create(suList, suListSize, "chem_params.txt", NULL);
+ *   cf_bbs_read_transformations(bbs, "transformations/", 900, 0);   or cf_bbs_set_transformations
+ *   cf_results *results = cf_fold(bbs, constraints, constraintsSize, &foldOptions);
+ *   for (i = 0; i < cf_results_count(results, 1); i++) cf_results_get(results, 1, i, &result);
+ *   cf_results_free(results);
+ *   cf_bbs_free(bbs);
+ *
+ * Functions that can fail return NULL or a non zero value, cf_last_error describes the error. This covers bad input:
+ * missing PDB, chem lib or TransDB files, invalid TransDB files and atoms out of the grid. Internal errors of the
+ * molecule and grid libraries still end the process. The PDB files of the SU list are read from the paths given in
+ * it, relative to the current directory. Folds of the same cf_bbs must not run at the same time.
+ */
+#ifndef COMBFOLD_H
+#define COMBFOLD_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CF_API_VERSION 1
+
+typedef struct cf_bbs cf_bbs;
+typedef struct cf_results cf_results;
+
+// CF_API_VERSION of the library
+int cf_api_version(void);
+
+// the last error of the calling thread, empty if there was none
+const char *cf_last_error(void);
+
+// Group: BBs
+
+typedef struct {
+    // minimal B-factor of an atom to be considered for collisions (default 0)
+    float min_temperature;
+    // threads used for building the BBs, 0 - all cores (default 0)
+    unsigned int threads;
+    // memory limit of the grids built at the same time, 0 - half of the physical memory (default 0)
+    unsigned long max_grid_memory_mb;
+    // directory for caching the parsed atoms, surfaces and grids between runs, NULL - no cache (default NULL)
+    const char *cache_dir;
+    // compute the grid distances with the exact Euclidean distance transform (default 0)
+    int exact_dist_grid;
+} cf_bbs_options;
+
+void cf_bbs_options_init(cf_bbs_options *options);
+
+// builds the BBs of an SU list in the format of the SU file (su_list need not be null terminated).
+// options may be NULL for the defaults
+cf_bbs *cf_bbs_create(const char *su_list, size_t su_list_size, const char *chem_lib_file,
+                      const cf_bbs_options *options);
+void cf_bbs_free(cf_bbs *bbs);
+
+unsigned int cf_bbs_count(const cf_bbs *bbs);
+// the PDB file name of BB i as given in the SU list, NULL if there is no such BB
+const char *cf_bbs_name(const cf_bbs *bbs, unsigned int i);
+
+// Group: transformations
+
+// one transformation: rotation angles and translation, as in the pair files, and its score
+typedef struct {
+    float rotation[3];
+    float translation[3];
+    float score;
+} cf_transformation;
+
+// the transformations of the pair file <first>_plus_<second>, first and second are BB indices
+typedef struct {
+    unsigned int first, second;
+    const cf_transformation *transformations;
+    size_t count;
+} cf_pair_transformations;
+
+// replaces the transformations of all the BBs, pairs that are not given have none. The transformations are copied.
+// If cluster_rmsd is positive, the transformations of each pair are clustered and the best scoring of each cluster
+// kept. Returns 0 on success
+int cf_bbs_set_transformations(cf_bbs *bbs, const cf_pair_transformations *pairs, size_t pairs_num,
+                               float cluster_rmsd);
+
+// replaces the transformations of all the BBs by at most trans_num of each pair read from the text pair files
+// <prefix><first>_plus_<second> or from a TransDB file. Returns 0 on success
+int cf_bbs_read_transformations(cf_bbs *bbs, const char *trans_files_prefix, unsigned int trans_num,
+                                float cluster_rmsd);
+
+// Group: fold
+
+typedef struct {
+    // best solutions kept at each step (default 100)
+    unsigned int best_k;
+    // results kept for each combination of subunits, 0 - best_k (default 0)
+    unsigned int max_result_per_res_set;
+    // max fraction of the backbone atoms of a chain that can collide with another chain (default 0.1)
+    float max_backbone_collision_per_chain;
+    // minimal B-factor of an atom to be considered for collisions (default 0)
+    float min_temperature;
+    // maximum allowed penetration between subunit surfaces (default -1)
+    double penetration_threshold;
+    // minimal ratio of satisfied constraints (default 0.1)
+    double restraints_ratio;
+} cf_fold_options;
+
+void cf_fold_options_init(cf_fold_options *options);
+
+// assembles the BBs with their current transformations. constraints is in the format of the constraints file and may
+// be NULL or empty. options may be NULL for the defaults. Returns NULL on error, e.g. if the transformations don't
+// connect all the BBs
+cf_results *cf_fold(cf_bbs *bbs, const char *constraints, size_t constraints_size, const cf_fold_options *options);
+
+// Group: results
+
+typedef struct {
+    unsigned int first, second;
+    float score;
+} cf_fold_step;
+
+// one assembly, the fields of a line of the .res files. The arrays are owned by the results
+typedef struct {
+    unsigned int size;
+    float trans_score;
+    float weighted_trans_score;
+    float restraints_ratio;
+    float max_penetration;
+    int multiple_penetration;
+    int single_penetration;
+    int backbone_penetration;
+    // BB indices
+    const unsigned int *bb_ids;
+    // 6 floats for each BB: rotation angles and translation
+    const float *transformations;
+    size_t fold_steps_num;
+    const cf_fold_step *fold_steps;
+} cf_result;
+
+// number of subunits in each result: the BBs count if the fold completed, otherwise the size of the largest
+// assembled subsets (0 if none)
+unsigned int cf_results_size(const cf_results *results);
+// number of results, clustered (non zero) as in _clustered.res, clustered results exist only for complete folds
+size_t cf_results_count(const cf_results *results, int clustered);
+// fills result i, best first. Returns 0 on success
+int cf_results_get(const cf_results *results, int clustered, size_t i, cf_result *result);
+void cf_results_free(cf_results *results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMBFOLD_H */
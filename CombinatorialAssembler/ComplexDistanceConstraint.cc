@@ -81,6 +81,17 @@ int ComplexDistanceConstraint::readRestraintsFile(const std::string fileName) {
     std::vector<CrossLink> crosslinks;
     int xnum = readCrossLinkFile(fileName, crosslinks);
     Logger::infoMessage() << "# of xlinks " << xnum << " read from file" << fileName << std::endl;
+    return addCrossLinks(crosslinks);
+}
+
+int ComplexDistanceConstraint::readRestraints(std::istream &in) {
+    std::vector<CrossLink> crosslinks;
+    int xnum = readCrossLinks(in, crosslinks);
+    Logger::infoMessage() << "# of xlinks " << xnum << " read" << std::endl;
+    return addCrossLinks(crosslinks);
+}
+
+int ComplexDistanceConstraint::addCrossLinks(const std::vector<CrossLink> &crosslinks) {
     int MAX_OFFSET = 20;
 
     crosslinkIndToWeight_ = std::vector<float>(crosslinks.size());
@@ -20,6 +20,8 @@ class ComplexDistanceConstraint {
           restraintIndsToCrosslinkInds_(noOfSUs_ * noOfSUs_) {}
 
     int readRestraintsFile(const std::string fileName);
+    // reads the restraints from a stream in the format of the restraints file
+    int readRestraints(std::istream &in);
     int addChainConnectivityConstraints();
 
     int numberOfRestraints(int suInd1, int suInd2) const {
@@ -40,6 +42,9 @@ class ComplexDistanceConstraint {
                              const std::vector<RigidTrans3> &trans) const;
 
   private:
+    // maps the cross links to restraints between the SUs that have their residues
+    int addCrossLinks(const std::vector<CrossLink> &crosslinks);
+
     void addConstraint(int suInd1, int suInd2, Vector3 receptorAtom, Vector3 ligandAtom, float maxDistance,
                        float minDistance = 0);
 
@@ -0,0 +1,288 @@
+#include "FoldCheckpoint.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+const char MAGIC[8] = {'C', 'F', 'C', 'H', 'K', 'P', 'N', 'T'};
+const char CANDIDATES_MAGIC[8] = {'C', 'F', 'C', 'A', 'N', 'D', 'I', 'D'};
+const uint32_t VERSION = 1;
+const uint32_t CANDIDATES_VERSION = 2;
+
+template <class T> void writeValue(std::ostream &out, const T &value) { out.write((const char *)&value, sizeof(T)); }
+
+template <class T> T readValue(std::istream &in) {
+    T value;
+    if (!in.read((char *)&value, sizeof(T)))
+        throw std::runtime_error("truncated file");
+    return value;
+}
+
+void writeString(std::ostream &out, const std::string &s) {
+    writeValue<uint32_t>(out, s.size());
+    out.write(s.data(), s.size());
+}
+
+std::string readString(std::istream &in) {
+    uint32_t length = readValue<uint32_t>(in);
+    std::string s(length, '\0');
+    if (!in.read(&s[0], length))
+        throw std::runtime_error("truncated file");
+    return s;
+}
+
+void writeTrans(std::ostream &out, const RigidTrans3 &trans) {
+    for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 3; c++)
+            writeValue<float>(out, trans.rotation()[r][c]);
+    for (int c = 0; c < 3; c++)
+        writeValue<float>(out, trans.translation()[c]);
+}
+
+RigidTrans3 readTrans(std::istream &in) {
+    float rotation[9];
+    for (int k = 0; k < 9; k++)
+        rotation[k] = readValue<float>(in);
+    float t[3];
+    for (int k = 0; k < 3; k++)
+        t[k] = readValue<float>(in);
+    return RigidTrans3(Matrix3(rotation), Vector3(t[0], t[1], t[2]));
+}
+
+void writeSet(std::ostream &out, const BitId &set) {
+    writeValue<uint32_t>(out, set.count());
+    for (uint32_t i = 0; i < set.size(); i++) {
+        if (set.test(i))
+            writeValue<uint32_t>(out, i);
+    }
+}
+
+BitId readSet(std::istream &in, unsigned int bbsNum) {
+    BitId set;
+    uint32_t count = readValue<uint32_t>(in);
+    for (uint32_t k = 0; k < count; k++) {
+        uint32_t i = readValue<uint32_t>(in);
+        if (i >= bbsNum)
+            throw std::runtime_error("bad subunit set");
+        set.set(i);
+    }
+    return set;
+}
+
+// the SuperBBs of bestK as indices in sbbIndex, from the lowest score
+void writeBestK(std::ostream &out, const BestK &bestK, const std::map<const SuperBB *, uint64_t> &sbbIndex) {
+    writeValue<uint64_t>(out, bestK.size());
+    for (const std::shared_ptr<SuperBB> &sbb : bestK)
+        writeValue<uint64_t>(out, sbbIndex.at(sbb.get()));
+}
+
+// pushing in the saved order keeps the order of equal scores
+void readBestK(std::istream &in, BestK &bestK, const std::vector<std::shared_ptr<SuperBB>> &sbbs) {
+    uint64_t count = readValue<uint64_t>(in);
+    for (uint64_t k = 0; k < count; k++) {
+        uint64_t index = readValue<uint64_t>(in);
+        if (index >= sbbs.size())
+            throw std::runtime_error("bad result index");
+        bestK.push(sbbs[index]);
+    }
+}
+} // namespace
+
+void FoldCheckpoint::writeSuperBB(std::ostream &out, const SuperBB &sbb) {
+    writeValue<uint32_t>(out, sbb.bbs_.size());
+    writeValue<uint32_t>(out, sbb.foldSteps_.size());
+    for (unsigned int i = 0; i < sbb.bbs_.size(); i++) {
+        writeValue<uint32_t>(out, sbb.bbs_[i]->getID());
+        writeTrans(out, sbb.trans_[i]);
+    }
+    for (const FoldStep &step : sbb.foldSteps_) {
+        writeValue<uint32_t>(out, step.i_);
+        writeValue<uint32_t>(out, step.j_);
+        writeValue<float>(out, step.tScore_);
+    }
+    writeValue<float>(out, sbb.restraintsRatio_);
+    writeValue<float>(out, sbb.maxPen_);
+    writeValue<float>(out, sbb.transScore_);
+    writeValue<float>(out, sbb.weightedTransScore_);
+    writeValue<int32_t>(out, sbb.backBonePen_);
+    writeValue<int32_t>(out, sbb.multPen_);
+    writeValue<int32_t>(out, sbb.singlePen_);
+}
+
+std::shared_ptr<SuperBB> FoldCheckpoint::readSuperBB(std::istream &in,
+                                                     const std::vector<std::shared_ptr<const BB>> &bbs) {
+    uint32_t size = readValue<uint32_t>(in);
+    uint32_t foldStepsNum = readValue<uint32_t>(in);
+    if (size == 0 || size > bbs.size())
+        throw std::runtime_error("bad result size");
+
+    std::shared_ptr<SuperBB> sbb;
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t id = readValue<uint32_t>(in);
+        if (id >= bbs.size())
+            throw std::runtime_error("bad subunit id");
+        RigidTrans3 trans = readTrans(in);
+        if (i == 0) {
+            sbb = std::make_shared<SuperBB>(bbs[id]);
+            sbb->trans_[0] = trans;
+        } else {
+            sbb->bbs_.push_back(bbs[id]);
+            sbb->trans_.push_back(trans);
+            sbb->bitIDS_ |= bbs[id]->bitId();
+        }
+    }
+    sbb->size_ = size;
+    for (uint32_t k = 0; k < foldStepsNum; k++) {
+        unsigned int i = readValue<uint32_t>(in);
+        unsigned int j = readValue<uint32_t>(in);
+        sbb->foldSteps_.push_back(FoldStep(i, j, readValue<float>(in)));
+    }
+    sbb->restraintsRatio_ = readValue<float>(in);
+    sbb->maxPen_ = readValue<float>(in);
+    sbb->transScore_ = readValue<float>(in);
+    sbb->weightedTransScore_ = readValue<float>(in);
+    sbb->backBonePen_ = readValue<int32_t>(in);
+    sbb->multPen_ = readValue<int32_t>(in);
+    sbb->singlePen_ = readValue<int32_t>(in);
+    return sbb;
+}
+
+bool FoldCheckpoint::write(const std::string fileName, unsigned int length,
+                           const std::vector<std::shared_ptr<const BB>> &bbs,
+                           const std::map<unsigned int, BestK *> &keptResultsByLength,
+                           const BestKContainer &container) {
+    // the saved BestKs, the results of single subunits are built by HierarchicalFold
+    std::vector<const BestK *> kept;
+    for (unsigned int l = 2; l <= length; l++)
+        kept.push_back(keptResultsByLength.at(l));
+    std::vector<BitId> sets;
+    for (const BitId &set : container.sets()) {
+        if (set.count() > 1)
+            sets.push_back(set);
+    }
+
+    // each SuperBB is written once, the BestKs refer to it by index
+    std::map<const SuperBB *, uint64_t> sbbIndex;
+    std::vector<const SuperBB *> sbbs;
+    auto addSuperBBs = [&](const BestK &bestK) {
+        for (const std::shared_ptr<SuperBB> &sbb : bestK) {
+            if (sbbIndex.insert(std::make_pair(sbb.get(), sbbs.size())).second)
+                sbbs.push_back(sbb.get());
+        }
+    };
+    for (const BestK *bestK : kept)
+        addSuperBBs(*bestK);
+    for (const BitId &set : sets)
+        addSuperBBs(container[set]);
+
+    std::string tmpFileName = fileName + ".tmp";
+    std::ofstream out(tmpFileName, std::ios::binary);
+    if (!out)
+        return false;
+    out.write(MAGIC, sizeof(MAGIC));
+    writeValue<uint32_t>(out, VERSION);
+    writeValue<uint32_t>(out, length);
+    writeValue<uint32_t>(out, bbs.size());
+    for (const std::shared_ptr<const BB> &bb : bbs)
+        writeString(out, bb->getPDBFileName());
+
+    writeValue<uint64_t>(out, sbbs.size());
+    for (const SuperBB *sbb : sbbs)
+        writeSuperBB(out, *sbb);
+    for (const BestK *bestK : kept) {
+        writeValue<uint32_t>(out, bestK->k());
+        writeBestK(out, *bestK, sbbIndex);
+    }
+    writeValue<uint64_t>(out, sets.size());
+    for (const BitId &set : sets) {
+        writeSet(out, set);
+        writeBestK(out, container[set], sbbIndex);
+    }
+    out.close();
+    if (!out)
+        return false;
+    return std::rename(tmpFileName.c_str(), fileName.c_str()) == 0;
+}
+
+bool FoldCheckpoint::writeCandidates(const std::string fileName, const std::vector<ShardCandidate> &candidates) {
+    std::string tmpFileName = fileName + ".tmp";
+    std::ofstream out(tmpFileName, std::ios::binary);
+    if (!out)
+        return false;
+    out.write(CANDIDATES_MAGIC, sizeof(CANDIDATES_MAGIC));
+    writeValue<uint32_t>(out, CANDIDATES_VERSION);
+    writeValue<uint64_t>(out, candidates.size());
+    for (const ShardCandidate &candidate : candidates) {
+        writeValue<uint64_t>(out, candidate.pairIndex_);
+        writeValue<float>(out, candidate.boundScore_);
+        writeValue<int32_t>(out, candidate.firstBB_);
+        writeValue<int32_t>(out, candidate.secondBB_);
+        writeSuperBB(out, *candidate.sbb_);
+    }
+    out.close();
+    if (!out)
+        return false;
+    return std::rename(tmpFileName.c_str(), fileName.c_str()) == 0;
+}
+
+void FoldCheckpoint::readCandidates(const std::string fileName, const std::vector<std::shared_ptr<const BB>> &bbs,
+                                    const std::function<void(const ShardCandidate &)> &add) {
+    std::ifstream in(fileName, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("can't open " + fileName);
+    char magic[sizeof(MAGIC)];
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, CANDIDATES_MAGIC, sizeof(CANDIDATES_MAGIC)) != 0 ||
+        readValue<uint32_t>(in) != CANDIDATES_VERSION)
+        throw std::runtime_error(fileName + " is not a candidates file of version " +
+                                 std::to_string(CANDIDATES_VERSION));
+    uint64_t count = readValue<uint64_t>(in);
+    for (uint64_t i = 0; i < count; i++) {
+        ShardCandidate candidate;
+        candidate.pairIndex_ = readValue<uint64_t>(in);
+        candidate.boundScore_ = readValue<float>(in);
+        candidate.firstBB_ = readValue<int32_t>(in);
+        candidate.secondBB_ = readValue<int32_t>(in);
+        candidate.sbb_ = readSuperBB(in, bbs);
+        add(candidate);
+    }
+}
+
+unsigned int FoldCheckpoint::read(const std::string fileName, const std::vector<std::shared_ptr<const BB>> &bbs,
+                                  std::map<unsigned int, BestK *> &keptResultsByLength, BestKContainer &container) {
+    std::ifstream in(fileName, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("can't open " + fileName);
+    char magic[sizeof(MAGIC)];
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        readValue<uint32_t>(in) != VERSION)
+        throw std::runtime_error("not a checkpoint of version " + std::to_string(VERSION));
+    unsigned int length = readValue<uint32_t>(in);
+    if (readValue<uint32_t>(in) != bbs.size())
+        throw std::runtime_error("the checkpoint is of a different number of subunits");
+    for (const std::shared_ptr<const BB> &bb : bbs) {
+        if (readString(in) != bb->getPDBFileName())
+            throw std::runtime_error("the checkpoint is of different subunits");
+    }
+    if (length < 2 || length > bbs.size())
+        throw std::runtime_error("bad completed length");
+
+    std::vector<std::shared_ptr<SuperBB>> sbbs(readValue<uint64_t>(in));
+    for (std::shared_ptr<SuperBB> &sbb : sbbs)
+        sbb = readSuperBB(in, bbs);
+    for (unsigned int l = 2; l <= length; l++) {
+        delete keptResultsByLength[l];
+        keptResultsByLength[l] = new BestK(readValue<uint32_t>(in));
+        readBestK(in, *keptResultsByLength[l], sbbs);
+    }
+    uint64_t setsNum = readValue<uint64_t>(in);
+    for (uint64_t k = 0; k < setsNum; k++) {
+        BitId set = readSet(in, bbs.size());
+        if (!container.isEmpty(set))
+            throw std::runtime_error("repeated subunit set");
+        readBestK(in, *container.newBestK(set), sbbs);
+    }
+    return length;
+}
@@ -0,0 +1,58 @@
+/**
+ * The state of HierarchicalFold after a length is completed, saved to a binary checkpoint file so a run can resume
+ * from the next length. It holds the kept results of each length and the BestK of each subunit set, with every
+ * SuperBB written once as its BB ids, transformations, fold steps and scores. The transformations are written as
+ * their rotation matrices, so a resumed run continues with exactly the same results.
+ *
+ * The same encoding is used for the candidate results that each shard of a sharded fold computes for a length.
+ */
+#ifndef FOLDCHECKPOINT_H
+#define FOLDCHECKPOINT_H
+
+#include "BestKContainer.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// a result that a shard of a sharded fold connected, before it is pushed to the BestK of its subunit set
+struct ShardCandidate {
+    uint64_t pairIndex_; // the pair of kept results it was connected from, in the order of the fold
+    float boundScore_;   // the score that tryToConnect compares to the minimum of the BestK
+    int32_t firstBB_;    // the pair of BBs it was connected by, for the counters of the pair
+    int32_t secondBB_;
+    std::shared_ptr<SuperBB> sbb_;
+};
+
+class FoldCheckpoint {
+  public:
+    // writes the kept results of lengths 2 to length and the BestKs of container to fileName, through a temporary
+    // file so an interrupted write keeps the previous checkpoint. bbs are the BBs by id. Returns false on error
+    static bool write(const std::string fileName, unsigned int length,
+                      const std::vector<std::shared_ptr<const BB>> &bbs,
+                      const std::map<unsigned int, BestK *> &keptResultsByLength, const BestKContainer &container);
+
+    // reads a checkpoint of the same BBs, adds the kept results of each saved length to keptResultsByLength and the
+    // saved BestKs of more than one subunit to container. Returns the completed length, throws std::runtime_error
+    // on error
+    static unsigned int read(const std::string fileName, const std::vector<std::shared_ptr<const BB>> &bbs,
+                             std::map<unsigned int, BestK *> &keptResultsByLength, BestKContainer &container);
+
+    // writes the candidates of one shard for a length to fileName, through a temporary file so the file appears
+    // complete. Returns false on error
+    static bool writeCandidates(const std::string fileName, const std::vector<ShardCandidate> &candidates);
+
+    // reads a file of writeCandidates, calls add(candidate) for each candidate in the order they were written.
+    // Throws std::runtime_error on error
+    static void readCandidates(const std::string fileName, const std::vector<std::shared_ptr<const BB>> &bbs,
+                               const std::function<void(const ShardCandidate &)> &add);
+
+  private:
+    static void writeSuperBB(std::ostream &out, const SuperBB &sbb);
+    static std::shared_ptr<SuperBB> readSuperBB(std::istream &in, const std::vector<std::shared_ptr<const BB>> &bbs);
+};
+
+#endif /* FOLDCHECKPOINT_H */
@@ -0,0 +1,97 @@
+#include "FoldStats.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sys/resource.h>
+
+namespace {
+void writeCounters(std::ostream &out, const FoldCounters &counters) {
+    out << "{\"pairsConsidered\": " << counters.pairsConsidered_ << ", \"pairsPruned\": " << counters.pairsPruned_
+        << ", \"transformationsTried\": " << counters.transTried_
+        << ", \"penetrationChecks\": " << counters.penetrationChecks_
+        << ", \"sphereSkipped\": " << counters.sphereSkipped_ << ", \"rejected\": {\"scoreBound\": "
+        << counters.scoreBound_ << ", \"constraints\": " << counters.constraints_
+        << ", \"penetration\": " << counters.penetration_ << ", \"restraints\": " << counters.restraints_
+        << ", \"dominated\": " << counters.dominated() << "}, \"pushed\": " << counters.pushed_
+        << ", \"accepted\": " << counters.accepted_ << "}";
+}
+} // namespace
+
+FoldCounters &FoldCounters::operator+=(const FoldCounters &other) {
+    pairsConsidered_ += other.pairsConsidered_;
+    pairsPruned_ += other.pairsPruned_;
+    transTried_ += other.transTried_;
+    penetrationChecks_ += other.penetrationChecks_;
+    sphereSkipped_ += other.sphereSkipped_;
+    scoreBound_ += other.scoreBound_;
+    constraints_ += other.constraints_;
+    penetration_ += other.penetration_;
+    restraints_ += other.restraints_;
+    pushed_ += other.pushed_;
+    accepted_ += other.accepted_;
+    return *this;
+}
+
+FoldCounters FoldCounters::operator-(const FoldCounters &other) const {
+    FoldCounters result = *this;
+    result.pairsConsidered_ -= other.pairsConsidered_;
+    result.pairsPruned_ -= other.pairsPruned_;
+    result.transTried_ -= other.transTried_;
+    result.penetrationChecks_ -= other.penetrationChecks_;
+    result.sphereSkipped_ -= other.sphereSkipped_;
+    result.scoreBound_ -= other.scoreBound_;
+    result.constraints_ -= other.constraints_;
+    result.penetration_ -= other.penetration_;
+    result.restraints_ -= other.restraints_;
+    result.pushed_ -= other.pushed_;
+    result.accepted_ -= other.accepted_;
+    return result;
+}
+
+long FoldStats::peakRSSKB() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_maxrss;
+}
+
+bool FoldStats::write(const std::string fileName, unsigned int subunits, unsigned int k, unsigned int resultSize,
+                      const StatsClock &clock, const std::vector<LengthStats> &lengths) {
+    std::ofstream out(fileName + ".tmp");
+    out << "{\"subunits\": " << subunits << ", \"bestK\": " << k << ", \"resultSize\": " << resultSize
+        << ", \"wallSeconds\": " << clock.wallSeconds() << ", \"cpuSeconds\": " << clock.cpuSeconds()
+        << ", \"peakRSSKB\": " << peakRSSKB() << ",\n \"lengths\": [";
+    for (size_t l = 0; l < lengths.size(); l++) {
+        const LengthStats &length = lengths[l];
+        out << (l == 0 ? "\n  " : ",\n  ") << "{\"length\": " << length.length_
+            << ", \"wallSeconds\": " << length.wallSeconds_ << ", \"cpuSeconds\": " << length.cpuSeconds_
+            << ", \"counters\": ";
+        writeCounters(out, length.counters_);
+        out << ", \"resultSets\": " << length.resultSets_ << ", \"candidates\": " << length.candidates_
+            << ", \"clustered\": " << length.clustered_ << ", \"maxSetSize\": " << length.maxSetSize_
+            << ", \"kept\": " << length.kept_ << ", \"minScore\": " << length.minScore_
+            << ", \"maxScore\": " << length.maxScore_ << ", \"peakRSSKB\": " << length.peakRSSKB_
+            << ",\n   \"subIterations\": [";
+        for (size_t s = 0; s < length.subIterations_.size(); s++) {
+            const SubIterationStats &subIteration = length.subIterations_[s];
+            out << (s == 0 ? "\n    " : ",\n    ") << "{\"sizes\": [" << subIteration.firstSize_ << ", "
+                << subIteration.secondSize_ << "], \"wallSeconds\": " << subIteration.wallSeconds_
+                << ", \"cpuSeconds\": " << subIteration.cpuSeconds_ << ", \"counters\": ";
+            writeCounters(out, subIteration.counters_);
+            out << "}";
+        }
+        out << "],\n   \"bbPairs\": [";
+        bool first = true;
+        for (const auto &[bbs, counters] : length.bbPairs_) {
+            out << (first ? "\n    " : ",\n    ") << "{\"bbs\": [" << bbs.first << ", " << bbs.second
+                << "], \"counters\": ";
+            writeCounters(out, counters);
+            out << "}";
+            first = false;
+        }
+        out << "]}";
+    }
+    out << "]}" << std::endl;
+    out.close();
+    return out && std::rename((fileName + ".tmp").c_str(), fileName.c_str()) == 0;
+}
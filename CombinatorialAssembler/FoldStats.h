@@ -0,0 +1,87 @@
+/**
+ * Statistics of a fold for --stats-json: the work counters of tryToConnect and filterTrans, and the time, BestK sizes
+ * and scores of each length and sub-iteration, written as one JSON document.
+ */
+#ifndef FOLDSTATS_H
+#define FOLDSTATS_H
+
+#include <chrono>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+// counts of the work done connecting pairs of kept results
+struct FoldCounters {
+    unsigned long pairsConsidered_ = 0;   // pairs of kept results of a sub-iteration
+    unsigned long pairsPruned_ = 0;       // pairs not connected: ident subunits, overlapping or invalid assembly
+    unsigned long transTried_ = 0;        // transformations between the BBs of the connected pairs
+    unsigned long penetrationChecks_ = 0; // pairs of BBs placed by a transformation checked for penetration
+    unsigned long sphereSkipped_ = 0;     // of them, not checked since their bounding spheres don't intersect
+    // rejected transformations by reason
+    unsigned long scoreBound_ = 0;  // the score can't reach the minimum of the BestK
+    unsigned long constraints_ = 0; // areConstraintsSatisfied
+    unsigned long penetration_ = 0; // backbone penetration above maxBackboneCollisionPercentPerChain
+    unsigned long restraints_ = 0;  // restraints ratio below the threshold
+    unsigned long pushed_ = 0;      // candidates pushed to the BestK of their set
+    unsigned long accepted_ = 0;    // candidates kept by push_cluster, the others are dominated by its results
+
+    // transformations tried that didn't add a result, and candidates pushed that push_cluster didn't keep. 0 rather
+    // than wrapping if the counters are inconsistent
+    unsigned long wasted() const { return transTried_ > accepted_ ? transTried_ - accepted_ : 0; }
+    unsigned long dominated() const { return pushed_ > accepted_ ? pushed_ - accepted_ : 0; }
+
+    FoldCounters &operator+=(const FoldCounters &other);
+    FoldCounters operator-(const FoldCounters &other) const;
+};
+
+// the counters of tryToConnect by the pair of BBs of the tried transformations, smaller ID first
+typedef std::map<std::pair<unsigned int, unsigned int>, FoldCounters> BBPairCounters;
+
+// wall and process CPU time since construction
+class StatsClock {
+  public:
+    StatsClock() : wall_(std::chrono::steady_clock::now()), cpu_(std::clock()) {}
+    double wallSeconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_).count();
+    }
+    double cpuSeconds() const { return (double)(std::clock() - cpu_) / CLOCKS_PER_SEC; }
+
+  private:
+    std::chrono::steady_clock::time_point wall_;
+    std::clock_t cpu_;
+};
+
+struct SubIterationStats {
+    unsigned int firstSize_, secondSize_;
+    double wallSeconds_, cpuSeconds_;
+    FoldCounters counters_;
+};
+
+struct LengthStats {
+    unsigned int length_;
+    double wallSeconds_, cpuSeconds_;
+    std::vector<SubIterationStats> subIterations_;
+    FoldCounters counters_;   // of all the sub-iterations
+    BBPairCounters bbPairs_;  // of all the sub-iterations
+    unsigned int resultSets_; // subunit sets with results
+    size_t candidates_;       // results of all the sets before clustering
+    size_t clustered_;        // results of all the sets after clustering
+    size_t maxSetSize_;       // largest BestK of a set before clustering
+    size_t kept_;             // kept results of the length
+    float minScore_, maxScore_; // of the kept results, 0 if there are none
+    long peakRSSKB_;
+};
+
+class FoldStats {
+  public:
+    // peak resident set size of the process in KB
+    static long peakRSSKB();
+
+    // writes the statistics through a temporary file, so readers never see a partial file. resultSize is the size
+    // of the results, 0 while the fold is running. Returns false on error
+    static bool write(const std::string fileName, unsigned int subunits, unsigned int k, unsigned int resultSize,
+                      const StatsClock &clock, const std::vector<LengthStats> &lengths);
+};
+
+#endif /* FOLDSTATS_H */
@@ -1,4 +1,19 @@
 #include "HierarchicalFold.h"
+#include "FoldCheckpoint.h"
+#include "Trace.h"
+
+#include <ContentHash.h>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
 
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/connected_components.hpp>
@@ -7,25 +22,65 @@ Timer HierarchicalFold::timer_;
 Timer HierarchicalFold::timerAll_;
 unsigned int HierarchicalFold::countResults_(0);
 
+namespace {
+// the abort file of this shard, empty once its fold is done. A fixed buffer, since it is read in a signal handler
+char abortFileName[4096] = "";
+
+void writeShardAbort() {
+    if (abortFileName[0] == '\0')
+        return;
+    int fd = open(abortFileName, O_WRONLY | O_CREAT, 0644);
+    if (fd >= 0)
+        close(fd);
+}
+
+void shardAbortSignal(int signal) {
+    writeShardAbort();
+    std::signal(signal, SIG_DFL);
+    std::raise(signal);
+}
+} // namespace
+
 std::vector<std::vector<unsigned int>> createIdentGroups(unsigned int N_, BestKContainer &bestKContainer_) {
+    std::vector<std::shared_ptr<const BB>> bbs;
+    for (unsigned int i = 0; i < N_; i++)
+        bbs.push_back((*(bestKContainer_[BitId(i)].begin()))->bbs_[0]);
+
+    // BB::isIdent requires equal atoms, group id and transformation scores to every other BB. The fingerprint hashes
+    // all of them except the transformations to BBs with the same atoms, since these are the BBs that may be in the
+    // ident group and isIdent skips the pair itself. Equal fingerprints are necessary for isIdent, so it is checked
+    // only for BBs with the same fingerprint.
+    std::unordered_map<uint64_t, std::vector<unsigned int>> buckets;
+    std::vector<uint64_t> fingerprints(N_);
+    for (unsigned int i = 0; i < N_; i++) {
+        ContentHash hash;
+        hash.update(bbs[i]->coordinatesHash());
+        hash.update(bbs[i]->groupId());
+        for (unsigned int k = 0; k < N_; k++) {
+            if (bbs[k]->coordinatesHash() == bbs[i]->coordinatesHash())
+                continue;
+            const TransList &trans = bbs[i]->getTransformations(k);
+            hash.update(k);
+            hash.update(trans.size());
+            for (size_t t = 0; t < trans.size(); t++)
+                hash.update(trans.score(t) + 0.0f);
+        }
+        fingerprints[i] = hash.value();
+        buckets[fingerprints[i]].push_back(i);
+    }
+
     std::vector<bool> addedToGroup(N_, false);
     std::vector<std::vector<unsigned int>> identGroups;
     for (unsigned int i = 0; i < N_; i++) {
-        std::shared_ptr<SuperBB> sbbI = *(bestKContainer_[BitId(i)].begin());
-        const std::shared_ptr<const BB> bbI = sbbI->bbs_[0];
-
         if (addedToGroup[i])
             continue;
         addedToGroup[i] = true;
         std::vector<unsigned int> identical;
 
-        for (unsigned int j = i + 1; j < N_; j++) {
-            std::cout << "checking ident " << i << " & " << j << std::endl;
-            std::shared_ptr<SuperBB> sbbJ = *(bestKContainer_[BitId(j)].begin());
-
-            const std::shared_ptr<const BB> bbJ = sbbJ->bbs_[0];
-
-            if (bbI->isIdent(*bbJ)) {
+        for (unsigned int j : buckets[fingerprints[i]]) {
+            if (j <= i)
+                continue;
+            if (bbs[i]->isIdent(*bbs[j])) {
                 addedToGroup[j] = true;
                 std::cout << "found ident " << i << " " << j << std::endl;
                 identical.push_back(j);
@@ -89,7 +144,7 @@ void printBestK(unsigned int N_, BestK *bestK) {
             }
     }
 
-    std::cout << "scores of saved " << bestK->minScore() << ":" << bestK->maxScore() << std::endl;
+    std::cout << "scores of saved " << bestK->lowestScore() << ":" << bestK->maxScore() << std::endl;
     std::cout << "new kept results by chain ";
     for (const auto &elem : count_new_kept_by_bb)
         std::cout << elem.first << ":" << elem.second << ", ";
@@ -143,7 +198,158 @@ bool isValidBasedOnAssembly(std::map<unsigned int, std::vector<unsigned int>> as
     return true;
 }
 
-void HierarchicalFold::fold(const std::string &outFileNamePrefix) {
+FoldResults HierarchicalFold::fold(const std::string &outFileNamePrefix) {
+    FoldResults results = assemble();
+    if (results.size_ == N_) {
+        // fully assembled results
+        std::ofstream outFile(outFileNamePrefix + ".res");
+        std::ofstream outFileClustered(outFileNamePrefix + "_clustered.res");
+        for (const std::shared_ptr<SuperBB> &sbb : results.results_)
+            sbb->fullReport(outFile);
+        for (const std::shared_ptr<SuperBB> &sbb : results.clustered_)
+            sbb->fullReport(outFileClustered);
+        outFile.close();
+        outFileClustered.close();
+    } else if (results.size_ > 1) {
+        // largest subsets
+        std::ofstream outFile("cb_" + std::to_string(results.size_) + "_" + outFileNamePrefix + ".res");
+        for (const std::shared_ptr<SuperBB> &sbb : results.results_)
+            sbb->fullReport(outFile);
+        outFile.close();
+    }
+    return results;
+}
+
+bool HierarchicalFold::resume(const std::string &fileName) {
+    try {
+        resumedLength_ = FoldCheckpoint::read(fileName, bbs_, keptResultsByLength, bestKContainer_);
+    } catch (std::runtime_error &e) {
+        std::cerr << "Can't resume from checkpoint " << fileName << ": " << e.what() << std::endl;
+        return false;
+    }
+    std::cout << "resuming after length " << resumedLength_ << " from " << fileName << std::endl;
+    return true;
+}
+
+void HierarchicalFold::writeProgress(unsigned int length, unsigned int firstResultSize, float bestScore,
+                                     double seconds) const {
+    // replaced through a temporary file so readers never see a partial file
+    std::string fileName = streamPrefix_ + "_progress.json";
+    std::ofstream outFile(fileName + ".tmp");
+    outFile << "{\"subunits\": " << N_ << ", \"length\": " << length << ", ";
+    if (firstResultSize == 0)
+        outFile << "\"subIteration\": null, \"completedLength\": " << length;
+    else
+        outFile << "\"subIteration\": [" << firstResultSize << ", " << length - firstResultSize
+                << "], \"completedLength\": " << length - 1;
+    outFile << ", \"bestScore\": " << bestScore << ", \"elapsedSeconds\": " << seconds << "}" << std::endl;
+    outFile.close();
+    if (!outFile || std::rename((fileName + ".tmp").c_str(), fileName.c_str()) != 0)
+        std::cerr << "Can't write progress file " << fileName << std::endl;
+}
+
+void HierarchicalFold::printWastedPairs() const {
+    std::vector<std::pair<std::pair<unsigned int, unsigned int>, FoldCounters>> pairs(bbPairCounters_.begin(),
+                                                                                      bbPairCounters_.end());
+    std::stable_sort(pairs.begin(), pairs.end(),
+                     [](const auto &p1, const auto &p2) { return p1.second.wasted() > p2.second.wasted(); });
+    if (pairs.size() > wastedPairsNum_)
+        pairs.resize(wastedPairsNum_);
+
+    std::cout << "*** BB pairs by wasted transformations (tried that didn't add a result)" << std::endl;
+    std::cout << "BB1 BB2 tried wasted scoreBound constraints penetration restraints dominated penetrationChecks "
+                 "sphereSkipped"
+              << std::endl;
+    for (const auto &[bbs, counters] : pairs) {
+        std::cout << bbs_[bbs.first]->getPDBFileName() << " " << bbs_[bbs.second]->getPDBFileName() << " "
+                  << counters.transTried_ << " " << counters.wasted() << " " << counters.scoreBound_ << " "
+                  << counters.constraints_ << " " << counters.penetration_ << " " << counters.restraints_ << " "
+                  << counters.dominated() << " " << counters.penetrationChecks_ << " "
+                  << counters.sphereSkipped_ << std::endl;
+    }
+}
+
+std::string HierarchicalFold::shardFileName(unsigned int length, unsigned int shardIndex) const {
+    return shardDir_ + "/length_" + std::to_string(length) + "_shard_" + std::to_string(shardIndex) + "_of_" +
+           std::to_string(shardsNum_) + ".candidates";
+}
+
+std::string HierarchicalFold::shardAbortFileName(const std::string &shardDir, unsigned int shardIndex,
+                                                 unsigned int shardsNum) {
+    return shardDir + "/shard_" + std::to_string(shardIndex) + "_of_" + std::to_string(shardsNum) + ".abort";
+}
+
+void HierarchicalFold::setShardAbort(unsigned int shardIndex, unsigned int shardsNum, const std::string &shardDir) {
+    std::string fileName = shardAbortFileName(shardDir, shardIndex, shardsNum);
+    if (fileName.size() >= sizeof(abortFileName)) {
+        std::cerr << "Shard directory name too long " << shardDir << std::endl;
+        exit(1);
+    }
+    strcpy(abortFileName, fileName.c_str());
+    std::atexit(writeShardAbort);
+    for (int signal : {SIGINT, SIGTERM, SIGHUP, SIGSEGV, SIGBUS, SIGFPE, SIGABRT})
+        std::signal(signal, shardAbortSignal);
+}
+
+void HierarchicalFold::writeShard(unsigned int length, const std::vector<ShardCandidate> &candidates) const {
+    std::string fileName = shardFileName(length, shardIndex_);
+    if (!FoldCheckpoint::writeCandidates(fileName, candidates)) {
+        std::cerr << "Can't write shard results " << fileName << std::endl;
+        exit(1);
+    }
+}
+
+void HierarchicalFold::readShards(unsigned int length, const std::function<void(const ShardCandidate &)> &add) const {
+    for (unsigned int shard = 0; shard < shardsNum_; shard++) {
+        std::string fileName = shardFileName(length, shard);
+        // the files are renamed into place when complete
+        bool waiting = false;
+        auto waitStart = std::chrono::steady_clock::now();
+        while (!std::ifstream(fileName)) {
+            if (!waiting)
+                std::cout << "waiting for " << fileName << std::endl;
+            waiting = true;
+            for (unsigned int other = 0; other < shardsNum_; other++) {
+                std::string abortFile = shardAbortFileName(shardDir_, other, shardsNum_);
+                if (std::ifstream(abortFile)) {
+                    std::cerr << "Shard " << other << "/" << shardsNum_ << " failed, see " << abortFile << std::endl;
+                    exit(1);
+                }
+            }
+            if (shardTimeout_ > 0 &&
+                std::chrono::steady_clock::now() - waitStart > std::chrono::seconds(shardTimeout_)) {
+                std::cerr << "Timed out after " << shardTimeout_ << " s waiting for " << fileName << std::endl;
+                exit(1);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        try {
+            FoldCheckpoint::readCandidates(fileName, bbs_, add);
+        } catch (std::runtime_error &e) {
+            std::cerr << "Can't read shard results: " << e.what() << std::endl;
+            exit(1);
+        }
+    }
+}
+
+FoldResults HierarchicalFold::assemble() {
+    Trace::Span span("assemble", "fold");
+    auto start = std::chrono::steady_clock::now();
+    StatsClock runClock;
+    auto elapsed = [&start]() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+    // results of a previous run in the shard directory would be merged as if they were of this run
+    if (shardsNum_ > 1 && (std::ifstream(shardFileName(std::max(2u, resumedLength_ + 1), shardIndex_)) ||
+                           std::ifstream(shardAbortFileName(shardDir_, shardIndex_, shardsNum_)))) {
+        std::cerr << "The shard directory " << shardDir_ << " has results of a previous run, use an empty directory"
+                  << std::endl;
+        exit(1);
+    }
+    // a resumed run continues the stream of the run it resumes
+    if (!streamPrefix_.empty() && resumedLength_ == 0)
+        std::ofstream(streamPrefix_ + "_stream.res", std::ios::trunc);
+
     std::vector<std::vector<unsigned int>> identGroups = createIdentGroups(N_, bestKContainer_);
     std::map<unsigned int, std::vector<unsigned int>> assemblyGroupsMap = createAssemblyGroupsMap(N_, bestKContainer_);
 
@@ -152,6 +358,7 @@ void HierarchicalFold::fold(const std::string &outFileNamePrefix) {
         precomputedResults[i] = new BestK(K_);
 
     // populate with homomers subunits
+    Trace::Span symmetrySpan("symmetry", "fold");
     for (std::vector<unsigned int> identGroup : identGroups) {
         for (unsigned int groupDivider = 1; (identGroup.size() / groupDivider) >= 5; groupDivider++) {
         if ((identGroup.size() % groupDivider) != 0)
@@ -166,29 +373,64 @@ void HierarchicalFold::fold(const std::string &outFileNamePrefix) {
         createSymmetry(groupSBBs, *precomputedResults[groupSBBs.size()]);
         }
     }
+    symmetrySpan.end();
 
     // Hierarchical Assembly
-    for (unsigned int length = 2; length <= N_; length++) { // # subunits iteration
+    for (unsigned int length = std::max(2u, resumedLength_ + 1); length <= N_; length++) { // # subunits iteration
         std::cout << "*** running iteration " << length
                   << " prev kept results: " << keptResultsByLength[length - 1]->size() << std::endl;
+        Trace::Span lengthSpan("length", "fold");
+        lengthSpan.arg("length", length);
+        StatsClock lengthClock;
+        LengthStats lengthStats;
+        lengthStats.length_ = length;
+        FoldCounters lengthCounters = counters_;
         std::unordered_map<BitId, BestK *> best_k_by_id;
-
-        // populate with precomputedResults
-        for (auto it1 = precomputedResults[length]->begin(); it1 != precomputedResults[length]->end(); it1++) {
-            BitId currResSet = (**it1).bitIds();
+        auto addResult = [&best_k_by_id, this](std::shared_ptr<SuperBB> sbb) {
+            BitId currResSet = sbb->bitIds();
             if (best_k_by_id.count(currResSet) == 0)
                 best_k_by_id[currResSet] = new BestK(K_);
-            best_k_by_id[currResSet]->push(*it1);
-        }
+            best_k_by_id[currResSet]->push(sbb);
+        };
+
+        // populate with precomputedResults
+        for (auto it1 = precomputedResults[length]->begin(); it1 != precomputedResults[length]->end(); it1++)
+            addResult(*it1);
+
+        // a shard connects every shardsNum_ pair, from the shardIndex_ pair, to candidates that are merged when the
+        // length is done. It adds the subunit sets of all the pairs to best_k_by_id, so the sets are in the same
+        // order as in one process, and keeps its own results in them to prune its transformations
+        unsigned long pairIndex = 0;
+        std::vector<ShardCandidate> shardCandidates;
 
         // try to assemble from each pair of kept results that together have (length) subunits
         for (unsigned int firstResultSize = 1; firstResultSize <= length / 2; firstResultSize++) {
             unsigned int secondResultSize = length - firstResultSize;
             std::cout << "** running sub-iteration " << firstResultSize << " " << secondResultSize << std::endl;
+            Trace::Span subIterationSpan("sub-iteration", "fold");
+            subIterationSpan.arg("first", firstResultSize);
+            subIterationSpan.arg("second", secondResultSize);
+            if (!streamPrefix_.empty()) {
+                // the best of the previous length and of the results of this length so far, 0 if there are none
+                const BestK *previous = keptResultsByLength[length - 1];
+                bool found = previous->size() != 0;
+                float bestScore = previous->maxScore();
+                for (const auto &[currResSet, currBestK] : best_k_by_id) {
+                    if (currBestK->size() == 0)
+                        continue;
+                    bestScore = found ? std::max(bestScore, currBestK->maxScore()) : currBestK->maxScore();
+                    found = true;
+                }
+                writeProgress(length, firstResultSize, bestScore, elapsed());
+            }
             std::cout << "counters " << countFilterTrasSkipped_ << "/" << countFilterTras_ << std::endl;
+            StatsClock subIterationClock;
+            FoldCounters subIterationCounters = counters_;
 
             for (auto it1 = keptResultsByLength[firstResultSize]->begin();
                  it1 != keptResultsByLength[firstResultSize]->end(); it1++) {
+                // the connections of one kept result to all the kept results of the second size
+                Trace::Span connectSpan("tryToConnect", "fold");
                 SuperBB sbb1 = **it1;
                 BitId setA = sbb1.bitIds();
 
@@ -199,55 +441,117 @@ void HierarchicalFold::fold(const std::string &outFileNamePrefix) {
                         std::distance(keptResultsByLength[firstResultSize]->begin(), it1) >
                             std::distance(keptResultsByLength[secondResultSize]->begin(), it2))
                         continue; // Since in this case there are 2 identical loops, don't do things twice
+                    unsigned long currPairIndex = pairIndex++;
+                    bool shardPair = currPairIndex % shardsNum_ == shardIndex_;
+                    if (shardPair)
+                        counters_.pairsConsidered_++;
 
                     // If there are identical subunits in both results, rewrite the second result to not have the same
                     std::shared_ptr<SuperBB> sbb2Pointer = getMatchingSBB(sbb1, **it2, identGroups);
-                    if (sbb2Pointer == NULL)
+                    if (sbb2Pointer == NULL) {
+                        counters_.pairsPruned_ += shardPair;
                         continue;
+                    }
                     SuperBB sbb2 = *sbb2Pointer;
 
                     // make sure that the two results can be connected
                     BitId setB = sbb2.bitIds();
-                    if ((setA & setB) != 0)
+                    if ((setA & setB) != 0) {
+                        counters_.pairsPruned_ += shardPair;
                         continue;
+                    }
                     BitId currResSet = setA | setB;
                     if(!isValidBasedOnAssembly(assemblyGroupsMap, currResSet)){
                         std::cout << "invalid assembly " << currResSet << std::endl;
+                        counters_.pairsPruned_ += shardPair;
                         continue;
                     }
 
                     // connect the two results and add all new combined results to best_k_by_id[currResSet]
                     if (best_k_by_id.count(currResSet) == 0)
                         best_k_by_id[currResSet] = new BestK(K_);
+                    if (!shardPair)
+                        continue;
 
                     unsigned int resCountBefore = best_k_by_id[currResSet]->size();
                     float minScoreBefore = best_k_by_id[currResSet]->minScore();
 
                     std::promise<int> promise1;
-                    this->tryToConnect(1, sbb1, sbb2, *best_k_by_id[currResSet], (length < N_), promise1, identGroups);
+                    this->tryToConnect(1, sbb1, sbb2, *best_k_by_id[currResSet], (length < N_), promise1, identGroups,
+                                       shardsNum_ > 1 ? &shardCandidates : NULL, currPairIndex);
 
                     if (resCountBefore < best_k_by_id[currResSet]->size() ||
                         minScoreBefore != best_k_by_id[currResSet]->minScore())
                         std::cout << "found more for " << currResSet << " based on " << setA << " and " << setB
                                   << " before: " << resCountBefore << " after: " << best_k_by_id[currResSet]->size()
-                                  << " scores " << best_k_by_id[currResSet]->minScore() << ":"
+                                  << " scores " << best_k_by_id[currResSet]->lowestScore() << ":"
                                   << best_k_by_id[currResSet]->maxScore() << std::endl;
                 }
             }
+            lengthStats.subIterations_.push_back({firstResultSize, secondResultSize, subIterationClock.wallSeconds(),
+                                                  subIterationClock.cpuSeconds(), counters_ - subIterationCounters});
+        }
+
+        if (shardsNum_ > 1) {
+            Trace::Span mergeSpan("merge shards", "fold");
+            // push the candidates of all the shards in the order of their pairs, as one process pushes them, so all
+            // the shards keep the same results
+            writeShard(length, shardCandidates);
+            shardCandidates.clear();
+            std::vector<ShardCandidate> candidates;
+            readShards(length, [&candidates](const ShardCandidate &candidate) { candidates.push_back(candidate); });
+            // the candidates of each shard are in pair order, and each pair is of one shard
+            std::stable_sort(candidates.begin(), candidates.end(),
+                             [](const ShardCandidate &c1, const ShardCandidate &c2) {
+                                 return c1.pairIndex_ < c2.pairIndex_;
+                             });
+            // back to the precomputed results only, the sets keep their order
+            for (auto &[currResSet, currBestK] : best_k_by_id) {
+                delete currBestK;
+                currBestK = new BestK(K_);
+            }
+            for (auto it1 = precomputedResults[length]->begin(); it1 != precomputedResults[length]->end(); it1++)
+                addResult(*it1);
+            for (const ShardCandidate &candidate : candidates) {
+                BestK &results = *best_k_by_id.at(candidate.sbb_->bitIds());
+                // as in tryToConnect, counted by the shard of the pair only
+                FoldCounters candidateCounters;
+                if (candidate.boundScore_ < results.minScore()) {
+                    candidateCounters.scoreBound_++;
+                } else {
+                    candidateCounters.pushed_++;
+                    if (results.push_cluster(candidate.sbb_, 1, identGroups))
+                        candidateCounters.accepted_++;
+                }
+                if (candidate.pairIndex_ % shardsNum_ != shardIndex_)
+                    continue;
+                counters_ += candidateCounters;
+                lengthBBPairCounters_[std::make_pair(std::min(candidate.firstBB_, candidate.secondBB_),
+                                                     std::max(candidate.firstBB_, candidate.secondBB_))] +=
+                    candidateCounters;
+            }
         }
 
         // cluster results and save them
+        Trace::Span clusterSpan("cluster", "fold");
         std::map<unsigned int, BestK *> bestForSubunitId;
         keptResultsByLength[length] = new BestK(K_);
 
+        lengthStats.resultSets_ = 0;
+        lengthStats.candidates_ = lengthStats.clustered_ = lengthStats.maxSetSize_ = 0;
         for (const auto &[currResSet, currBestK] : best_k_by_id) {
             if (currBestK->size() > 0) {
                 BestK *clusteredBestK = bestKContainer_.newBestK(currResSet);
                 currBestK->cluster(*clusteredBestK, 1.0, identGroups);
+                lengthStats.resultSets_++;
+                lengthStats.candidates_ += currBestK->size();
+                lengthStats.clustered_ += clusteredBestK->size();
+                lengthStats.maxSetSize_ = std::max(lengthStats.maxSetSize_, currBestK->size());
 
                 std::cerr << "clustering resSet " << currResSet << " before: " << currBestK->size() << " after "
-                          << bestKContainer_[currResSet].size() << " scores " << bestKContainer_[currResSet].minScore()
-                          << ":" << bestKContainer_[currResSet].maxScore() << std::endl;
+                          << bestKContainer_[currResSet].size() << " scores "
+                          << bestKContainer_[currResSet].lowestScore() << ":" << bestKContainer_[currResSet].maxScore()
+                          << std::endl;
 
                 for (unsigned int i = 0; i < N_; i++) {
                     if (currResSet.test(i)) {
@@ -276,38 +580,73 @@ void HierarchicalFold::fold(const std::string &outFileNamePrefix) {
             delete currBestK;
         }
 
+        clusterSpan.end();
+
         printBestK(N_, keptResultsByLength[length]);
+
+        if (!streamPrefix_.empty()) {
+            std::ofstream streamFile(streamPrefix_ + "_stream.res", std::ios::app);
+            for (auto it = keptResultsByLength[length]->rbegin(); it != keptResultsByLength[length]->rend(); it++)
+                (*it)->result().report(streamFile);
+            streamFile.close();
+            writeProgress(length, 0, keptResultsByLength[length]->maxScore(), elapsed());
+        }
+
+        if (!checkpointFileName_.empty()) {
+            Trace::Span checkpointSpan("checkpoint", "fold");
+            if (FoldCheckpoint::write(checkpointFileName_, length, bbs_, keptResultsByLength, bestKContainer_))
+                std::cout << "saved checkpoint of length " << length << " to " << checkpointFileName_ << std::endl;
+            else
+                std::cerr << "Can't write checkpoint " << checkpointFileName_ << std::endl;
+        }
+
+        if (!statsFileName_.empty()) {
+            lengthStats.wallSeconds_ = lengthClock.wallSeconds();
+            lengthStats.cpuSeconds_ = lengthClock.cpuSeconds();
+            lengthStats.counters_ = counters_ - lengthCounters;
+            lengthStats.bbPairs_ = lengthBBPairCounters_;
+            lengthStats.kept_ = keptResultsByLength[length]->size();
+            lengthStats.minScore_ = keptResultsByLength[length]->lowestScore();
+            lengthStats.maxScore_ = keptResultsByLength[length]->maxScore();
+            lengthStats.peakRSSKB_ = FoldStats::peakRSSKB();
+            stats_.push_back(lengthStats);
+            if (!FoldStats::write(statsFileName_, N_, K_, 0, runClock, stats_))
+                std::cerr << "Can't write stats file " << statsFileName_ << std::endl;
+        }
+        for (const auto &[bbs, counters] : lengthBBPairCounters_)
+            bbPairCounters_[bbs] += counters;
+        lengthBBPairCounters_.clear();
     }
 
-    // output fully assembled results or largest subsets
+    // the other shards don't wait for this one anymore
+    abortFileName[0] = '\0';
+
+    // fully assembled results or largest subsets
+    FoldResults results;
+    results.size_ = 0;
     if (keptResultsByLength[N_]->size() != 0) {
-        std::string outFileName = outFileNamePrefix + ".res";
-        std::ofstream outFile(outFileName);
-        std::ofstream outFileClustered(outFileNamePrefix + "_clustered.res");
+        Trace::Span clusterSpan("cluster results", "fold");
+        results.size_ = N_;
         BestK clusteredBestK(finalSizeLimit_); // TODO: this should also change on the best_k_by_id level
 
-        for (auto it = keptResultsByLength[N_]->rbegin(); it != keptResultsByLength[N_]->rend(); it++)
-            (*it)->fullReport(outFile);
-        // output after clustering
+        results.results_.assign(keptResultsByLength[N_]->rbegin(), keptResultsByLength[N_]->rend());
         keptResultsByLength[N_]->cluster(clusteredBestK, 5.0, identGroups);
-        for (auto it = clusteredBestK.rbegin(); it != clusteredBestK.rend(); it++)
-            (*it)->fullReport(outFileClustered);
-        outFile.close();
-        outFileClustered.close();
+        results.clustered_.assign(clusteredBestK.rbegin(), clusteredBestK.rend());
     } else {
-        // output largest subsets
         for (unsigned int i = N_; i > 1; i--) {
             if (keptResultsByLength[i]->size() == 0)
                 continue;
-            std::string outFileName = "cb_" + std::to_string(i) + "_" + outFileNamePrefix + ".res";
-            std::ofstream outFile(outFileName);
-            for (auto it = keptResultsByLength[i]->rbegin(); it != keptResultsByLength[i]->rend(); it++)
-                (*it)->fullReport(outFile);
-            outFile.close();
+            results.size_ = i;
+            results.results_.assign(keptResultsByLength[i]->rbegin(), keptResultsByLength[i]->rend());
             break;
         }
     }
 
+    if (!statsFileName_.empty() && !FoldStats::write(statsFileName_, N_, K_, results.size_, runClock, stats_))
+        std::cerr << "Can't write stats file " << statsFileName_ << std::endl;
+    if (wastedPairsNum_ > 0)
+        printWastedPairs();
+
     // cleanup
     for (const auto &[length, currBestK] : precomputedResults) {
         delete currBestK;
@@ -315,25 +654,34 @@ void HierarchicalFold::fold(const std::string &outFileNamePrefix) {
     for (const auto &[length, currBestK] : keptResultsByLength) {
         delete currBestK;
     }
+    return results;
 }
 
 void HierarchicalFold::tryToConnect(int id, const SuperBB &sbb1, const SuperBB &sbb2, BestK &results, bool toAdd,
-                                    std::promise<int> &output, std::vector<std::vector<unsigned int>> &identGroups) {
+                                    std::promise<int> &output, std::vector<std::vector<unsigned int>> &identGroups,
+                                    std::vector<ShardCandidate> *candidates, uint64_t pairIndex) {
     // iterate over pairs of BBs os SuperBB1 and SuperBB2
     for (int i = 0; i < (int)sbb1.bbs_.size(); i++) {
         int firstBB = sbb1.bbs_[i]->getID();
         for (int j = 0; j < (int)sbb2.bbs_.size(); j++) {
             int secondBB = sbb2.bbs_[j]->getID();
 
+            // counted locally and added once for the pair of BBs, so the counters are not shared in the loop
+            FoldCounters pairCounters;
+
             // loop over possible transformations between BBs
             for (TransIterator2 it(sbb1, sbb2, firstBB, secondBB); !it.isAtEnd(); it++) {
-                // optimization - check that the score is not lower than the minimum in the current bestK
-                if((it.getScore() + sbb1.transScore_ + sbb2.transScore_) < results.minScore()){
+                pairCounters.transTried_++;
+                // optimization - check that the score is not lower than the minimum in the current bestK. A shard
+                // checks against its own results, and its candidates are checked again when they are merged
+                float boundScore = it.getScore() + sbb1.transScore_ + sbb2.transScore_;
+                if (boundScore < results.minScore()) {
+                    pairCounters.scoreBound_++;
                     continue;
                 }
 
                 // discard any invalid transformations
-                bool filtered = filterTrans(sbb1, sbb2, it.transformation());
+                bool filtered = filterTrans(sbb1, sbb2, it.transformation(), pairCounters);
                 if (filtered)
                     continue;
 
@@ -343,18 +691,34 @@ void HierarchicalFold::tryToConnect(int id, const SuperBB &sbb1, const SuperBB &
                 if (theNew->getRestraintsRatio() < restraintsRatioThreshold_) {
                     //            std::cout << "not enough restraints " << theNew->getRestraintsRatio() << " : " <<
                     //            complexConst_.getDistanceRestraintsRatioThreshold();
+                    pairCounters.restraints_++;
                     continue;
                 }
 
                 // results.push(theNew);
-                results.push_cluster(theNew, 1, identGroups);
+                bool accepted = results.push_cluster(theNew, 1, identGroups);
+                if (accepted && candidates != NULL) {
+                    // counted when the candidates are merged
+                    candidates->push_back({pairIndex, boundScore, firstBB, secondBB, theNew});
+                    continue;
+                }
+                pairCounters.pushed_++;
+                if (accepted)
+                    pairCounters.accepted_++;
+            }
+
+            if (pairCounters.transTried_ > 0) {
+                counters_ += pairCounters;
+                lengthBBPairCounters_[std::make_pair(std::min(firstBB, secondBB), std::max(firstBB, secondBB))] +=
+                    pairCounters;
             }
         }
     }
     output.set_value(1);
 }
 
-bool HierarchicalFold::filterTrans(const SuperBB &sbb1, const SuperBB &sbb2, const RigidTrans3 &trans) const {
+bool HierarchicalFold::filterTrans(const SuperBB &sbb1, const SuperBB &sbb2, const RigidTrans3 &trans,
+                                   FoldCounters &counters) const {
 
     // check distance constraints & restraints
     for (unsigned int i = 0; i < sbb1.size_; i++) {
@@ -364,8 +728,10 @@ bool HierarchicalFold::filterTrans(const SuperBB &sbb1, const SuperBB &sbb2, con
             const BB &bb2 = *sbb2.bbs_[j];
             RigidTrans3 t2 = t * sbb2.trans_[j];
             // check constraints first
-            if (!complexConst_.areConstraintsSatisfied(bb1.getID(), bb2.getID(), t2))
+            if (!complexConst_.areConstraintsSatisfied(bb1.getID(), bb2.getID(), t2)) {
+                counters.constraints_++;
                 return true;
+            }
         }
     }
 
@@ -386,37 +752,21 @@ bool HierarchicalFold::filterTrans(const SuperBB &sbb1, const SuperBB &sbb2, con
             }
 
             countFilterTras_ = countFilterTras_ + 1;
+            counters.penetrationChecks_++;
 
             // optimization - check if radiuses are too far apart and if so, skip check
             if ((pBB1->getRadius() + pBB2->getRadius()) < (pBB1->getCM() - t2*pBB2->getCM()).norm()) {
                 countFilterTrasSkipped_ = countFilterTrasSkipped_ + 1;
+                counters.sphereSkipped_++;
                 continue;
             }
 
-            unsigned int bbPenetrations = 0;
-            unsigned int totalUsedAtoms = 0;
-
-            // TODO: maybe should save Weighted bbPen using pBB1->grid_->getDist(v) as weight
-            for (Molecule<Atom>::const_iterator it = pBB2->caAtoms_.begin(); it != pBB2->caAtoms_.end(); it++) {
-                if (it->getTempFactor() < minTemperatureToConsiderCollision) {
-                    continue;
-                }
-                totalUsedAtoms++;
-
-                Vector3 v = t2 * it->position();
-                if (pBB1->getDistFromSurface(v) < 0) {
-                    // getResidueEntry(v) when used in BBGrid.h will return -1*res_index if res_index is backbone
-                    if (pBB1->grid_->getResidueEntry(v) < 0 && pBB1->grid_->getDist(v) < penetrationThreshold_) {
-                        int resEntry = pBB1->grid_->getResidueEntry(v) * -1;
-                        if (pBB1->getAtomByResId(resEntry).getTempFactor() < minTemperatureToConsiderCollision)
-                            continue;
-
-                        bbPenetrations++;
-                    }
-                }
-            }
+            unsigned int totalUsedAtoms;
+            unsigned int bbPenetrations = pBB1->backbonePenetrations(t2, *pBB2, penetrationThreshold_,
+                                                                     minTemperatureToConsiderCollision, totalUsedAtoms);
             float bbPenChangePercent = (float)(bbPenetrations) / (float)totalUsedAtoms;
             if (bbPenChangePercent > maxBackboneCollisionPercentPerChain) {
+                counters.penetration_++;
                 return true;
             }
         }
@@ -641,7 +991,7 @@ std::shared_ptr<SuperBB> HierarchicalFold::getMatchingSBB(SuperBB sbb1, SuperBB
     return newSbb;
 }
 
-void HierarchicalFold::checkConnectivity() const {
+bool HierarchicalFold::checkConnectivity() const {
     typedef boost::adjacency_list<boost::vecS,        // edge list
                                   boost::vecS,        // vertex list
                                   boost::undirectedS, // directedness
@@ -675,8 +1025,9 @@ void HierarchicalFold::checkConnectivity() const {
             std::cerr << "SU " << i << " component " << component[i] << std::endl;
         std::cerr << "Not enough transformations between subunits, there should be one connected component!"
                   << std::endl;
-        exit(1);
+        return false;
     }
+    return true;
 }
 
 void HierarchicalFold::outputConnectivityGraph(std::string outFileName) const {
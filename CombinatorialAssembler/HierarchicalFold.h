@@ -5,9 +5,21 @@
 #include "BestKContainer.h"
 #include "ComplexDistanceConstraint.h"
 #include "BBContainer.h"
+#include "FoldCheckpoint.h"
+#include "FoldStats.h"
+#include <functional>
 #include <future>
 #include <memory>
 
+// The results of a fold: the fully assembled results and their clustering, best first. If no full assembly was found,
+// the results of the largest assembled subsets and no clustered results
+struct FoldResults {
+    // number of subunits in each result, 0 if there are no results
+    unsigned int size_;
+    std::vector<std::shared_ptr<SuperBB>> results_;
+    std::vector<std::shared_ptr<SuperBB>> clustered_;
+};
+
 // TODO: should this class just be a namespace? because each function is called once...
 class HierarchicalFold {
   public:
@@ -19,7 +31,8 @@ class HierarchicalFold {
           maxResultPerResSet(maxResultPerResSet), minTemperatureToConsiderCollision(minTemperatureToConsiderCollision),
           maxBackboneCollisionPercentPerChain(maxBackboneCollisionPercentPerChain),
           restraintsRatioThreshold_(restraintsRatio), penetrationThreshold_(penetrationThreshold),
-          finalSizeLimit_(k * N_), bestKContainer_(k), complexConst_(bbContainer.getBBs()) {
+          finalSizeLimit_(k * N_), bestKContainer_(k), complexConst_(bbContainer.getBBs()), resumedLength_(0),
+          bbs_(bbContainer.getBBs()), shardIndex_(0), shardsNum_(1), shardTimeout_(0), wastedPairsNum_(0) {
 
         // initialize keptResultsByLength and bestKContainer_
         keptResultsByLength[1] = new BestK(N_);
@@ -34,12 +47,60 @@ class HierarchicalFold {
     }
     
 
-    void fold(const std::string &outFileNamePrefix);
+    // assembles and writes <prefix>.res and <prefix>_clustered.res, or cb_<size>_<prefix>.res for the largest subsets
+    FoldResults fold(const std::string &outFileNamePrefix);
+
+    // assembles without writing, a HierarchicalFold can assemble once
+    FoldResults assemble();
+
+    // after each length, the kept results are saved to a checkpoint file that resume can continue from
+    void setCheckpointFile(const std::string &fileName) { checkpointFileName_ = fileName; }
+
+    // loads the lengths completed in a checkpoint of the same subunits, assemble then continues from the next
+    // length. K may differ from the run that wrote the checkpoint. Returns false (after printing the error) if the
+    // checkpoint can't be read
+    bool resume(const std::string &fileName);
+
+    // as soon as each length is clustered its kept results are appended, best first, to <prefix>_stream.res, and
+    // <prefix>_progress.json is updated with the current length, sub-iteration and best score
+    void setStreamOutput(const std::string &prefix) { streamPrefix_ = prefix; }
+
+    // runs as shard shardIndex of shardsNum processes that fold the same input: each length, a shard connects a
+    // deterministic slice of the pairs of kept results and writes the connected candidates to shardDir, then all the
+    // shards push the candidates of all the shards in pair order and continue with the same results. A shard prunes
+    // its transformations and candidates with its own results only, which are not the results one process has at
+    // that pair, so the kept results can differ from one process in results of close scores.
+    // shardDir must be shared by the shards and not hold files of another run
+    void setShard(unsigned int shardIndex, unsigned int shardsNum, const std::string &shardDir) {
+        shardIndex_ = shardIndex;
+        shardsNum_ = shardsNum;
+        shardDir_ = shardDir;
+    }
+
+    // from now until its fold is done, if this shard ends (exit or a fatal signal) it leaves an abort file in
+    // shardDir, and the shards waiting for its results exit with an error. Exits if the file name is too long
+    static void setShardAbort(unsigned int shardIndex, unsigned int shardsNum, const std::string &shardDir);
+
+    // a shard that waits more than seconds for the results of another shard exits with an error, 0 waits forever
+    void setShardTimeout(unsigned int seconds) { shardTimeout_ = seconds; }
+
+    // the statistics of each length and sub-iteration (FoldStats) are written to fileName as JSON after each length
+    // and when the fold ends
+    void setStatsFile(const std::string &fileName) { statsFileName_ = fileName; }
 
+    // when the fold ends, prints the pairsNum pairs of BBs with the most transformations tried that didn't add a
+    // result, with the counts of each rejection reason
+    void setWastedPairs(unsigned int pairsNum) { wastedPairsNum_ = pairsNum; }
+
+    // pushes the results of connecting sbb1 and sbb2 to results, and if candidates is given (a shard) adds the
+    // results that were pushed to candidates as connected from pair pairIndex, counted when they are merged
     void tryToConnect(int id, const SuperBB &sbb1, const SuperBB &sbb2, BestK &results, bool toAdd,
-                      std::promise<int> &output, std::vector<std::vector<unsigned int>> &identGroups);
+                      std::promise<int> &output, std::vector<std::vector<unsigned int>> &identGroups,
+                      std::vector<ShardCandidate> *candidates = NULL, uint64_t pairIndex = 0);
     
-    bool filterTrans(const SuperBB &sbb1, const SuperBB &sbb2, const RigidTrans3 &trans) const;
+    // true if the transformation is rejected, the reason is counted in counters
+    bool filterTrans(const SuperBB &sbb1, const SuperBB &sbb2, const RigidTrans3 &trans,
+                     FoldCounters &counters) const;
 
     void createSymmetry(std::vector<std::shared_ptr<SuperBB>> identBBs, BestK &results);
 
@@ -55,7 +116,13 @@ class HierarchicalFold {
         complexConst_.addChainConnectivityConstraints();
     }
 
-    void checkConnectivity() const;
+    void readConstraints(std::istream &in) {
+        complexConst_.readRestraints(in);
+        complexConst_.addChainConnectivityConstraints();
+    }
+
+    // false if the transformations don't connect all the subunits
+    bool checkConnectivity() const;
 
     void outputConnectivityGraph(std::string outFileName = "graph.sif") const;
 
@@ -66,6 +133,7 @@ class HierarchicalFold {
 
     mutable unsigned int countFilterTras_;
     mutable unsigned int countFilterTrasSkipped_;
+    FoldCounters counters_;
 
   private:
     const unsigned int N_;                 // number of subunits
@@ -81,6 +149,32 @@ class HierarchicalFold {
     BestKContainer bestKContainer_;
     std::map<unsigned int, BestK *> keptResultsByLength;
     ComplexDistanceConstraint complexConst_;
+
+    // writes the progress file of streamPrefix_, firstResultSize is 0 once the length is clustered
+    void writeProgress(unsigned int length, unsigned int firstResultSize, float bestScore, double seconds) const;
+
+    void printWastedPairs() const;
+
+    std::string shardFileName(unsigned int length, unsigned int shardIndex) const;
+    static std::string shardAbortFileName(const std::string &shardDir, unsigned int shardIndex,
+                                          unsigned int shardsNum);
+    // writes the candidates of this shard for length, exits on error
+    void writeShard(unsigned int length, const std::vector<ShardCandidate> &candidates) const;
+    // waits for the candidates of all the shards for length and calls add for each candidate, exits on error
+    void readShards(unsigned int length, const std::function<void(const ShardCandidate &)> &add) const;
+
+    std::string checkpointFileName_;
+    std::string streamPrefix_;
+    unsigned int resumedLength_; // lengths up to it were loaded from a checkpoint
+    std::vector<std::shared_ptr<const BB>> bbs_;
+    unsigned int shardIndex_, shardsNum_;
+    unsigned int shardTimeout_; // seconds, 0 for none
+    std::string shardDir_;
+    std::string statsFileName_;
+    std::vector<LengthStats> stats_;
+    unsigned int wastedPairsNum_;
+    BBPairCounters lengthBBPairCounters_; // of the current length
+    BBPairCounters bbPairCounters_;       // of the completed lengths
 };
 
 #endif /* HIERARCHICALFOLD_H */
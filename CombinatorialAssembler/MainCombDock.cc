@@ -1,6 +1,10 @@
 #include "BBContainer.h"
 #include "HierarchicalFold.h"
+#include "ModelWriter.h"
+#include "ResultFile.h"
+#include "Trace.h"
 
+#include <cerrno>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -8,11 +12,21 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <vector>
-// #include <memory>
+#include <memory>
 
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
 
+// the name of a file of shard i > 0: <name>_shard_<i>.<extension>
+std::string shardFileName(std::string fileName, unsigned int shardIndex) {
+    if (fileName.empty() || shardIndex == 0)
+        return fileName;
+    size_t extension = fileName.find_last_of("./");
+    if (extension == std::string::npos || fileName[extension] == '/')
+        extension = fileName.size();
+    return fileName.insert(extension, "_shard_" + std::to_string(shardIndex));
+}
+
 // #include <gperftools/profiler.h>
 
 int main(int argc, char *argv[]) {
@@ -26,6 +40,23 @@ int main(int argc, char *argv[]) {
     float maxBackboneCollisionPerChain;
     float minTemperatureToConsiderCollision;
     unsigned int maxResultPerResSet;
+    unsigned int threadsNum;
+    unsigned long maxGridMemoryMB;
+    std::string cacheDir;
+    float transClusterRMSD;
+    bool exactDistGrid;
+    unsigned int modelsNum;
+    std::string modelsFormatName;
+    bool binaryResults;
+    std::string checkpointFileName;
+    std::string resumeFileName;
+    bool stream;
+    std::string shardName;
+    std::string shardDir;
+    unsigned int shardTimeout;
+    std::string statsFileName;
+    std::string traceFileName;
+    unsigned int wastedPairsNum;
 
     std::string outFileNamePrefix;
     double restraintsRatio;
@@ -58,7 +89,54 @@ int main(int argc, char *argv[]) {
             "number of results saved for each calculated combination of subunits (default=k)")
 
             ("outputFileNamePrefix,o", po::value<std::string>(&outFileNamePrefix)->default_value("output"),
-             "output file name, default name output.res");
+             "output file name, default name output.res")(
+                "threads", po::value<unsigned int>(&threadsNum)->default_value(0),
+                "number of threads used for preprocessing (default=0, all cores)")(
+                "maxGridMemoryMB", po::value<unsigned long>(&maxGridMemoryMB)->default_value(0),
+                "memory limit for subunit grids built at the same time (default=0, half of the physical memory)")(
+                "cacheDir", po::value<std::string>(&cacheDir)->default_value(""),
+                "directory for caching the parsed atoms, surfaces and grids of the subunits between runs "
+                "(default=no cache)")(
+                "transClusterRMSD", po::value<float>(&transClusterRMSD)->default_value(0),
+                "cluster the transformations of each pair at this RMSD when loading, keeping the best scoring "
+                "(default=0, no clustering)")(
+                "exactDistGrid", po::bool_switch(&exactDistGrid),
+                "compute the subunit grid distances with an exact Euclidean distance transform (default=layered "
+                "approximation)")(
+                "write-models", po::value<unsigned int>(&modelsNum)->default_value(0),
+                "write the complexes of the N best clustered results (or of the largest subsets) to "
+                "<outputFileNamePrefix>_clustered_<i> (default=0, none)")(
+                "format", po::value<std::string>(&modelsFormatName)->default_value("pdb"),
+                "format of the written complexes, pdb or cif (default=pdb)")(
+                "binary-results", po::bool_switch(&binaryResults),
+                "also write the results to binary result files, <outputFileNamePrefix>.resb and "
+                "<outputFileNamePrefix>_clustered.resb (or cb_<size>_<outputFileNamePrefix>.resb), see ResultDump")(
+                "checkpoint", po::value<std::string>(&checkpointFileName)->default_value(""),
+                "save the kept results to this checkpoint file after each length (default=no checkpoint)")(
+                "resume", po::value<std::string>(&resumeFileName)->default_value(""),
+                "skip the lengths completed in this checkpoint file and continue from the next length, the other "
+                "arguments may differ, e.g. bestK (default=start from length 2)")(
+                "stream", po::bool_switch(&stream),
+                "append the kept results of each length to <outputFileNamePrefix>_stream.res as soon as it is "
+                "done, and keep the current length and best score in <outputFileNamePrefix>_progress.json")(
+                "shard", po::value<std::string>(&shardName)->default_value(""),
+                "run as shard i/M of M processes, each started with the same arguments, that split each length and "
+                "merge their results through --shard-dir. Only shard 0 writes the output, which can differ from a run "
+                "without shards in results of close scores (default=no sharding)")(
+                "shard-dir", po::value<std::string>(&shardDir)->default_value("shards"),
+                "directory shared by the shards for their results, empty at the start of a run (default=shards)")(
+                "shard-timeout", po::value<unsigned int>(&shardTimeout)->default_value(0),
+                "seconds a shard waits for the results of another shard before it exits with an error. A shard that "
+                "fails leaves an abort file in --shard-dir that ends the others (default=0, wait forever)")(
+                "stats-json", po::value<std::string>(&statsFileName)->default_value(""),
+                "write the time, work counters and results of each length and sub-iteration to this JSON file, "
+                "shard i > 0 writes <name>_shard_<i>.<extension> (default=none)")(
+                "trace", po::value<std::string>(&traceFileName)->default_value(""),
+                "write a timeline of the phases of the run to this file in the Chrome trace format, for "
+                "chrome://tracing or ui.perfetto.dev, shard i > 0 writes <name>_shard_<i>.<extension> (default=none)")(
+                "wasted-pairs", po::value<unsigned int>(&wastedPairsNum)->default_value(0),
+                "at the end, print the N pairs of subunits with the most transformations tried that didn't add a "
+                "result, with the number rejected by each filter (default=0)");
 
     // required options: currently 5
     po::options_description hidden("Hidden options");
@@ -98,8 +176,29 @@ int main(int argc, char *argv[]) {
 
     if (maxResultPerResSet == 0)
         maxResultPerResSet = bestK;
+    unsigned int shardIndex = 0, shardsNum = 1;
+    if (!shardName.empty()) {
+        if (sscanf(shardName.c_str(), "%u/%u", &shardIndex, &shardsNum) != 2 || shardsNum == 0 ||
+            shardIndex >= shardsNum) {
+            std::cerr << "Bad shard " << shardName << ", use i/M with 0 <= i < M" << std::endl;
+            exit(1);
+        }
+        if (mkdir(shardDir.c_str(), 0755) != 0 && errno != EEXIST) {
+            std::cerr << "Can't create shard directory " << shardDir << std::endl;
+            exit(1);
+        }
+        if (shardsNum > 1)
+            HierarchicalFold::setShardAbort(shardIndex, shardsNum, shardDir);
+    }
+    ModelFormat modelsFormat;
+    if (!parseModelFormat(modelsFormatName, modelsFormat)) {
+        std::cerr << "Unknown model format " << modelsFormatName << ", use pdb or cif" << std::endl;
+        exit(1);
+    }
 
     // done parsing
+    if (!traceFileName.empty())
+        Trace::enable();
 
     auto start = std::chrono::high_resolution_clock::now();
     HierarchicalFold::timerAll_.reset();
@@ -108,8 +207,16 @@ int main(int argc, char *argv[]) {
     std::string argv_str(argv[0]);
     std::string base = argv_str.substr(0, argv_str.find_last_of("/"));
     std::string chemLibFileName = base + "/chem_params.txt";
-    BBContainer bbContainer(suFileName, chemLibFileName, minTemperatureToConsiderCollision);
-    bbContainer.readTransformationFiles(transFilesPrefix, transNumToRead);
+    std::unique_ptr<BBContainer> bbContainerPtr;
+    try {
+        bbContainerPtr.reset(new BBContainer(suFileName, chemLibFileName, minTemperatureToConsiderCollision,
+                                             threadsNum, maxGridMemoryMB, cacheDir, exactDistGrid));
+        bbContainerPtr->readTransformationFiles(transFilesPrefix, transNumToRead, transClusterRMSD);
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        exit(1);
+    }
+    BBContainer &bbContainer = *bbContainerPtr;
 
     std::cout << "Starting HierarchicalFold" << std::endl;
     HierarchicalFold hierarchalFold(bbContainer, bestK, maxResultPerResSet, minTemperatureToConsiderCollision,
@@ -121,12 +228,64 @@ int main(int argc, char *argv[]) {
     HierarchicalFold::timer_.reset();
 
     hierarchalFold.outputConnectivityGraph("graph.txt");
-    hierarchalFold.checkConnectivity();
+    if (!hierarchalFold.checkConnectivity())
+        exit(1);
+    if (!resumeFileName.empty() && !hierarchalFold.resume(resumeFileName))
+        exit(1);
+    hierarchalFold.setShard(shardIndex, shardsNum, shardDir);
+    hierarchalFold.setShardTimeout(shardTimeout);
+    hierarchalFold.setStatsFile(shardFileName(statsFileName, shardIndex));
+    hierarchalFold.setWastedPairs(wastedPairsNum);
+    // the shards have the same results, shard 0 writes them
+    if (shardIndex == 0) {
+        hierarchalFold.setCheckpointFile(checkpointFileName);
+        if (stream)
+            hierarchalFold.setStreamOutput(outFileNamePrefix);
+    } else {
+        modelsNum = 0;
+        binaryResults = false;
+    }
     //    ProfilerStart("nameOfProfile.log");
     auto startBeforeFold = std::chrono::high_resolution_clock::now();
-    hierarchalFold.fold(outFileNamePrefix);
+    FoldResults results =
+        shardIndex == 0 ? hierarchalFold.fold(outFileNamePrefix) : hierarchalFold.assemble();
     //    ProfilerStop();
     auto end = std::chrono::high_resolution_clock::now();
+
+    if (binaryResults && results.size_ > 1) {
+        std::vector<std::pair<std::string, const std::vector<std::shared_ptr<SuperBB>> *>> outputs;
+        if (results.size_ == bbContainer.getBBsNumber()) {
+            outputs.push_back(std::make_pair(outFileNamePrefix + ".resb", &results.results_));
+            outputs.push_back(std::make_pair(outFileNamePrefix + "_clustered.resb", &results.clustered_));
+        } else {
+            outputs.push_back(
+                std::make_pair("cb_" + std::to_string(results.size_) + "_" + outFileNamePrefix + ".resb",
+                               &results.results_));
+        }
+        for (const auto &[fileName, sbbs] : outputs) {
+            std::vector<ResultFile::Result> binary;
+            for (const std::shared_ptr<SuperBB> &sbb : *sbbs)
+                binary.push_back(sbb->result());
+            if (!ResultFile::write(fileName, binary))
+                std::cerr << "Can't write " << fileName << std::endl;
+        }
+    }
+
+    // the complexes are named after the .res file of their results
+    Trace::Span modelsSpan("write models", "output");
+    if (modelsNum > 0 && results.size_ == bbContainer.getBBsNumber()) {
+        unsigned int written = writeModels(results.clustered_, modelsNum, outFileNamePrefix + "_clustered",
+                                           modelsFormat, threadsNum);
+        std::cout << "Wrote " << written << " models" << std::endl;
+    } else if (modelsNum > 0 && results.size_ > 1) {
+        unsigned int written = writeModels(results.results_, modelsNum,
+                                           "cb_" + std::to_string(results.size_) + "_" + outFileNamePrefix,
+                                           modelsFormat, threadsNum);
+        std::cout << "Wrote " << written << " models" << std::endl;
+    }
+    modelsSpan.end();
+    if (!traceFileName.empty() && !Trace::write(shardFileName(traceFileName, shardIndex)))
+        std::cerr << "Can't write trace file " << traceFileName << std::endl;
     std::chrono::duration<double> diff = end - start;
     std::chrono::duration<double> diffFold = end - startBeforeFold;
     std::cout << "Overall time " << diff.count() << " s\n";
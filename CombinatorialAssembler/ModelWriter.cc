@@ -0,0 +1,93 @@
+#include "ModelWriter.h"
+
+#include <CIF.h>
+#include <Parallel.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+namespace {
+// the atoms of the complex grouped by chain, the chains in order of first appearance
+std::vector<std::vector<Atom>> modelChains(const SuperBB &sbb) {
+    std::vector<std::vector<Atom>> chains;
+    std::map<char, unsigned int> chainIndex;
+    for (unsigned int i = 0; i < sbb.bbs_.size(); i++) {
+        const ChemMolecule &atoms = sbb.bbs_[i]->allAtoms_;
+        for (ChemMolecule::const_iterator it = atoms.begin(); it != atoms.end(); it++) {
+            auto inserted = chainIndex.insert(std::make_pair(it->chainId(), (unsigned int)chains.size()));
+            if (inserted.second)
+                chains.push_back(std::vector<Atom>());
+            Atom atom = *it;
+            atom *= sbb.trans_[i];
+            chains[inserted.first->second].push_back(atom);
+        }
+    }
+    // a chain split between BBs is ordered by residue number, the atoms of a residue keep their order
+    for (std::vector<Atom> &chain : chains) {
+        std::stable_sort(chain.begin(), chain.end(),
+                         [](const Atom &a, const Atom &b) { return a.residueIndex() < b.residueIndex(); });
+    }
+    return chains;
+}
+} // namespace
+
+bool parseModelFormat(const std::string &name, ModelFormat &format) {
+    if (name == "pdb")
+        format = ModelFormat::PDB;
+    else if (name == "cif")
+        format = ModelFormat::CIF;
+    else
+        return false;
+    return true;
+}
+
+bool writeModel(const SuperBB &sbb, const std::string &fileName, ModelFormat format) {
+    std::ofstream outFile(fileName);
+    if (!outFile)
+        return false;
+
+    if (format == ModelFormat::CIF) {
+        outFile << "data_model" << std::endl;
+        CIF::writeAtomSiteTable(outFile);
+    }
+    unsigned int atomId = 1;
+    for (std::vector<Atom> &chain : modelChains(sbb)) {
+        for (Atom &atom : chain) {
+            atom.setAtomId(atomId++);
+            if (format == ModelFormat::CIF)
+                atom.output2cif(outFile);
+            else // Atom writes up to the temperature factor, the element is in columns 77-78
+                outFile << atom << "          " << std::right << std::setw(2) << atom.element();
+            outFile << std::endl;
+        }
+        if (format == ModelFormat::PDB) {
+            // TER takes the next serial number and names the last residue of the chain. The first atom of the next
+            // chain takes the same serial, as in the models of scripts/libs/prepare_complex.py
+            const Atom &last = chain.back();
+            outFile << "TER   " << std::right << std::setw(5) << atomId << "      " << last.residueName() << " "
+                    << last.chainId() << std::setw(4) << last.residueIndex() << last.residueICode() << std::endl;
+        }
+    }
+    outFile << (format == ModelFormat::CIF ? "#" : "END") << std::endl;
+    outFile.close();
+    return (bool)outFile;
+}
+
+unsigned int writeModels(const std::vector<std::shared_ptr<SuperBB>> &results, unsigned int modelsNum,
+                         const std::string &namePrefix, ModelFormat format, unsigned int threadsNum) {
+    modelsNum = std::min(modelsNum, (unsigned int)results.size());
+    std::string extension = format == ModelFormat::CIF ? ".cif" : ".pdb";
+    std::atomic<unsigned int> written(0);
+    parallelFor(modelsNum, threadsNum, [&](unsigned int i) {
+        std::string fileName = namePrefix + "_" + std::to_string(i) + extension;
+        if (writeModel(*results[i], fileName, format))
+            written++;
+        else
+            std::cerr << "Can't write model " << fileName << std::endl;
+    });
+    return written;
+}
@@ -0,0 +1,29 @@
+/**
+ * Writes assembled results as complexes: the atoms of each BB of a result, moved by its transformation in the result.
+ * BBs of the same chain are merged into one chain, ordered by residue number, like the chains of
+ * scripts/libs/prepare_complex.py. The atoms are those kept in BB::allAtoms_, i.e. without waters and hydrogens.
+ * The element symbols are those of the input files, or guessed from the atom names if the files have none.
+ */
+#ifndef MODELWRITER_H
+#define MODELWRITER_H
+
+#include "SuperBB.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class ModelFormat { PDB, CIF };
+
+// "pdb" or "cif", returns false for other names
+bool parseModelFormat(const std::string &name, ModelFormat &format);
+
+// writes the complex of sbb to fileName, returns false if the file can't be written
+bool writeModel(const SuperBB &sbb, const std::string &fileName, ModelFormat format);
+
+// writes the first modelsNum results to <namePrefix>_<i>.pdb (or .cif), i from 0, on threadsNum threads
+// (0 - all cores). Returns the number of models written
+unsigned int writeModels(const std::vector<std::shared_ptr<SuperBB>> &results, unsigned int modelsNum,
+                         const std::string &namePrefix, ModelFormat format, unsigned int threadsNum);
+
+#endif /* MODELWRITER_H */
@@ -0,0 +1,52 @@
+// Prints the results of a binary result file (written by the assembler with --binary-results) as the lines of the
+// matching .res file.
+#include "../ResultFile.h"
+
+#include <iostream>
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+int main(int argc, char **argv) {
+    std::string fileName;
+    size_t first, last;
+    bool count;
+    po::options_description desc("Usage: ResultDump <resultFile>\n"
+                                 "prints the results of a binary result file in the text format of the .res files\n");
+    desc.add_options()("help,h", "ResultDump help")("first,f", po::value<size_t>(&first)->default_value(0),
+                                                    "index of the first result to print (default=0)")(
+        "last,l", po::value<size_t>(&last)->default_value(0),
+        "index after the last result to print (default=0, up to the end)")(
+        "count,c", po::bool_switch(&count), "only print the number of results");
+    po::options_description hidden("Hidden options");
+    hidden.add_options()("resultFile", po::value<std::string>(&fileName)->required(), "result file name");
+    po::options_description cmdline_options;
+    cmdline_options.add(desc).add(hidden);
+    po::positional_options_description p;
+    p.add("resultFile", 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(cmdline_options).positional(p).run(), vm);
+        if (vm.count("help")) {
+            std::cout << desc << "\n";
+            return 0;
+        }
+        po::notify(vm);
+    } catch (po::error &e) {
+        std::cout << desc << "\n";
+        return 0;
+    }
+
+    ResultFile results(fileName);
+    if (count) {
+        std::cout << results.size() << std::endl;
+        return 0;
+    }
+    if (last == 0 || last > results.size())
+        last = results.size();
+    for (size_t i = first; i < last; i++)
+        results.get(i).report(std::cout);
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include "ResultFile.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+const char MAGIC[8] = {'C', 'F', 'R', 'E', 'S', 'U', 'L', 'T'};
+const uint32_t VERSION = 1;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t resultsNum;
+};
+
+// the fixed part of a result, followed by size bb ids, 6 * size transformation floats and foldStepsNum steps
+struct RecordHeader {
+    uint32_t size;
+    uint32_t foldStepsNum;
+    float transScore;
+    float weightedTransScore;
+    float restraintsRatio;
+    float maxPen;
+    int32_t multPen;
+    int32_t singlePen;
+    int32_t backBonePen;
+};
+
+template <class T> void writeValue(std::ostream &out, const T &value) { out.write((const char *)&value, sizeof(T)); }
+
+template <class T> void writeArray(std::ostream &out, const std::vector<T> &values) {
+    out.write((const char *)values.data(), values.size() * sizeof(T));
+}
+
+template <class T> T readValue(const char *&buffer, const char *end) {
+    T value;
+    if (buffer + sizeof(T) > end)
+        throw std::runtime_error("truncated file");
+    memcpy(&value, buffer, sizeof(T));
+    buffer += sizeof(T);
+    return value;
+}
+
+template <class T> void readArray(const char *&buffer, const char *end, size_t n, std::vector<T> &values) {
+    if (n > (size_t)(end - buffer) / sizeof(T))
+        throw std::runtime_error("truncated result");
+    values.resize(n);
+    memcpy(values.data(), buffer, n * sizeof(T));
+    buffer += n * sizeof(T);
+}
+
+uint64_t recordSize(const ResultFile::Result &result) {
+    return sizeof(RecordHeader) + result.bbIds_.size() * sizeof(uint32_t) + result.trans_.size() * sizeof(float) +
+           result.foldSteps_.size() * sizeof(ResultFile::Step);
+}
+} // namespace
+
+void ResultFile::Result::report(std::ostream &s) const {
+    s << "size_ " << size_ << " transScore_ " << transScore_ << " multPen_ " << multPen_ << " singlePen_ "
+      << singlePen_ << " diffPen " << singlePen_ - multPen_ << " backBonePen_ " << backBonePen_ << " maxPen_ "
+      << maxPen_ << " restraintsRatio_ " << restraintsRatio_ << " weightedTransScore " << weightedTransScore_;
+    s << " [";
+    for (size_t i = 0; i < bbIds_.size(); i++) {
+        const float *t = &trans_[6 * i];
+        s << bbIds_[i] << "(" << t[0] << ' ' << t[1] << ' ' << t[2] << ' ' << t[3] << ' ' << t[4] << ' ' << t[5]
+          << ")";
+        if (i + 1 != bbIds_.size())
+            s << ",";
+    }
+    s << "]  0 0 0 0 0 0";
+    s << "foldSteps:";
+    for (const Step &step : foldSteps_)
+        s << " (" << step.i_ << ", " << step.j_ << ")-" << step.score_;
+    s << std::endl;
+}
+
+ResultFile::ResultFile(const std::string fileName) : file_(new MappedFile(fileName)) {
+    if (!file_->isOpen()) {
+        std::cerr << "Can't open result file " << fileName << std::endl;
+        exit(1);
+    }
+    try {
+        const char *buffer = file_->begin();
+        const char *end = file_->end();
+        Header header = readValue<Header>(buffer, end);
+        if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION)
+            throw std::runtime_error("not a result file of version " + std::to_string(VERSION));
+        readArray(buffer, end, header.resultsNum, offsets_);
+        for (uint64_t offset : offsets_) {
+            if (offset + sizeof(RecordHeader) > file_->size())
+                throw std::runtime_error("bad index entry");
+        }
+    } catch (std::runtime_error &e) {
+        std::cerr << "Bad result file " << fileName << ": " << e.what() << std::endl;
+        exit(1);
+    }
+}
+
+ResultFile::Result ResultFile::get(size_t i) const {
+    if (i >= offsets_.size())
+        throw std::out_of_range("ResultFile::get: no result " + std::to_string(i));
+    const char *buffer = file_->begin() + offsets_[i];
+    const char *end = file_->end();
+    RecordHeader header = readValue<RecordHeader>(buffer, end);
+    Result result;
+    result.size_ = header.size;
+    result.transScore_ = header.transScore;
+    result.weightedTransScore_ = header.weightedTransScore;
+    result.restraintsRatio_ = header.restraintsRatio;
+    result.maxPen_ = header.maxPen;
+    result.multPen_ = header.multPen;
+    result.singlePen_ = header.singlePen;
+    result.backBonePen_ = header.backBonePen;
+    readArray(buffer, end, header.size, result.bbIds_);
+    readArray(buffer, end, 6 * (size_t)header.size, result.trans_);
+    readArray(buffer, end, header.foldStepsNum, result.foldSteps_);
+    return result;
+}
+
+bool ResultFile::write(const std::string fileName, const std::vector<Result> &results) {
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.reserved = 0;
+    header.resultsNum = results.size();
+
+    std::ofstream out(fileName, std::ios::binary);
+    if (!out)
+        return false;
+    writeValue(out, header);
+    uint64_t offset = sizeof(Header) + results.size() * sizeof(uint64_t);
+    for (const Result &result : results) {
+        writeValue(out, offset);
+        offset += recordSize(result);
+    }
+    for (const Result &result : results) {
+        RecordHeader record = {(uint32_t)result.bbIds_.size(), (uint32_t)result.foldSteps_.size(),
+                               result.transScore_,           result.weightedTransScore_,
+                               result.restraintsRatio_,      result.maxPen_,
+                               result.multPen_,              result.singlePen_,
+                               result.backBonePen_};
+        writeValue(out, record);
+        writeArray(out, result.bbIds_);
+        writeArray(out, result.trans_);
+        writeArray(out, result.foldSteps_);
+    }
+    out.close();
+    return (bool)out;
+}
@@ -0,0 +1,59 @@
+/**
+ * Assembly results in one binary file, the binary counterpart of the .res files. The file holds a header, an index
+ * of the offset of each result and the results. A result holds the score fields, the BB ids, the transformation of
+ * each BB (rotation angles and translation) and the fold steps, so result i is read with one lookup in the memory
+ * mapped file. report writes a result as the line of SuperBB::fullReport.
+ */
+#ifndef RESULTFILE_H
+#define RESULTFILE_H
+
+#include <MappedFile.h>
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ResultFile {
+  public:
+    struct Step {
+        uint32_t i_, j_;
+        float score_;
+    };
+
+    struct Result {
+        uint32_t size_;
+        float transScore_;
+        float weightedTransScore_;
+        float restraintsRatio_;
+        float maxPen_;
+        int32_t multPen_;
+        int32_t singlePen_;
+        int32_t backBonePen_;
+        std::vector<uint32_t> bbIds_;
+        // 6 floats for each BB: rotation angles and translation
+        std::vector<float> trans_;
+        std::vector<Step> foldSteps_;
+
+        // writes the result as a line of a .res file
+        void report(std::ostream &s) const;
+    };
+
+    // open a result file, exits if it is not a valid result file
+    ResultFile(const std::string fileName);
+
+    size_t size() const { return offsets_.size(); }
+
+    // result i, throws std::out_of_range if there is no such result
+    Result get(size_t i) const;
+
+    // writes the results to a new file, returns false on error
+    static bool write(const std::string fileName, const std::vector<Result> &results);
+
+  private:
+    std::unique_ptr<MappedFile> file_;
+    std::vector<uint64_t> offsets_;
+};
+
+#endif /* RESULTFILE_H */
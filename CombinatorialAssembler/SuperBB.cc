@@ -275,6 +275,30 @@ void SuperBB::fullReport(std::ostream &s) {
     s << std::endl;
 }
 
+ResultFile::Result SuperBB::result() const {
+    ResultFile::Result result;
+    result.size_ = size_;
+    result.transScore_ = transScore_;
+    result.weightedTransScore_ = weightedTransScore_;
+    result.restraintsRatio_ = restraintsRatio_;
+    result.maxPen_ = maxPen_;
+    result.multPen_ = multPen_;
+    result.singlePen_ = singlePen_;
+    result.backBonePen_ = backBonePen_;
+    for (unsigned int i = 0; i < bbs_.size(); i++) {
+        result.bbIds_.push_back(bbs_[i]->id_);
+        Vector3 rotation = trans_[i].rotationAngles();
+        Vector3 translation = trans_[i].translation();
+        for (int c = 0; c < 3; c++)
+            result.trans_.push_back(rotation[c]);
+        for (int c = 0; c < 3; c++)
+            result.trans_.push_back(translation[c]);
+    }
+    for (const FoldStep &step : foldSteps_)
+        result.foldSteps_.push_back({step.i_, step.j_, step.tScore_});
+    return result;
+}
+
 std::ostream &operator<<(std::ostream &s, const SuperBB &sbb) {
     // scores
     s << "size_ " << sbb.size_ << " backBonePen_ " << sbb.backBonePen_ << " restraintsRatio_ " << sbb.restraintsRatio_;
@@ -308,7 +332,7 @@ TransIterator2::TransIterator2(const SuperBB &bb1, const SuperBB &bb2, int pbb1,
 
     mediatorTrans_ = !bb2_.trans_[index2_];
     trans_ = &(b1->getTransformations(b2->getID())); // BB::trans(*b1, *b2);
-    it_ = trans_->begin();
+    index_ = 0;
     if (!isAtEnd()) {
         generateTransformation();
     }
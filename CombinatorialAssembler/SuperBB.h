@@ -7,18 +7,24 @@
 
 #include "BB.h"
 #include "FoldStep.h"
+#include "ResultFile.h"
+
+// average score of the fold steps, each weighted by the atoms of the smaller part that it joins
+float getWeightedTransScore(std::vector<FoldStep> steps, std::vector<std::shared_ptr<const BB>> bbs);
 
 class SuperBB {
   public:
     friend class BestK;
     friend class HierarchicalFold;
     friend class TransIterator2;
+    friend class FoldCheckpoint;
 
     SuperBB(std::shared_ptr<const BB> bb);
 
     BitId bitIds() const { return bitIDS_; }
     unsigned int size() const { return size_; }
     float getRestraintsRatio() const { return restraintsRatio_; }
+    const std::vector<FoldStep> &foldSteps() const { return foldSteps_; }
     void setRestraintsRatio(float r) { restraintsRatio_ = r; }
 
     // This function takes Two super BBs and joins them using a transformation between to BBs
@@ -32,6 +38,8 @@ class SuperBB {
     double calcRmsd(const SuperBB &other) const;
 
     void fullReport(std::ostream &s);
+    // the fields of fullReport for a ResultFile
+    ResultFile::Result result() const;
     friend std::ostream &operator<<(std::ostream &s, const SuperBB &sbb);
 
   private:
@@ -61,14 +69,14 @@ class TransIterator2 {
 
     RigidTrans3 &transformation() { return transformation_; }
 
-    float getScore() { return (*it_)->score_.totalScore_; }
+    float getScore() { return trans_->score(index_); }
 
-    void generateTransformation() { transformation_ = bb1_.trans_[index1_] * (*it_)->refFrame_ * mediatorTrans_; }
+    void generateTransformation() { transformation_ = bb1_.trans_[index1_] * trans_->trans(index_) * mediatorTrans_; }
 
     TransIterator2 &operator++(int) {
         while (!isAtEnd()) {
-            it_++;
-            if (it_ == trans_->end()) {
+            index_++;
+            if (isAtEnd()) {
                 return *this;
             }
             generateTransformation();
@@ -77,13 +85,13 @@ class TransIterator2 {
         return *this;
     }
 
-    bool isAtEnd() { return it_ == trans_->end(); }
+    bool isAtEnd() { return index_ == trans_->size(); }
 
   private:
     const SuperBB &bb1_, &bb2_;
     unsigned int index1_, index2_;
-    const std::vector<std::shared_ptr<TransformationAndScore>> *trans_;
-    std::vector<std::shared_ptr<TransformationAndScore>>::const_iterator it_;
+    const TransList *trans_;
+    size_t index_;
     RigidTrans3 mediatorTrans_;
     RigidTrans3 transformation_;
 };
@@ -0,0 +1,71 @@
+#include "Trace.h"
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Trace::enabled_(false);
+
+namespace {
+struct Event {
+    const char *name_;
+    const char *category_;
+    double start_, duration_; // microseconds from the start of the trace
+    std::string args_;
+};
+
+struct ThreadBuffer {
+    unsigned int tid_;
+    std::vector<Event> events_;
+};
+
+std::chrono::steady_clock::time_point traceStart;
+
+// the buffers of all the threads that recorded a span, kept after their threads end
+std::mutex buffersMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+ThreadBuffer &threadBuffer() {
+    thread_local ThreadBuffer *buffer = NULL;
+    if (buffer == NULL) {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+        buffer = buffers.back().get();
+        buffer->tid_ = buffers.size();
+    }
+    return *buffer;
+}
+} // namespace
+
+void Trace::enable() {
+    traceStart = std::chrono::steady_clock::now();
+    enabled_ = true;
+}
+
+void Trace::record(const char *name, const char *category, std::chrono::steady_clock::time_point start,
+                   const std::string &args) {
+    auto end = std::chrono::steady_clock::now();
+    threadBuffer().events_.push_back({name, category,
+                                      std::chrono::duration<double, std::micro>(start - traceStart).count(),
+                                      std::chrono::duration<double, std::micro>(end - start).count(), args});
+}
+
+bool Trace::write(const std::string fileName) {
+    std::ofstream out(fileName + ".tmp");
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for (const std::unique_ptr<ThreadBuffer> &buffer : buffers) {
+        for (const Event &event : buffer->events_) {
+            out << (first ? "\n" : ",\n") << "{\"name\": \"" << event.name_ << "\", \"cat\": \"" << event.category_
+                << "\", \"ph\": \"X\", \"ts\": " << std::fixed << event.start_ << ", \"dur\": " << event.duration_
+                << ", \"pid\": 1, \"tid\": " << buffer->tid_ << ", \"args\": {" << event.args_ << "}}";
+            first = false;
+        }
+    }
+    out << "\n]}" << std::endl;
+    out.close();
+    return out && std::rename((fileName + ".tmp").c_str(), fileName.c_str()) == 0;
+}
@@ -0,0 +1,66 @@
+/**
+ * Timeline of the phases of a run in the Chrome trace event format (chrome://tracing, ui.perfetto.dev). A Trace::Span
+ * records the time from its construction to its destruction on the calling thread. Each thread records to its own
+ * buffer, so spans on worker threads don't lock, and while tracing is disabled a span only reads a flag.
+ *
+ *   Trace::Span span("cluster", "fold");
+ *   span.arg("length", length);
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+class Trace {
+  public:
+    // starts recording, spans constructed before are not recorded
+    static void enable();
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // writes the spans of all the threads, spans that are still open are not written. Returns false on error
+    static bool write(const std::string fileName);
+
+    class Span {
+      public:
+        // name and category must outlive the trace, e.g. string literals
+        Span(const char *name, const char *category) : name_(NULL) {
+            if (enabled()) {
+                name_ = name;
+                category_ = category;
+                start_ = std::chrono::steady_clock::now();
+            }
+        }
+        ~Span() { end(); }
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+
+        // ends the span before its destruction
+        void end() {
+            if (name_ != NULL)
+                record(name_, category_, start_, args_);
+            name_ = NULL;
+        }
+
+        // adds an argument shown with the span
+        void arg(const char *key, long value) {
+            if (name_ != NULL)
+                args_ += (args_.empty() ? "\"" : ", \"") + std::string(key) + "\": " + std::to_string(value);
+        }
+
+      private:
+        const char *name_;
+        const char *category_;
+        std::chrono::steady_clock::time_point start_;
+        std::string args_;
+    };
+
+  private:
+    static void record(const char *name, const char *category, std::chrono::steady_clock::time_point start,
+                       const std::string &args);
+
+    static std::atomic<bool> enabled_;
+};
+
+#endif /* TRACE_H */
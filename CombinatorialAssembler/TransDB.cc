@@ -0,0 +1,233 @@
+#include "TransDB.h"
+
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+const char MAGIC[8] = {'C', 'F', 'T', 'R', 'A', 'N', 'D', 'B'};
+const uint32_t VERSION = 1;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t namesNum;
+    uint64_t pairsNum;
+    uint64_t recordsOffset;
+};
+
+struct IndexEntry {
+    uint32_t first, second;
+    uint64_t offset; // in records, from the start of the records
+    uint64_t count;
+};
+
+template <class T> void writeValue(std::ostream &out, const T &value) { out.write((const char *)&value, sizeof(T)); }
+
+template <class T> T readValue(const char *&buffer, const char *end) {
+    T value;
+    if (buffer + sizeof(T) > end)
+        throw std::runtime_error("truncated file");
+    memcpy(&value, buffer, sizeof(T));
+    buffer += sizeof(T);
+    return value;
+}
+
+void trim(const char *&begin, const char *&end) {
+    while (begin < end && isspace((unsigned char)*begin))
+        begin++;
+    while (end > begin && isspace((unsigned char)*(end - 1)))
+        end--;
+}
+
+bool isDelimiter(char c, const char *delimiters) { return c != '\0' && strchr(delimiters, c) != NULL; }
+
+// splits [begin, end) into at most maxFields fields at any of the delimiters, adjacent delimiters are merged.
+// returns the number of fields (maxFields + 1 if there are more)
+unsigned int split(const char *begin, const char *end, const char *delimiters, const char **fields,
+                   unsigned int maxFields) {
+    unsigned int n = 0;
+    const char *fieldBegin = begin;
+    for (const char *c = begin;; c++) {
+        if (c == end || isDelimiter(*c, delimiters)) {
+            if (n == maxFields)
+                return n + 1;
+            fields[2 * n] = fieldBegin;
+            fields[2 * n + 1] = c;
+            n++;
+            if (c == end)
+                return n;
+            while (c + 1 < end && isDelimiter(*(c + 1), delimiters))
+                c++;
+            fieldBegin = c + 1;
+        }
+    }
+}
+
+// parses a float at the start of [begin, end) like std::stof, trailing characters are ignored
+bool parseFloat(const char *begin, const char *end, float &value) {
+    while (begin < end && isspace((unsigned char)*begin))
+        begin++;
+    if (begin < end && *begin == '+')
+        begin++;
+    return std::from_chars(begin, end, value).ec == std::errc();
+}
+
+// parses the line [begin, end), returns false for comments, empty and malformed lines (malformed is set)
+bool parseLine(const char *begin, const char *end, TransDB::Record &record, bool &malformed) {
+    malformed = false;
+    trim(begin, end);
+    // skip comments
+    if (begin == end || *begin == '#')
+        return false;
+
+    malformed = true;
+    const char *fields[8];
+    if (split(begin, end, ":|\t", fields, 4) != 4)
+        return false;
+
+    const char *transBegin = fields[6], *transEnd = fields[7];
+    trim(transBegin, transEnd);
+    const char *transFields[12];
+    if (split(transBegin, transEnd, " ", transFields, 6) != 6)
+        return false;
+
+    float t[6];
+    for (int k = 0; k < 6; k++) {
+        if (!parseFloat(transFields[2 * k], transFields[2 * k + 1], t[k]))
+            return false;
+    }
+    if (!parseFloat(fields[2], fields[3], record.score_))
+        return false;
+    for (int k = 0; k < 3; k++) {
+        record.rotation_[k] = t[k];
+        record.translation_[k] = t[k + 3];
+    }
+    malformed = false;
+    return true;
+}
+} // namespace
+
+TransDB::TransDB(const std::string fileName) : file_(new MappedFile(fileName)) {
+    if (!file_->isOpen())
+        throw std::runtime_error("Can't open transformations DB " + fileName);
+    try {
+        const char *buffer = file_->begin();
+        const char *end = file_->end();
+        Header header = readValue<Header>(buffer, end);
+        if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION)
+            throw std::runtime_error("not a transformations DB of version " + std::to_string(VERSION));
+
+        std::vector<std::string> names;
+        for (uint32_t i = 0; i < header.namesNum; i++) {
+            uint32_t length = readValue<uint32_t>(buffer, end);
+            if (buffer + length > end)
+                throw std::runtime_error("truncated file");
+            names.push_back(std::string(buffer, length));
+            buffer += length;
+        }
+
+        if (header.recordsOffset > file_->size() || header.recordsOffset % alignof(Record) != 0)
+            throw std::runtime_error("bad records offset");
+        const Record *records = (const Record *)(file_->begin() + header.recordsOffset);
+        uint64_t recordsNum = (file_->size() - header.recordsOffset) / sizeof(Record);
+        for (uint64_t i = 0; i < header.pairsNum; i++) {
+            IndexEntry entry = readValue<IndexEntry>(buffer, end);
+            if (entry.first >= names.size() || entry.second >= names.size() || entry.offset > recordsNum ||
+                entry.count > recordsNum - entry.offset)
+                throw std::runtime_error("bad index entry");
+            index_[std::make_pair(names[entry.first], names[entry.second])] =
+                std::make_pair(records + entry.offset, entry.count);
+        }
+    } catch (std::runtime_error &e) {
+        throw std::runtime_error("Bad transformations DB " + fileName + ": " + e.what());
+    }
+}
+
+bool TransDB::isTransDB(const std::string fileName) {
+    std::ifstream in(fileName, std::ios::binary);
+    char magic[sizeof(MAGIC)];
+    return in.read(magic, sizeof(magic)) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+const TransDB::Record *TransDB::find(const std::string &first, const std::string &second, uint64_t &count) const {
+    auto it = index_.find(std::make_pair(first, second));
+    if (it == index_.end()) {
+        count = 0;
+        return NULL;
+    }
+    count = it->second.second;
+    return it->second.first;
+}
+
+bool TransDB::write(const std::string fileName, const std::vector<Pair> &pairs) {
+    std::vector<std::string> names;
+    std::map<std::string, uint32_t> nameIds;
+    for (const Pair &pair : pairs) {
+        for (const std::string &name : {pair.first_, pair.second_}) {
+            if (nameIds.insert(std::make_pair(name, (uint32_t)names.size())).second)
+                names.push_back(name);
+        }
+    }
+
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.namesNum = names.size();
+    header.pairsNum = pairs.size();
+    uint64_t offset = sizeof(Header) + pairs.size() * sizeof(IndexEntry);
+    for (const std::string &name : names)
+        offset += sizeof(uint32_t) + name.size();
+    // the records are read in place from the mapping, align them
+    uint64_t padding = (8 - offset % 8) % 8;
+    header.recordsOffset = offset + padding;
+
+    std::ofstream out(fileName, std::ios::binary);
+    if (!out)
+        return false;
+    writeValue(out, header);
+    for (const std::string &name : names) {
+        writeValue<uint32_t>(out, name.size());
+        out.write(name.data(), name.size());
+    }
+    uint64_t recordsOffset = 0;
+    for (const Pair &pair : pairs) {
+        IndexEntry entry = {nameIds[pair.first_], nameIds[pair.second_], recordsOffset, pair.records_.size()};
+        writeValue(out, entry);
+        recordsOffset += pair.records_.size();
+    }
+    for (uint64_t i = 0; i < padding; i++)
+        out.put('\0');
+    for (const Pair &pair : pairs)
+        out.write((const char *)pair.records_.data(), pair.records_.size() * sizeof(Record));
+    out.close();
+    return (bool)out;
+}
+
+bool TransDB::readTextFile(const std::string fileName, unsigned int transNumToRead, std::vector<Record> &records,
+                           unsigned int &malformed) {
+    records.clear();
+    malformed = 0;
+    MappedFile inFile(fileName);
+    if (!inFile.isOpen())
+        return false;
+
+    const char *line = inFile.begin();
+    while (line < inFile.end() && records.size() < transNumToRead) {
+        const char *lineEnd = (const char *)memchr(line, '\n', inFile.end() - line);
+        if (lineEnd == NULL)
+            lineEnd = inFile.end();
+        Record record;
+        bool isMalformed = false;
+        if (parseLine(line, lineEnd, record, isMalformed))
+            records.push_back(record);
+        if (isMalformed)
+            malformed++;
+        line = lineEnd + 1;
+    }
+    return true;
+}
@@ -0,0 +1,61 @@
+/**
+ * Pairwise transformations of all the subunits packed in one binary file. The file holds a header, the subunit names,
+ * an index of (first subunit, second subunit, offset, count) entries and the packed records of each pair. A pair
+ * entry holds the transformations of the text file <first>_plus_<second>, in the same order. The file is
+ * memory-mapped and find returns the records in the mapping, so no file is parsed. BBContainer::readTransDB copies
+ * the records of each pair it reads to its PairTransformations.
+ *
+ * The text pair files are parsed by readTextFile, which is also what the text loader of BBContainer uses.
+ */
+#ifndef TRANSDB_H
+#define TRANSDB_H
+
+#include <MappedFile.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TransDB {
+  public:
+    // one transformation: the rotation angles and translation of a RigidTrans3 and the score
+    struct Record {
+        float rotation_[3];
+        float translation_[3];
+        float score_;
+    };
+
+    // transformations of one ordered pair of subunits
+    struct Pair {
+        std::string first_, second_;
+        std::vector<Record> records_;
+    };
+
+    // open a DB file, throws std::runtime_error if it is not a valid DB
+    TransDB(const std::string fileName);
+
+    // true if the file starts like a DB file
+    static bool isTransDB(const std::string fileName);
+
+    // records of the pair first_plus_second (names without extension), NULL if the pair is not in the DB
+    const Record *find(const std::string &first, const std::string &second, uint64_t &count) const;
+
+    unsigned int pairsNum() const { return index_.size(); }
+
+    // writes the pairs to a new DB file, returns false on error
+    static bool write(const std::string fileName, const std::vector<Pair> &pairs);
+
+    // parses a text transformation file, one "index | score | comment | 6 transformation floats" per line. At most
+    // transNumToRead records are read. Returns false if the file can't be opened, malformed counts skipped lines
+    static bool readTextFile(const std::string fileName, unsigned int transNumToRead, std::vector<Record> &records,
+                             unsigned int &malformed);
+
+  private:
+    std::unique_ptr<MappedFile> file_;
+    // (first, second) -> (records, count)
+    std::map<std::pair<std::string, std::string>, std::pair<const Record *, uint64_t>> index_;
+};
+
+#endif /* TRANSDB_H */
@@ -0,0 +1,124 @@
+// Converts the text transformation files of a complex into one TransDB file, which can be given to the
+// assembler instead of the transformation files prefix.
+#include "../TransDB.h"
+
+#include <Parallel.h>
+
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+std::string trim_extension(const std::string file_name) {
+    if (file_name[file_name.size() - 4] == '.')
+        return file_name.substr(0, file_name.size() - 4);
+    return file_name;
+}
+
+// subunit names of the SU list, without extension
+std::vector<std::string> readSUNames(const std::string SUFileName) {
+    std::ifstream SUFile(SUFileName);
+    if (!SUFile) {
+        std::cerr << "Can't open SU file" << SUFileName << std::endl;
+        exit(1);
+    }
+    std::vector<std::string> names;
+    std::string line;
+    while (getline(SUFile, line)) {
+        boost::trim(line);
+        if (line.length() == 0)
+            continue;
+        std::vector<std::string> split_results;
+        boost::split(split_results, line, boost::is_any_of(" "), boost::token_compress_on);
+        names.push_back(trim_extension(split_results[0]));
+    }
+    return names;
+}
+
+int main(int argc, char **argv) {
+    // output arguments
+    for (int i = 0; i < argc; i++)
+        std::cerr << argv[i] << " ";
+    std::cerr << std::endl;
+
+    std::string suFileName, transFilesPrefix, outFileName;
+    unsigned int transNumToRead, threadsNum;
+    po::options_description desc("Usage: TransDB <subunitsFileList> <transFilesPrefix> <outFile>\n"
+                                 "packs the transformation files <prefix><A>_plus_<B> of all the subunit pairs into "
+                                 "one file\n");
+    desc.add_options()("help,h", "TransDB help")(
+        "transNumToRead,n", po::value<unsigned int>(&transNumToRead)->default_value(0),
+        "maximal number of transformations kept for each pair (default=0, all)")(
+        "threads", po::value<unsigned int>(&threadsNum)->default_value(0),
+        "number of threads used for parsing (default=0, all cores)");
+    po::options_description hidden("Hidden options");
+    hidden.add_options()("SUlist", po::value<std::string>(&suFileName)->required(), "SU list file name")(
+        "transFilesPrefix", po::value<std::string>(&transFilesPrefix)->required(), "Trans files prefix")(
+        "outFile", po::value<std::string>(&outFileName)->required(), "output file name");
+    po::options_description cmdline_options;
+    cmdline_options.add(desc).add(hidden);
+    po::positional_options_description p;
+    p.add("SUlist", 1);
+    p.add("transFilesPrefix", 1);
+    p.add("outFile", 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(cmdline_options).positional(p).run(), vm);
+        if (vm.count("help")) {
+            std::cout << desc << "\n";
+            return 0;
+        }
+        po::notify(vm);
+    } catch (po::error &e) {
+        std::cout << desc << "\n";
+        return 0;
+    }
+    if (transNumToRead == 0)
+        transNumToRead = std::numeric_limits<unsigned int>::max();
+
+    std::vector<std::string> names = readSUNames(suFileName);
+    std::vector<TransDB::Pair> pairs;
+    for (const std::string &first : names) {
+        for (const std::string &second : names) {
+            if (first == second)
+                continue;
+            TransDB::Pair pair;
+            pair.first_ = first;
+            pair.second_ = second;
+            pairs.push_back(pair);
+        }
+    }
+
+    // char and not bool, the elements of std::vector<bool> share words and are written by different threads
+    std::vector<char> opened(pairs.size());
+    std::vector<unsigned int> malformed(pairs.size());
+    parallelFor(pairs.size(), threadsNum, [&](unsigned int i) {
+        std::string inFileName = transFilesPrefix + pairs[i].first_ + "_plus_" + pairs[i].second_;
+        opened[i] = TransDB::readTextFile(inFileName, transNumToRead, pairs[i].records_, malformed[i]);
+    });
+
+    std::vector<TransDB::Pair> found;
+    size_t transNum = 0;
+    for (unsigned int i = 0; i < pairs.size(); i++) {
+        if (!opened[i])
+            continue;
+        if (malformed[i] > 0)
+            std::cerr << malformed[i] << " malformed lines were skipped in " << transFilesPrefix << pairs[i].first_
+                      << "_plus_" << pairs[i].second_ << std::endl;
+        transNum += pairs[i].records_.size();
+        found.push_back(std::move(pairs[i]));
+    }
+
+    if (!TransDB::write(outFileName, found)) {
+        std::cerr << "Can't write " << outFileName << std::endl;
+        return 1;
+    }
+    std::cout << transNum << " transforms of " << found.size() << " pairs were written to " << outFileName
+              << std::endl;
+    return 0;
+}
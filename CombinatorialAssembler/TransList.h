@@ -0,0 +1,66 @@
+#ifndef TRANSLIST_H
+#define TRANSLIST_H
+
+#include <Matrix3.h>
+#include <RigidTrans3.h>
+#include <Vector3.h>
+
+#include <memory>
+#include <vector>
+
+// The transformations read from one pair file <A>_plus_<B>, kept as contiguous arrays of rotations, translations
+// and scores
+class PairTransformations {
+  public:
+    void reserve(size_t n) {
+        rotations_.reserve(n);
+        translations_.reserve(n);
+        scores_.reserve(n);
+    }
+
+    void add(const RigidTrans3 &trans, float score) {
+        rotations_.push_back(trans.rotation());
+        translations_.push_back(trans.translation());
+        scores_.push_back(score);
+    }
+
+    size_t size() const { return scores_.size(); }
+    RigidTrans3 trans(size_t i) const { return RigidTrans3(rotations_[i], translations_[i]); }
+    float score(size_t i) const { return scores_[i]; }
+
+  private:
+    std::vector<Matrix3> rotations_;
+    std::vector<Vector3> translations_;
+    std::vector<float> scores_;
+};
+
+// The transformations of a BB to a partner BB. They are made of the pair files of both directions, the file
+// <partner>_plus_<BB> is used through the inverse of its transformations, which are computed on access.
+// Both BBs of a pair share the same PairTransformations.
+class TransList {
+  public:
+    TransList() : firstInverted_(false), secondInverted_(false), firstSize_(0) {}
+
+    // the transformations of first followed by the transformations of second, each may be used inverted
+    TransList(std::shared_ptr<const PairTransformations> first, bool firstInverted,
+              std::shared_ptr<const PairTransformations> second, bool secondInverted)
+        : first_(first), second_(second), firstInverted_(firstInverted), secondInverted_(secondInverted),
+          firstSize_(first ? first->size() : 0) {}
+
+    size_t size() const { return firstSize_ + (second_ ? second_->size() : 0); }
+
+    RigidTrans3 trans(size_t i) const {
+        if (i < firstSize_)
+            return firstInverted_ ? !first_->trans(i) : first_->trans(i);
+        return secondInverted_ ? !second_->trans(i - firstSize_) : second_->trans(i - firstSize_);
+    }
+
+    float score(size_t i) const { return i < firstSize_ ? first_->score(i) : second_->score(i - firstSize_); }
+
+  private:
+    std::shared_ptr<const PairTransformations> first_, second_;
+    bool firstInverted_, secondInverted_;
+    size_t firstSize_;
+};
+
+#endif /* TRANSLIST_H */
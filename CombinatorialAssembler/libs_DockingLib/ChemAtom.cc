@@ -18,6 +18,12 @@ ChemAtom::ChemAtom(const std::string& PDBrec, bool cif) :
   setPolarity();
 }
 
+ChemAtom::ChemAtom(const Atom& atom) :
+  Atom(atom),
+  chemType_(0), radius_(1.5), charge_(0), epsilon_(-0.01), hbType_(NONE), hbDirection_(Vector3(0,0,0)), ASA_(0) {
+  setPolarity();
+}
+
 void ChemAtom::setHBData(const HB_TYPE hbType, const Vector3& hbDirection) {
   // set type
   if(hbType_ == NONE) hbType_ = hbType;
@@ -46,6 +46,9 @@ class ChemAtom : public Atom { //, public EnergyAtom {
 
   ChemAtom(const std::string& PDBrec, bool cif = false);
 
+  //// the atom data of atom with default chemical data, as read from a record
+  explicit ChemAtom(const Atom& atom);
+
 
   // GROUP: modifiers
 
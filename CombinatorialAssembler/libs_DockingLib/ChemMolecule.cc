@@ -29,6 +29,10 @@ bool compareFragment(ChemMolecule::Fragment f1, ChemMolecule::Fragment f2) {
 
 void ChemMolecule::loadMolecule(std::istream &molFile, const ChemLib& chemLib, const PDB::Selector& selector) {
   Molecule<ChemAtom>::readAllPDBfile(molFile, selector);
+  assignChemLib(chemLib);
+}
+
+void ChemMolecule::assignChemLib(const ChemLib& chemLib) {
   for(Molecule<ChemAtom>::iterator molIter = begin(); molIter != end(); molIter++) {
     if(!molIter->isHydrogen()) {
       const ChemEntry* entry=chemLib.getLibEntry(molIter->residueName(), molIter->type());
@@ -60,6 +60,9 @@ public:
   //// load molecule from PDB file, using chemLib for attributes.
   void loadMolecule(std::istream &molFile, const ChemLib& chemLib, const PDB::Selector& selector = PDB::WaterHydrogenUnSelector());
 
+  //// assigns the chemLib attributes to atoms that were added one by one, as done by loadMolecule
+  void assignChemLib(const ChemLib& chemLib);
+
   //// reads and assigns default values for radius, charge and chemType
   void readAllPDBfile(std::istream &molFile, const PDB::Selector& selector = PDB::WaterHydrogenUnSelector());
 
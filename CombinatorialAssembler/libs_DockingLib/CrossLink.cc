@@ -12,6 +12,12 @@ int readCrossLinkFile(const std::string& fileName,
     std::cerr << "Can't find cross links file " << fileName << std::endl;
     exit(0);
   }
+  return readCrossLinks(s, crossLinks, addReverse);
+}
+
+int readCrossLinks(std::istream& s,
+                   std::vector<CrossLink>& crossLinks,
+                   bool addReverse) {
   CrossLink cl;
   while (s >> cl) {
     if(! cl.isInList(crossLinks)) { // check for duplicates
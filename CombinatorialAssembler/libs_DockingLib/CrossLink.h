@@ -59,6 +59,11 @@ int readCrossLinkFile(const std::string& fileName,
                       std::vector<CrossLink>& crossLinks,
                       bool addReverse = false);
 
+//// reads the cross links of a stream in the format of the cross links file
+int readCrossLinks(std::istream& s,
+                   std::vector<CrossLink>& crossLinks,
+                   bool addReverse = false);
+
 
 void writeCrossLinkFile(const std::string& fileName,
                         const std::vector<CrossLink>& crossLinks);
@@ -6,6 +6,7 @@
 
 #include "connolly_surface.h"
 #include <numerics.h>
+#include <Parallel.h>
 
 #include <boost/multi_array.hpp>
 #include <boost/unordered_map.hpp>
@@ -13,6 +14,7 @@
 #include <math.h>
 #include <vector>
 #include <algorithm>
+#include <sstream>
 
 
 /* Put GridPoint in a non-anonymous namespace, since g++ 4.2 has a bug which
@@ -97,8 +99,8 @@ class Cube {
   bool get_neighbors(int n, const std::vector<Vector3> &CO, float rp,
                      const std::vector<int> &IAT,
                      const std::vector<float> &rtype,
-                     std::vector<int> &neighbors) {
-    AtomInfo &ai = atom_info_[n];
+                     std::vector<int> &neighbors) const {
+    const AtomInfo &ai = atom_info_[n];
     neighbors.resize(0);
     if (ai.skip) {
       return false;
@@ -221,26 +223,24 @@ struct ProbePoint {
   std::vector<SurfPoint> points;
 };
 
-class YonCube {
+// Cell list of probe centers (yon or victim probes). The cube width is at
+// least the probe diameter, so all the centers closer than a probe diameter
+// to a point are in the point's cube or in the adjoining ones.
+class ProbeCube {
  public:
-  YonCube(const std::vector<YonProbe> &yon_probes, float rp, float dp,
-          float radmax)
+  ProbeCube(const std::vector<Vector3> &centers, float rp, float radmax)
       : comin_(1000000.0, 1000000.0, 1000000.0) {
     width_ = 2. * (radmax + rp);
-    dp2_ = dp * dp;
-    for (unsigned n = 0; n < yon_probes.size(); ++n) {
-      comin_.updateX(std::min(comin_[0], yon_probes[n].center[0]));
-      comin_.updateY(std::min(comin_[1], yon_probes[n].center[1]));
-      comin_.updateZ(std::min(comin_[2], yon_probes[n].center[2]));
-      // for (int k = 0; k < 3; ++k) {
-      //   comin_[k] = std::min(comin_[k], yon_probes[n].center[k]);
-      // }
+    for (unsigned n = 0; n < centers.size(); ++n) {
+      comin_.updateX(std::min(comin_[0], centers[n][0]));
+      comin_.updateY(std::min(comin_[1], centers[n][1]));
+      comin_.updateZ(std::min(comin_[2], centers[n][2]));
     }
 
     dim_ = 0;
-    atom_info_.resize(yon_probes.size());
-    for (unsigned n = 0; n < yon_probes.size(); ++n) {
-      atom_info_[n].ico = get_cube_coordinates(yon_probes[n].center);
+    atom_info_.resize(centers.size());
+    for (unsigned n = 0; n < centers.size(); ++n) {
+      atom_info_[n].ico = get_cube_coordinates(centers[n]);
       for (int k = 0; k < 3; ++k) {
         dim_ = std::max(dim_, atom_info_[n].ico[k]);
       }
@@ -254,14 +254,15 @@ class YonCube {
         }
       }
     }
-    for (unsigned n = 0; n < yon_probes.size(); ++n) {
+    for (unsigned n = 0; n < centers.size(); ++n) {
       add_probe_to_cube(n);
     }
   }
 
-  bool probe_overlap(const ProbePoint &probe,
-                     const std::vector<YonProbe> &yon_probes) {
-    std::vector<int> ic = get_cube_coordinates(probe.position);
+  // Call func(index) for each center in the cube of p and the adjoining cubes
+  template <class Func>
+  void for_each_near(const Vector3 &p, Func func) const {
+    std::vector<int> ic = get_cube_coordinates(p);
     for (int k = 0; k < 3; ++k) {
       ic[k] = std::max(ic[k], 0);
       ic[k] = std::min(ic[k], dim_ - 1);
@@ -275,11 +276,7 @@ class YonCube {
               if (jck >= 0 && jck < dim_) {
                 for (int jp = cube_[jci][jcj][jck]; jp >= 0;
                      jp = atom_info_[jp].icuptr) {
-                  const YonProbe &yp = yon_probes[jp];
-                  if (yp.center.dist2(probe.position) < dp2_ &&
-                      yp.altitude * probe.to_center < 0) {
-                    return true;
-                  }
+                  func(jp);
                 }
               }
             }
@@ -287,7 +284,6 @@ class YonCube {
         }
       }
     }
-    return false;
   }
 
  private:
@@ -304,7 +300,7 @@ class YonCube {
     }
   }
 
-  std::vector<int> get_cube_coordinates(const Vector3 &c) {
+  std::vector<int> get_cube_coordinates(const Vector3 &c) const {
     std::vector<int> ret;
     for (int k = 0; k < 3; ++k) {
       ret.push_back(static_cast<int>((c[k] - comin_[k]) / width_));
@@ -315,7 +311,6 @@ class YonCube {
   Vector3 comin_;
   int dim_;
   float width_;
-  float dp2_;
   std::vector<AtomInfo> atom_info_;
   boost::multi_array<int, 3> cube_;
 };
@@ -360,7 +355,7 @@ void imatx(std::vector<Vector3> &ghgt) {
 
 // Concatenate matrix b into matrix a
 void cat(std::vector<Vector3> &a, const std::vector<Vector3> &b) {
-  std::vector<Vector3> temp(3);
+  Vector3 temp[3];
   /*
   for (int i = 0; i < 3; ++i) {
     for (int j = 0; j < 3; ++j) {
@@ -375,7 +370,9 @@ void cat(std::vector<Vector3> &a, const std::vector<Vector3> &b) {
     temp[j].updateZ(a[0][2] * b[j][0] + a[1][2] * b[j][1] + a[2][2] * b[j][2]);
   }
 
-  a = temp;
+  for (int j = 0; j < 3; ++j) {
+    a[j] = temp[j];
+  }
 }
 
 // Conjugate matrix g with matrix h giving ghgt
@@ -461,23 +458,55 @@ struct SurfaceInfo {
   int nlost_concave;
 };
 
-void handle_atom(Surface &surface_points, int iatom, float d,
-                 const std::vector<int> inbr, const std::vector<Vector3> &CO,
-                 float rp, std::vector<bool> &srs, const std::vector<Vector3> &up,
-                 std::vector<YonProbe> &yon_probes,
-                 const std::vector<Vector3> &circle, const std::vector<int> &IAT,
-                 const std::vector<float> &rtype,
-                 const std::vector<AtomTypeInfo> &attyp_info,
-                 std::vector<ProbePoint> &beforept, SurfaceInfo &surface) {
-  float ri = rtype[IAT[iatom]];
-  Vector3 ci = CO[iatom];
-
-  /* transfer data from main arrays to neighbors */
+// Neighbors of an atom, linked in order of increasing distance from it
+struct Neighborhood {
   std::vector<Vector3> cnbr;
   std::vector<float> rnbr;
   std::vector<float> ernbr;
-  std::vector<float> disnbr;
   std::vector<int> lknbr;
+  int lkf;
+};
+
+// Saddle of the atoms iatom < jatom found by handle_atom. Whether it is
+// buried depends on the reentrant surface found by earlier atoms, so it is
+// decided later in atom order (see apply_reentrant_flags)
+struct AtomPair {
+  int jatom;
+  // third atoms of the concave triangles with some free probe
+  std::vector<int> concave;
+  // the torus is buried unless one of the atoms has reentrant surface
+  bool buried;
+  // some probe position around the pair is free
+  bool free;
+  // the saddle probes in AtomSurface::probes
+  unsigned saddle_begin, saddle_end;
+};
+
+// The surface of one atom: the reentrant probes of handle_atom and the
+// contact points of handle_contact
+struct AtomSurface {
+  AtomSurface() : handled(false), has_neighbors(false) {}
+
+  bool handled;
+  bool has_neighbors;
+  std::vector<AtomPair> pairs;
+  std::vector<ProbePoint> probes;
+  std::vector<SurfacePoint> contact;
+  std::string warnings;
+};
+
+void get_neighborhood(int iatom, const std::vector<int> &inbr,
+                      const std::vector<Vector3> &CO, float rp,
+                      const std::vector<int> &IAT,
+                      const std::vector<float> &rtype, Neighborhood &nb) {
+  Vector3 ci = CO[iatom];
+  std::vector<Vector3> &cnbr = nb.cnbr;
+  std::vector<float> &rnbr = nb.rnbr;
+  std::vector<float> &ernbr = nb.ernbr;
+  std::vector<int> &lknbr = nb.lknbr;
+  std::vector<float> disnbr;
+
+  /* transfer data from main arrays to neighbors */
   for (unsigned iuse = 0; iuse < inbr.size(); ++iuse) {
     int jatom = inbr[iuse];
     cnbr.push_back(CO[jatom]);
@@ -511,6 +540,23 @@ void handle_atom(Surface &surface_points, int iatom, float d,
   if (inbr.size() == 0) {
     lkf = -1;
   }
+  nb.lkf = lkf;
+}
+
+// Reentrant probes of the pairs and triangles in which iatom is the first atom
+void handle_atom(int iatom, float d, const std::vector<int> &inbr,
+                 const Neighborhood &nb, const std::vector<Vector3> &CO,
+                 float rp, const std::vector<Vector3> &up,
+                 const std::vector<Vector3> &circle, const std::vector<int> &IAT,
+                 const std::vector<float> &rtype, AtomSurface &atom) {
+  float ri = rtype[IAT[iatom]];
+  Vector3 ci = CO[iatom];
+  const std::vector<Vector3> &cnbr = nb.cnbr;
+  const std::vector<float> &rnbr = nb.rnbr;
+  const std::vector<float> &ernbr = nb.ernbr;
+  const std::vector<int> &lknbr = nb.lknbr;
+  int lkf = nb.lkf;
+  std::ostringstream warnings;
 
   // medium loop for each neighbor of iatom
   for (unsigned jnbr = 0; jnbr < inbr.size(); ++jnbr) {
@@ -536,8 +582,8 @@ void handle_atom(Surface &surface_points, int iatom, float d,
        AND Q AND T DEFINING THE SADDLE PLANE */
     float dij = vij.norm();
     if (dij <= 0.) {
-      std::cerr << "Atoms " << iatom << " and " << jatom
-                << " have the same center" << std::endl;
+      warnings << "Atoms " << iatom << " and " << jatom
+               << " have the same center" << std::endl;
       continue;
     }
     Vector3 uij = vij.getUnitVector();
@@ -563,6 +609,11 @@ void handle_atom(Surface &surface_points, int iatom, float d,
     // A STARTING ALTITUDE
     Vector3 aij = hij * q;
 
+    AtomPair atom_pair;
+    atom_pair.jatom = jatom;
+    atom_pair.buried = false;
+    atom_pair.free = false;
+
     // CONCAVE REENTRANT SURFACE
 
     // GATHER MUTUAL NEIGHBORS OF IATOM AND JATOM
@@ -613,8 +664,8 @@ void handle_atom(Surface &surface_points, int iatom, float d,
       float dijk = vijk.norm();
 
       if (dijk <= 0.0) {
-        std::cerr << "Atoms " << iatom << ", " << jatom << ", and " << katom
-                  << " have concentric circles" << std::endl;
+        warnings << "Atoms " << iatom << ", " << jatom << ", and " << katom
+                 << " have concentric circles" << std::endl;
         continue;
       }
       float f = 0.5 * (1.0 + (hij * hij - rijk * rijk) / (dijk * dijk));
@@ -637,13 +688,11 @@ void handle_atom(Surface &surface_points, int iatom, float d,
       // SO THEIR CROSS PRODUCT IS PERPENDICULAR TO THIS PLANE
       Vector3 aijk0 = uij&uijk; //algebra::get_vector_product(uij, uijk);
 
-      std::vector<Vector3> aijk;
-      aijk.push_back(aijk0 * hijk);
-      aijk.push_back(-aijk0 * hijk);
+      Vector3 aijk[2] = {aijk0 * hijk, -aijk0 * hijk};
 
       // PROBE PLACEMENT AT ENDS OF ALTITUDE VECTORS
-      std::vector<Vector3> pijk(2);
-      std::vector<bool> pair(2);
+      Vector3 pijk[2];
+      bool pair[2];
       for (int ip = 0; ip < 2; ++ip) {
         pijk[ip] = bijk + aijk[ip];
         // COLLISION CHECK WITH MUTUAL NEIGHBORS
@@ -653,7 +702,7 @@ void handle_atom(Surface &surface_points, int iatom, float d,
       if (!pair[0] && !pair[1]) continue;
       bool both = pair[0] && pair[1];
       // SOME REENTRANT SURFACE FOR ALL THREE ATOMS
-      srs[iatom] = srs[jatom] = srs[katom] = true;
+      atom_pair.concave.push_back(katom);
 
       // GENERATE SURFACE POINTS
       float area = (4. * pi * rp * rp) / up.size();
@@ -716,12 +765,7 @@ void handle_atom(Surface &surface_points, int iatom, float d,
           probe_point.position = pijk[ip];
           probe_point.to_center = aijk[ip];
           probe_point.type = yonprb ? YON : OTHER;
-          beforept.push_back(probe_point);
-
-          // SAVE PROBE IN YON PROBE ARRAYS
-          if (yonprb) {
-            yon_probes.push_back(YonProbe(pijk[ip], aijk[ip]));
-          }
+          atom.probes.push_back(probe_point);
         }
       }
     }
@@ -735,19 +779,22 @@ void handle_atom(Surface &surface_points, int iatom, float d,
        (AFTER TRIANGLES WITH ALL KATOMS HAVE BEEN CHECKED)
        AND IF THERE IS SOME MUTUAL NEIGHBOR IN THE SAME MOLECULE
        CLOSE ENOUGH SO THAT THE TORUS CANNOT BE FREE,
-       THEN WE KNOW THAT THIS MUST BE A BURIED TORUS */
-    if (!srs[iatom] && !srs[jatom] && mutual > 0) {
-      bool buried_torus = false;
-      for (unsigned knbr = 0; knbr < inbr.size() && !buried_torus; ++knbr) {
+       THEN WE KNOW THAT THIS MUST BE A BURIED TORUS.
+       THE REENTRANT SURFACE OF EARLIER ATOMS IS NOT KNOWN HERE, SO THE
+       SADDLE PROBES ARE GENERATED ANYWAY AND DROPPED IN ATOM ORDER */
+    int burying = -1;
+    if (mutual > 0) {
+      for (unsigned knbr = 0; knbr < inbr.size() && !atom_pair.buried; ++knbr) {
         if (!mnbr[knbr]) continue;
         float d2 = bij.dist2(cnbr[knbr]);
         float rk2 = ernbr[knbr] * ernbr[knbr] - hij * hij;
         if (d2 < rk2) {
-          buried_torus = true;
+          atom_pair.buried = true;
+          burying = knbr;
         }
       }
-      if (buried_torus) continue;
     }
+    atom_pair.saddle_begin = atom.probes.size();
 
     // CALCULATE NUMBER OF ROTATIONS OF PROBE PAIR,
     // ROTATION ANGLE AND ROTATION MATRIX
@@ -820,26 +867,29 @@ void handle_atom(Surface &surface_points, int iatom, float d,
 
     // ROTATE THE PROBE PAIR AROUND THE PAIR OF ATOMS
     for (int irot = 0; irot < nrot; ++irot, cat(pow, ghgt)) {
-      std::vector<Vector3> aijp(2);
+      Vector3 aijp[2];
       // MULTIPLY ALTITUDE VECTOR BY POWER MATRIX
       multv(aij, pow, aijp[0]);
       // SET UP OPPOSING ALTITUDE
       aijp[1] = -aijp[0];
 
       // SET UP PROBE SPHERE POSITIONS
-      std::vector<Vector3> pijp(2);
+      Vector3 pijp[2];
       bool pair[2];
       for (int ip = 0; ip < 2; ++ip) {
         pijp[ip] = bij + aijp[ip];
-        // CHECK FOR COLLISIONS WITH NEIGHBORING ATOMS
-        pair[ip] = !collid(pijp[ip], cnbr, ernbr, jnbr, -1, lkf, lknbr);
+        // CHECK FOR COLLISIONS WITH NEIGHBORING ATOMS, STARTING WITH
+        // THE NEIGHBOR THAT BURIES THE TORUS, WHICH MOST PROBES HIT
+        pair[ip] = !(burying >= 0 && pijp[ip].dist2(cnbr[burying]) <
+                                         ernbr[burying] * ernbr[burying]) &&
+                   !collid(pijp[ip], cnbr, ernbr, jnbr, -1, lkf, lknbr);
       }
 
       // NO SURFACE GENERATION IF NEITHER PROBE POSITION IS ALLOWED
       if (!pair[0] && !pair[1]) continue;
       bool both = pair[0] && pair[1];
       // SOME REENTRANT SURFACE FOR BOTH ATOMS
-      srs[iatom] = srs[jatom] = true;
+      atom_pair.free = true;
 
       /* SKIP TO BOTTOM OF MIDDLE LOOP IF IATOM AND JATOM
          ARE CLOSE ENOUGH AND THE SURFACE POINT DENSITY IS
@@ -886,21 +936,53 @@ void handle_atom(Surface &surface_points, int iatom, float d,
           probe_point.position = pijp[ip];
           probe_point.to_center = aijp[ip];
           probe_point.type = yonprb ? YON : OTHER;
-          beforept.push_back(probe_point);
-          // SAVE PROBE IN YON PROBE ARRAYS
-          if (yonprb) {
-            yon_probes.push_back(YonProbe(pijp[ip], aijp[ip]));
-          }
+          atom.probes.push_back(probe_point);
         }
       }
     }
+    atom_pair.saddle_end = atom.probes.size();
+    atom.pairs.push_back(atom_pair);
   }
+  atom.warnings = warnings.str();
+}
 
-  /* IF THE PROBE RADIUS IS GREATER THAN ZERO
-     AND IATOM HAS AT LEAST ONE NEIGHBOR, BUT NO REENTRANT SURFACE,
-     THEN IATOM MUST BE COMPLETELY INACCESSIBLE TO THE PROBE */
-  if (rp > 0. && inbr.size() > 0 && !srs[iatom]) return;
+// Replays the reentrant surface flags of the pairs of iatom in the order the
+// serial program sets them, and drops the saddle probes of buried tori
+void apply_reentrant_flags(int iatom, AtomSurface &atom,
+                           std::vector<bool> &srs) {
+  std::vector<bool> keep(atom.probes.size(), true);
+  for (unsigned p = 0; p < atom.pairs.size(); ++p) {
+    const AtomPair &atom_pair = atom.pairs[p];
+    int jatom = atom_pair.jatom;
+    for (unsigned k = 0; k < atom_pair.concave.size(); ++k) {
+      srs[iatom] = srs[jatom] = srs[atom_pair.concave[k]] = true;
+    }
+    if (atom_pair.buried && !srs[iatom] && !srs[jatom]) {
+      for (unsigned i = atom_pair.saddle_begin; i < atom_pair.saddle_end; ++i) {
+        keep[i] = false;
+      }
+      continue;
+    }
+    if (atom_pair.free) {
+      srs[iatom] = srs[jatom] = true;
+    }
+  }
 
+  std::vector<ProbePoint> probes;
+  for (unsigned i = 0; i < atom.probes.size(); ++i) {
+    if (keep[i]) probes.push_back(std::move(atom.probes[i]));
+  }
+  atom.probes.swap(probes);
+}
+
+// Contact surface points of iatom
+void handle_contact(int iatom, const Neighborhood &nb,
+                    const std::vector<Vector3> &CO, const std::vector<int> &IAT,
+                    const std::vector<float> &rtype,
+                    const std::vector<AtomTypeInfo> &attyp_info,
+                    std::vector<SurfacePoint> &contact) {
+  float ri = rtype[IAT[iatom]];
+  Vector3 ci = CO[iatom];
   const AtomTypeInfo &attyp = attyp_info[IAT[iatom]];
   float area = (4. * pi * ri * ri) / attyp.ua.size();
 
@@ -909,22 +991,16 @@ void handle_atom(Surface &surface_points, int iatom, float d,
     // SET UP PROBE COORDINATES
     Vector3 pipt = ci + attyp.eva[i];
     // CHECK FOR COLLISION WITH NEIGHBORING ATOMS
-    if (collid(pipt, cnbr, ernbr, -1, -1, lkf, lknbr)) continue;
+    if (collid(pipt, nb.cnbr, nb.ernbr, -1, -1, nb.lkf, nb.lknbr)) continue;
 
-    // INCREMENT SURFACE POINT COUNTER FOR CONVEX SURFACE
-    surface.npoints++;
-
-    // ADD SURFACE POINT AREA TO CONTACT AREA
-    surface.area += area;
     Vector3 outco = ci + ri * attyp.ua[i];
     Vector3 outvec = attyp.ua[i];
 
     // CONTACT
     //SurfacePoint sp(iatom, -1, -1, outco, area, outvec);
     SurfacePoint sp(outco, outvec, area, iatom);
-    surface_points.push_back(sp);
+    contact.push_back(sp);
   }
-  return;
 }
 
 SurfaceInfo generate_contact_surface(
@@ -932,7 +1008,7 @@ SurfaceInfo generate_contact_surface(
     float radmax, float rp, float d, std::vector<YonProbe> &yon_probes,
     const std::vector<int> &IAT, const std::vector<float> &rtype,
     const std::vector<AtomTypeInfo> &attyp_info,
-    std::vector<ProbePoint> &beforept) {
+    std::vector<ProbePoint> &beforept, unsigned int threadsNum) {
   Cube cube;
   cube.grid_coordinates(CO, radmax, rp);
 
@@ -953,152 +1029,244 @@ SurfaceInfo generate_contact_surface(
         Vector3(rp * std::cos(fi), rp * std::sin(fi), 0.));
   }
 
-  SurfaceInfo surface;
-  std::vector<bool> srs(CO.size(), false);
-  for (unsigned i = 0; i < CO.size(); ++i) {
+  // the atoms are handled in parallel, the reentrant surface flags that
+  // decide which probes and contact points are kept are then applied in
+  // atom order, so the result is the same for any number of threads
+  std::vector<AtomSurface> atoms(CO.size());
+  parallelFor(CO.size(), threadsNum, [&](unsigned int i) {
     std::vector<int> itnl;
     if (cube.get_neighbors(i, CO, rp, IAT, rtype, itnl)) {
       std::sort(itnl.begin(), itnl.end());
-      handle_atom(surface_points, i, d, itnl, CO, rp, srs, up, yon_probes,
-                  circle, IAT, rtype, attyp_info, beforept, surface);
+      Neighborhood nb;
+      get_neighborhood(i, itnl, CO, rp, IAT, rtype, nb);
+      atoms[i].handled = true;
+      atoms[i].has_neighbors = itnl.size() > 0;
+      handle_atom(i, d, itnl, nb, CO, rp, up, circle, IAT, rtype, atoms[i]);
+    }
+  });
+
+  std::vector<bool> srs(CO.size(), false);
+  for (unsigned i = 0; i < CO.size(); ++i) {
+    apply_reentrant_flags(i, atoms[i], srs);
+  }
+
+  /* IF THE PROBE RADIUS IS GREATER THAN ZERO
+     AND IATOM HAS AT LEAST ONE NEIGHBOR, BUT NO REENTRANT SURFACE,
+     THEN IATOM MUST BE COMPLETELY INACCESSIBLE TO THE PROBE */
+  parallelFor(CO.size(), threadsNum, [&](unsigned int i) {
+    if (!atoms[i].handled) return;
+    if (rp > 0. && atoms[i].has_neighbors && !srs[i]) return;
+    std::vector<int> itnl;
+    cube.get_neighbors(i, CO, rp, IAT, rtype, itnl);
+    std::sort(itnl.begin(), itnl.end());
+    Neighborhood nb;
+    get_neighborhood(i, itnl, CO, rp, IAT, rtype, nb);
+    handle_contact(i, nb, CO, IAT, rtype, attyp_info, atoms[i].contact);
+  });
+
+  SurfaceInfo surface;
+  for (unsigned i = 0; i < CO.size(); ++i) {
+    AtomSurface &atom = atoms[i];
+    std::cerr << atom.warnings;
+    for (unsigned j = 0; j < atom.contact.size(); ++j) {
+      // INCREMENT SURFACE POINT COUNTER FOR CONVEX SURFACE
+      surface.npoints++;
+      // ADD SURFACE POINT AREA TO CONTACT AREA
+      surface.area += atom.contact[j].surfaceArea();
+      surface_points.push_back(atom.contact[j]);
+    }
+    for (unsigned j = 0; j < atom.probes.size(); ++j) {
+      // SAVE PROBE IN YON PROBE ARRAYS
+      if (atom.probes[j].type == YON) {
+        yon_probes.push_back(
+            YonProbe(atom.probes[j].position, atom.probes[j].to_center));
+      }
+      beforept.push_back(std::move(atom.probes[j]));
     }
+    atom = AtomSurface();
   }
   return surface;
 }
 
 void get_victim_probes(const std::vector<YonProbe> &yon_probes,
                        std::vector<ProbePoint> &beforept, float rp,
-                       float radmax, std::vector<int> &victims) {
+                       float radmax, std::vector<int> &victims,
+                       unsigned int threadsNum) {
   // NO VICTIM PROBES IF NO YON PROBES
   if (yon_probes.size() == 0) return;
 
   // Probe diameter
   float dp = 2. * rp;
+  float dp2 = dp * dp;
 
-  YonCube cube(yon_probes, rp, dp, radmax);
+  std::vector<Vector3> centers;
+  for (unsigned j = 0; j < yon_probes.size(); ++j) {
+    centers.push_back(yon_probes[j].center);
+  }
+  ProbeCube cube(centers, rp, radmax);
 
-  int ivic = 0;
-  for (std::vector<ProbePoint>::iterator pit = beforept.begin();
-       pit != beforept.end(); ++pit, ++ivic) {
-    if (pit->type == YON) continue;
+  parallelFor(beforept.size(), threadsNum, [&](unsigned int ivic) {
+    ProbePoint &probe = beforept[ivic];
+    if (probe.type == YON) return;
 
     // CHECK IF PROBE TOO FAR FROM SYMMETRY ELEMENT FOR POSSIBLE OVERLAP
-    if (pit->to_center.norm2() > dp * dp) continue;
+    if (probe.to_center.norm2() > dp2) return;
 
     // LOOK FOR OVERLAP WITH ANY YON PROBE IN THE SAME MOLECULE
-    if (cube.probe_overlap(*pit, yon_probes)) {
+    bool overlap = false;
+    cube.for_each_near(probe.position, [&](int jp) {
+      const YonProbe &yp = yon_probes[jp];
+      if (yp.center.dist2(probe.position) < dp2 &&
+          yp.altitude * probe.to_center < 0) {
+        overlap = true;
+      }
+    });
+    if (overlap) {
+      probe.type = VICTIM;
+    }
+  });
+
+  for (unsigned ivic = 0; ivic < beforept.size(); ++ivic) {
+    if (beforept[ivic].type == VICTIM) {
       victims.push_back(ivic);
-      pit->type = VICTIM;
     }
   }
 }
 
 void get_eaten_points(const std::vector<YonProbe> &yon_probes,
+                      const ProbeCube &yon_cube,
                       const std::vector<ProbePoint> &beforept, float dp2,
                       const ProbePoint &probe, unsigned &neat, unsigned &nyeat,
-                      const std::vector<int> &victims, std::vector<Vector3> &eat,
-                      int &pi) {
+                      const std::vector<int> &victims,
+                      const ProbeCube &victim_cube, std::vector<Vector3> &eat) {
   neat = nyeat = 0;
   eat.resize(0);
   if (yon_probes.size() == 0) return;
 
-  pi++;
   // DETERMINE IF PROBE IS A YON OR VICTIM PROBE
   if (probe.type == OTHER) {
     return;
   }
 
-  // CHECK THIS VICTIM OR YON PROBE AGAINST ALL YON PROBES
-  for (unsigned j = 0; j < yon_probes.size(); ++j) {
-    if (probe.position.dist2(yon_probes[j].center) >= dp2) continue;
-    if (probe.to_center * yon_probes[j].altitude >= 0.) continue;
+  // CHECK THIS VICTIM OR YON PROBE AGAINST THE CLOSE YON PROBES
+  yon_cube.for_each_near(probe.position, [&](int j) {
+    if (probe.position.dist2(yon_probes[j].center) >= dp2) return;
+    if (probe.to_center * yon_probes[j].altitude >= 0.) return;
 
     // THIS YON PROBE COULD EAT SOME OF THE PROBE'S POINTS
     neat++;
     nyeat++;
     eat.push_back(yon_probes[j].center);
-  }
+  });
 
   // ONLY YON PROBES CAN HAVE THEIR POINTS EATEN BY VICTIMS
   if (probe.type != YON) return;
 
-  // CHECK THIS YON PROBE AGAINST ALL VICTIM PROBES
-  for (unsigned j = 0; j < victims.size(); ++j) {
+  // CHECK THIS YON PROBE AGAINST THE CLOSE VICTIM PROBES
+  victim_cube.for_each_near(probe.position, [&](int j) {
     const ProbePoint &victim = beforept[victims[j]];
-    if (probe.position.dist2(victim.position) >= dp2) continue;
-    if (probe.to_center * victim.to_center >= 0.) continue;
+    if (probe.position.dist2(victim.position) >= dp2) return;
+    if (probe.to_center * victim.to_center >= 0.) return;
     // THIS VICTIM PROBE COULD EAT SOME OF THE PROBE'S POINTS
     neat++;
     eat.push_back(victim.position);
-  }
+  });
 }
 
 void check_eaten_points(Surface &surface_points,
                         const std::vector<YonProbe> &yon_probes,
                         const std::vector<ProbePoint> &beforept, float rp,
-                        const std::vector<int> &victims, SurfaceInfo &surface) {
+                        float radmax, const std::vector<int> &victims,
+                        SurfaceInfo &surface, unsigned int threadsNum) {
   float rp2 = rp * rp;
   float dp = rp * 2.;
   float dp2 = dp * dp;
-  int pi = 0;
-  for (std::vector<ProbePoint>::const_iterator pit = beforept.begin();
-       pit != beforept.end(); ++pit) {
-    unsigned neat, nyeat;
-    std::vector<Vector3> eat;
-    get_eaten_points(yon_probes, beforept, dp2, *pit, neat, nyeat, victims, eat,
-                     pi);
-
-    // READ THE SURFACE POINTS BELONGING TO THE PROBE
-    for (std::vector<SurfPoint>::const_iterator sit = pit->points.begin();
-         sit != pit->points.end(); ++sit) {
-      // CHECK SURFACE POINT AGAINST ALL EATERS OF THIS PROBE
-      bool point_eaten = false;
-      for (unsigned k = 0; k < eat.size(); ++k) {
-        // VICTIM PROBES CANNOT EAT NON-YON POINTS OF YON PROBES
-        if (!(pit->type == YON && !sit->yon && k >= nyeat) &&
-            eat[k].dist2(sit->s) < rp2) {
-          point_eaten = true;
-          break;
+
+  std::vector<Vector3> centers;
+  for (unsigned j = 0; j < yon_probes.size(); ++j) {
+    centers.push_back(yon_probes[j].center);
+  }
+  ProbeCube yon_cube(centers, rp, radmax);
+  centers.resize(0);
+  for (unsigned j = 0; j < victims.size(); ++j) {
+    centers.push_back(beforept[victims[j]].position);
+  }
+  ProbeCube victim_cube(centers, rp, radmax);
+
+  // the probes are checked in parallel blocks that are merged in order
+  const unsigned block_size = 256;
+  unsigned blocks = (beforept.size() + block_size - 1) / block_size;
+  std::vector<std::vector<SurfacePoint> > kept(blocks);
+  std::vector<SurfaceInfo> lost(blocks);
+  parallelFor(blocks, threadsNum, [&](unsigned int b) {
+    unsigned end = std::min<unsigned>(beforept.size(), (b + 1) * block_size);
+    for (unsigned p = b * block_size; p < end; ++p) {
+      const ProbePoint &probe = beforept[p];
+      unsigned neat, nyeat;
+      std::vector<Vector3> eat;
+      get_eaten_points(yon_probes, yon_cube, beforept, dp2, probe, neat, nyeat,
+                       victims, victim_cube, eat);
+
+      // READ THE SURFACE POINTS BELONGING TO THE PROBE
+      for (std::vector<SurfPoint>::const_iterator sit = probe.points.begin();
+           sit != probe.points.end(); ++sit) {
+        // CHECK SURFACE POINT AGAINST ALL EATERS OF THIS PROBE
+        bool point_eaten = false;
+        for (unsigned k = 0; k < eat.size(); ++k) {
+          // VICTIM PROBES CANNOT EAT NON-YON POINTS OF YON PROBES
+          if (!(probe.type == YON && !sit->yon && k >= nyeat) &&
+              eat[k].dist2(sit->s) < rp2) {
+            point_eaten = true;
+            break;
+          }
         }
-      }
 
-      if (!point_eaten) {
-        Vector3 outvec = (pit->position - sit->s) / rp;
-        // REENTRANT SURFACE POINT
-        surface.npoints++;
-        surface.area += sit->area;
-
-        //SurfacePoint sp(sit->n1, sit->n2, sit->n3, sit->s, sit->area, outvec);
-        SurfacePoint sp(sit->s, outvec, sit->area, sit->n1, sit->n2, sit->n3);
-        surface_points.push_back(sp);
-      } else {
-        if (pit->ishape == 2) {
-          surface.nlost_saddle++;
+        if (!point_eaten) {
+          Vector3 outvec = (probe.position - sit->s) / rp;
+          // REENTRANT SURFACE POINT
+          //SurfacePoint sp(sit->n1, sit->n2, sit->n3, sit->s, sit->area, outvec);
+          SurfacePoint sp(sit->s, outvec, sit->area, sit->n1, sit->n2, sit->n3);
+          kept[b].push_back(sp);
         } else {
-          surface.nlost_concave++;
+          if (probe.ishape == 2) {
+            lost[b].nlost_saddle++;
+          } else {
+            lost[b].nlost_concave++;
+          }
         }
       }
     }
+  });
+
+  for (unsigned b = 0; b < blocks; ++b) {
+    for (unsigned j = 0; j < kept[b].size(); ++j) {
+      surface.npoints++;
+      surface.area += kept[b][j].surfaceArea();
+      surface_points.push_back(kept[b][j]);
+    }
+    surface.nlost_saddle += lost[b].nlost_saddle;
+    surface.nlost_concave += lost[b].nlost_concave;
   }
 }
 
 SurfaceInfo generate_reentrant_surface(Surface &surface_points,
                                        const std::vector<YonProbe> &yon_probes,
                                        std::vector<ProbePoint> &beforept,
-                                       float rp, float radmax) {
+                                       float rp, float radmax,
+                                       unsigned int threadsNum) {
   SurfaceInfo surface;
   std::vector<int> victims;
-  get_victim_probes(yon_probes, beforept, rp, radmax, victims);
+  get_victim_probes(yon_probes, beforept, rp, radmax, victims, threadsNum);
   std::cerr << yon_probes.size() << " yon and " << victims.size()
             << " victim probes" << std::endl;
-  check_eaten_points(surface_points, yon_probes, beforept, rp, victims,
-                     surface);
+  check_eaten_points(surface_points, yon_probes, beforept, rp, radmax, victims,
+                     surface, threadsNum);
   return surface;
 }
 
 void msdots(Surface &surface_points, float d, float rp,
             const std::vector<float> &rtype, const std::vector<Vector3> &CO,
-            const std::vector<int> &IAT) {
+            const std::vector<int> &IAT, unsigned int threadsNum) {
   if(rp <= 0) {
     std::cerr << "Negative probe radius: " << rp << std::endl; return;
   }
@@ -1135,10 +1303,10 @@ void msdots(Surface &surface_points, float d, float rp,
   std::vector<ProbePoint> beforept;
   SurfaceInfo contact_surface =
       generate_contact_surface(surface_points, CO, radmax, rp, d, yon_probes,
-                               IAT, rtype, attyp_info, beforept);
+                               IAT, rtype, attyp_info, beforept, threadsNum);
 
   SurfaceInfo reentrant_surface = generate_reentrant_surface(
-      surface_points, yon_probes, beforept, rp, radmax);
+      surface_points, yon_probes, beforept, rp, radmax, threadsNum);
 
 
   std::cerr << reentrant_surface.nlost_saddle
@@ -1157,7 +1325,8 @@ void msdots(Surface &surface_points, float d, float rp,
 
 }  // namespace
 
-Surface get_connolly_surface(const ChemMolecule& molecule, float d, float rp) {
+Surface get_connolly_surface(const ChemMolecule& molecule, float d, float rp,
+                             unsigned int threadsNum) {
   typedef boost::unordered_map<float, int> M;
   M radii2type;
 
@@ -1184,6 +1353,6 @@ Surface get_connolly_surface(const ChemMolecule& molecule, float d, float rp) {
 
   /* --------- RUN CONNOLLY'S MOLECULAR SURFACE PROGRAM -------- */
   Surface surface_points;
-  msdots(surface_points, d, rp, rvdw, CO, IAT);
+  msdots(surface_points, d, rp, rvdw, CO, IAT, threadsNum);
   return surface_points;
 }
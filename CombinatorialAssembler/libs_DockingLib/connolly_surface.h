@@ -13,9 +13,13 @@
 
     M.L. Connolly, "Analytical molecular surface calculation",
     J. Appl. Cryst. 16, p548-558 (1983).
+
+    The atoms are handled on threadsNum threads (0 - all cores), the surface
+    points are the same, in the same order, for any number of threads.
  */
 Surface get_connolly_surface(const ChemMolecule& molecule,
-                             float density, float probe_radius);
+                             float density, float probe_radius,
+                             unsigned int threadsNum = 1);
 
 
 #endif
@@ -20,6 +20,19 @@ ResidueGrid::ResidueGrid(const Surface &surface, const float inDelta, const floa
   residues.insert(residues.end(), maxEntry, (int)0);
 }
 
+ResidueGrid::ResidueGrid(const char*& buffer, const char* const end):
+  MoleculeGrid(buffer, end)
+{
+  residues.resize(maxEntry);
+  readBinary(buffer, end, residues.data(), maxEntry * sizeof(int));
+}
+
+void ResidueGrid::writeBinary(std::ostream& out) const
+{
+  MoleculeGrid::writeBinary(out);
+  out.write((const char*)residues.data(), maxEntry * sizeof(int));
+}
+
 int ResidueGrid::getResidueEntry(const Vector3& point) const {
   int index = getIndexForPoint(point);
   if(!isValidIndex(index))
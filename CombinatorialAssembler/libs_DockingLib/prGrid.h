@@ -10,8 +10,10 @@ class ProbGrid : public MoleculeGrid {
  public:
   ProbGrid(const Surface &surface, const float inDelta, const float maxRadius);
 
+  //// the inside voxels get the probability of the closest atom,
+  // computed on threadsNum threads (0 - all cores)
   template<class MoleculeT>
-  void markProbs(const MoleculeT &M);
+  void markProbs(const MoleculeT &M, unsigned int threadsNum = 1);
 
   float getProb(const Vector3 &point) const;
  private:
@@ -34,8 +36,16 @@ class ResidueGrid : public MoleculeGrid {
  public:
   ResidueGrid(const Surface &surface, const float inDelta, const float maxRadius);
 
+  //// Constructs the grid from the binary representation written by writeBinary()
+  ResidueGrid(const char*& buffer, const char* const end);
+
+  //// Writes the distances and the residues grids in a raw binary format
+  void writeBinary(std::ostream& out) const;
+
+  //// the inside voxels get the residue of the closest atom,
+  // computed on threadsNum threads (0 - all cores)
   template<class MoleculeT>
-  void markResidues(const MoleculeT &M);
+  void markResidues(const MoleculeT &M, unsigned int threadsNum = 1);
   int getResidueEntry(const Vector3 &point) const;
   void printGrid(std::ofstream& file) const;
  protected:
@@ -59,8 +69,9 @@ class AtomGrid : public MoleculeGrid {
  public:
   AtomGrid(const Surface &surface, const float inDelta, const float maxRadius):
     MoleculeGrid(surface, inDelta, maxRadius), atoms_(maxEntry) {}
+  //// computed on threadsNum threads (0 - all cores)
   template<class MoleculeT>
-  void markAtoms(const MoleculeT &mol, std::vector<float>& radii);
+  void markAtoms(const MoleculeT &mol, std::vector<float>& radii, unsigned int threadsNum = 1);
 
   // get volume corresponding to each atom
   template<class MoleculeT>
@@ -76,8 +87,10 @@ class AtomTypeGrid : public MoleculeGrid {
  public:
   AtomTypeGrid(const Surface &surface, const float inDelta, const float maxRadius);
 
+  //// every voxel gets the chemical type of the closest atom,
+  // computed on threadsNum threads (0 - all cores)
   template<class MoleculeT>
-  void markAtomTypes(const MoleculeT &M);
+  void markAtomTypes(const MoleculeT &M, unsigned int threadsNum = 1);
   unsigned int getAtomType(const Vector3 &point) const {
      int index = getIndexForPoint(point);
      if(!isValidIndex(index))
@@ -144,9 +157,10 @@ class SurfacePointGrid : public MoleculeGrid {
 };
 
 template<class MoleculeT>
-void ProbGrid::markProbs(const MoleculeT &M) {
-  std::vector<float> weights;
-  weights.insert(weights.end(), maxEntry, 0.0);
+void ProbGrid::markProbs(const MoleculeT &M, unsigned int threadsNum) {
+  std::vector<Vector3> centers;
+  std::vector<float> weightRadii, values;
+  std::vector<int> intRadii;
   for(typename MoleculeT::const_iterator it=M.begin(); it!=M.end(); it++) {
     float atomRadius = it->getAtomRadius();
     float radius = atomRadius*2; //may be +1 is enough
@@ -156,41 +170,20 @@ void ProbGrid::markProbs(const MoleculeT &M) {
       std::cerr << "Error: Point out of grid" << std::endl;
       exit(1);
     }
-
-    int intRadius = getIntGridRadius(radius);
-    int radius2 = intRadius*intRadius;
-
-    int i_bound,j_bound,k_bound;
-    i_bound = intRadius;
-    for (int i = -i_bound; i <= i_bound; i++ ) {
-      j_bound = (int)sqrt(radius2 - i*i);
-      for (int j = -j_bound; j <= j_bound; j++) {
-	k_bound = (int)sqrt(radius2 - i*i - j*j);
-	for (int k = -k_bound; k <= k_bound; k++) {
-	  int index = centerIndex + i + xGridNum * j + xyGridNum * k;
-	  if(isValidIndex(index) && grid[index] <= 0) {
-	    Vector3 point = getPointForIndex(index);
-	    float dist = point.dist(it->position());
-	    if(dist == 0.0) {
-	      probs[index]=it->getSteadyProb();
-	      continue; }
-	    float weight = atomRadius/dist;
-	    if(weight <= weights[index])
-	      continue;
-	    weights[index]=weight;
-	    probs[index]=it->getSteadyProb();
-	  }
-	}
-      }
-    }
+    centers.push_back(it->position());
+    weightRadii.push_back(atomRadius);
+    intRadii.push_back(getIntGridRadius(radius));
+    values.push_back(it->getSteadyProb());
   }
-  weights.clear();
+  assignClosestAtoms(centers, weightRadii, intRadii, true, threadsNum,
+                     [&](int index, int atom) { probs[index] = values[atom]; });
 }
 
 template<class MoleculeT>
-void ResidueGrid::markResidues(const MoleculeT &M) {
-  std::vector<float> weights;
-  weights.insert(weights.end(), maxEntry, 0.0);
+void ResidueGrid::markResidues(const MoleculeT &M, unsigned int threadsNum) {
+  std::vector<Vector3> centers;
+  std::vector<float> weightRadii;
+  std::vector<int> intRadii, values;
   for(typename MoleculeT::const_iterator it=M.begin(); it!=M.end(); it++) {
     float atomRadius = it->getRadius();
     float radius = atomRadius*2; //may be +1 is enough
@@ -200,42 +193,16 @@ void ResidueGrid::markResidues(const MoleculeT &M) {
       std::cerr << "Error: Point out of grid" << std::endl;
       exit(1);
     }
-
-    int intRadius = getIntGridRadius(radius);
-    int radius2 = intRadius*intRadius;
-
-    int i_bound,j_bound,k_bound;
-    i_bound = intRadius;
-    for (int i = -i_bound; i <= i_bound; i++ ) {
-      j_bound = (int)sqrt(radius2 - i*i);
-      for (int j = -j_bound; j <= j_bound; j++) {
-	k_bound = (int)sqrt(radius2 - i*i - j*j);
-	for (int k = -k_bound; k <= k_bound; k++) {
-	  int index = centerIndex + i + xGridNum * j + xyGridNum * k;
-	  if(isValidIndex(index) && grid[index] <= 0) {
-	    Vector3 point = getPointForIndex(index);
-	    float dist = point.dist(it->position());
-	    if(dist == 0.0) {
-	      if(it->isBackbone())
-		residues[index] = M.residueEntry(it->chainId(), it->residueSequenceID()) * -1;
-	      else
-		residues[index] = M.residueEntry(it->chainId(), it->residueSequenceID());
-	      continue;
-	    }
-	    float weight = atomRadius/dist;
-	    if(weight <= weights[index])
-	      continue;
-	    weights[index] = weight;
-	    if(it->isBackbone())
-	      residues[index] = M.residueEntry(it->chainId(), it->residueSequenceID()) * -1;
-	    else
-	      residues[index] = M.residueEntry(it->chainId(), it->residueSequenceID());
-	  }
-	}
-      }
-    }
+    centers.push_back(it->position());
+    weightRadii.push_back(atomRadius);
+    intRadii.push_back(getIntGridRadius(radius));
+    if(it->isBackbone())
+      values.push_back(M.residueEntry(it->chainId(), it->residueSequenceID()) * -1);
+    else
+      values.push_back(M.residueEntry(it->chainId(), it->residueSequenceID()));
   }
-  weights.clear();
+  assignClosestAtoms(centers, weightRadii, intRadii, true, threadsNum,
+                     [&](int index, int atom) { residues[index] = values[atom]; });
 }
 
 template<class MoleculeT>
@@ -269,9 +236,10 @@ void AtomsGrid::markAtoms(const MoleculeT &M, float radius) {
 }
 
 template<class MoleculeT>
-void AtomGrid::markAtoms(const MoleculeT &mol, std::vector<float>& radii) {
-  std::vector<float> weights;
-  weights.insert(weights.end(), maxEntry, 0.0);
+void AtomGrid::markAtoms(const MoleculeT &mol, std::vector<float>& radii, unsigned int threadsNum) {
+  std::vector<Vector3> centers;
+  std::vector<float> weightRadii;
+  std::vector<int> intRadii;
   int atomIndex=0;
   for(typename MoleculeT::const_iterator it=mol.begin(); it!=mol.end(); it++, atomIndex++) {
     int centerIndex = getIndexForPoint(it->position());
@@ -281,34 +249,12 @@ void AtomGrid::markAtoms(const MoleculeT &mol, std::vector<float>& radii) {
     }
     float atomRadius = radii[atomIndex];
     float radius = atomRadius*2; //may be +1 is enough
-    int intRadius = getIntGridRadius(radius);
-    int radius2 = intRadius*intRadius;
-
-    int i_bound,j_bound,k_bound;
-    i_bound = intRadius;
-    for (int i = -i_bound; i <= i_bound; i++ ) {
-      j_bound = (int)sqrt(radius2 - i*i);
-      for (int j = -j_bound; j <= j_bound; j++) {
-	k_bound = (int)sqrt(radius2 - i*i - j*j);
-	for (int k = -k_bound; k <= k_bound; k++) {
-	  int index = centerIndex + i + xGridNum * j + xyGridNum * k;
-	  if(isValidIndex(index)) {
-	    Vector3 point = getPointForIndex(index);
-	    float dist = point.dist(it->position());
-	    if(dist == 0.0) {
-	      atoms_[index] = atomIndex;
-	      continue;
-	    }
-	    float weight = radius/dist;
-	    if(weight <= weights[index]) continue;
-	    weights[index] = weight;
-	    atoms_[index] = atomIndex;
-	  }
-	}
-      }
-    }
+    centers.push_back(it->position());
+    weightRadii.push_back(radius);
+    intRadii.push_back(getIntGridRadius(radius));
   }
-  weights.clear();
+  assignClosestAtoms(centers, weightRadii, intRadii, false, threadsNum,
+                     [&](int index, int atom) { atoms_[index] = atom; });
 }
 
 template<class MoleculeT>
@@ -329,11 +275,12 @@ void AtomGrid::getVolume(const MoleculeT &mol, std::vector<float>& volume) {
 }
 
 template<class MoleculeT>
-void AtomTypeGrid::markAtomTypes(const MoleculeT &M) {
-  std::vector<float> weights;
-  weights.insert(weights.end(), maxEntry, 0.0);
-  int atomIndex=0;
-  for(typename MoleculeT::const_iterator it=M.begin(); it!=M.end(); it++, atomIndex++) {
+void AtomTypeGrid::markAtomTypes(const MoleculeT &M, unsigned int threadsNum) {
+  std::vector<Vector3> centers;
+  std::vector<float> weightRadii;
+  std::vector<int> intRadii;
+  std::vector<unsigned int> values;
+  for(typename MoleculeT::const_iterator it=M.begin(); it!=M.end(); it++) {
     float atomRadius = it->getRadius();
     float radius = atomRadius*2; //may be +1 is enough
     int centerIndex = getIndexForPoint(it->position());
@@ -341,36 +288,13 @@ void AtomTypeGrid::markAtomTypes(const MoleculeT &M) {
       std::cerr << "Error: Point out of grid" << std::endl;
       exit(1);
     }
-
-    int intRadius = getIntGridRadius(radius);
-    int radius2 = intRadius*intRadius;
-
-    int i_bound,j_bound,k_bound;
-    i_bound = intRadius;
-    for (int i = -i_bound; i <= i_bound; i++ ) {
-      j_bound = (int)sqrt(radius2 - i*i);
-      for (int j = -j_bound; j <= j_bound; j++) {
-	k_bound = (int)sqrt(radius2 - i*i - j*j);
-	for (int k = -k_bound; k <= k_bound; k++) {
-	  int index = centerIndex + i + xGridNum * j + xyGridNum * k;
-	  if(isValidIndex(index)) {
-	    Vector3 point = getPointForIndex(index);
-	    float dist = point.dist(it->position());
-	    if(dist == 0.0) {
-	      atomTypes[index] = it->getChemType();
-	      continue;
-	    }
-	    float weight = atomRadius/dist;
-	    if(weight <= weights[index])
-	      continue;
-	    weights[index] = weight;
-	    atomTypes[index] = it->getChemType();
-	  }
-	}
-      }
-    }
+    centers.push_back(it->position());
+    weightRadii.push_back(atomRadius);
+    intRadii.push_back(getIntGridRadius(radius));
+    values.push_back(it->getChemType());
   }
-  weights.clear();
+  assignClosestAtoms(centers, weightRadii, intRadii, false, threadsNum,
+                     [&](int index, int atom) { atomTypes[index] = values[atom]; });
 }
 
 #endif
@@ -2,8 +2,10 @@
 #include "PDB.h"
 #include "CIF.h"
 
+#include <stdexcept>
 #include <string>
 #include <string.h>
+#include <ctype.h>
 #include <math.h>
 #include "macros.h"
 
@@ -83,6 +85,73 @@ Atom::Atom(const std::string& line, bool cif) {
   else initPDB(line);
 }
 
+namespace {
+template <class T> void writeBinaryValue(std::ostream& s, const T& value) {
+  s.write((const char*)&value, sizeof(T));
+}
+
+template <class T> T readBinaryValue(const char*& buffer, const char* const end) {
+  T value;
+  if(buffer + sizeof(T) > end)
+    throw std::runtime_error("truncated atom");
+  memcpy(&value, buffer, sizeof(T));
+  buffer += sizeof(T);
+  return value;
+}
+
+void writeBinaryString(std::ostream& s, const std::string& str) {
+  writeBinaryValue<unsigned int>(s, str.size());
+  s.write(str.data(), str.size());
+}
+
+std::string readBinaryString(const char*& buffer, const char* const end) {
+  unsigned int length = readBinaryValue<unsigned int>(buffer, end);
+  if(buffer + length > end)
+    throw std::runtime_error("truncated atom");
+  std::string str(buffer, length);
+  buffer += length;
+  return str;
+}
+}
+
+Atom::Atom(const char*& buffer, const char* const end) {
+  for(int i = 0; i < 3; i++)
+    (*this)[i] = readBinaryValue<real>(buffer, end);
+  atomEntryType = readBinaryValue<AtomEntryType>(buffer, end);
+  chId = readBinaryValue<char>(buffer, end);
+  altLoc = readBinaryValue<char>(buffer, end);
+  atomId = readBinaryValue<unsigned int>(buffer, end);
+  residueId = readBinaryValue<int>(buffer, end);
+  residueSeqICode = readBinaryValue<char>(buffer, end);
+  resType = readBinaryValue<char>(buffer, end);
+  occupancy = readBinaryValue<float>(buffer, end);
+  tempFactor = readBinaryValue<float>(buffer, end);
+  sseInfo.first = readBinaryValue<char>(buffer, end);
+  sseInfo.second = readBinaryValue<short>(buffer, end);
+  atomName = readBinaryString(buffer, end);
+  resName = readBinaryString(buffer, end);
+  elementSymbol = readBinaryString(buffer, end);
+}
+
+void Atom::writeBinary(std::ostream& s) const {
+  for(int i = 0; i < 3; i++)
+    writeBinaryValue<real>(s, (*this)[i]);
+  writeBinaryValue<AtomEntryType>(s, atomEntryType);
+  writeBinaryValue<char>(s, chId);
+  writeBinaryValue<char>(s, altLoc);
+  writeBinaryValue<unsigned int>(s, atomId);
+  writeBinaryValue<int>(s, residueId);
+  writeBinaryValue<char>(s, residueSeqICode);
+  writeBinaryValue<char>(s, resType);
+  writeBinaryValue<float>(s, occupancy);
+  writeBinaryValue<float>(s, tempFactor);
+  writeBinaryValue<char>(s, sseInfo.first);
+  writeBinaryValue<short>(s, sseInfo.second);
+  writeBinaryString(s, atomName);
+  writeBinaryString(s, resName);
+  writeBinaryString(s, elementSymbol);
+}
+
 void Atom::initPDB(const std::string& PDBrec) {
   (*this)[0] = PDB::atomXCoord(PDBrec);
   (*this)[1] = PDB::atomYCoord(PDBrec);
@@ -99,6 +168,7 @@ void Atom::initPDB(const std::string& PDBrec) {
   sseInfo = std::pair<char,short>(0,0);
   atomName = PDB::atomType(PDBrec);
   resName = PDB::getAtomResidueLongName(PDBrec);
+  elementSymbol = PDB::getElement(PDBrec);
 }
 
 void Atom::initCIF(const std::string& CIFrec) {
@@ -117,6 +187,7 @@ void Atom::initCIF(const std::string& CIFrec) {
   atomName = parseAtomName(CIF::atomType(CIFrec).c_str());
   resName = CIF::getAtomResidueLongName(CIFrec);
   resType = PDB::residueShortName(resName);
+  elementSymbol = CIF::getElement(CIFrec);
 }
 
 char Atom::chainId() const {
@@ -181,6 +252,22 @@ float Atom::getTempFactor() const {
   return tempFactor;
 }
 
+std::string Atom::element() const {
+  if (!elementSymbol.empty())
+    return elementSymbol;
+  // PDB atom names put the element in positions 1-2, right justified, so a
+  // one letter element starts at position 2. Names that start at position 1
+  // are two letter elements, except for the atoms of protein and nucleic
+  // acid residues, that only have one letter elements.
+  std::string element;
+  for (unsigned int i = 0; i < 2 && i < atomName.length(); i++)
+    if (isalpha(atomName[i]))
+      element += atomName[i];
+  if (element.length() == 2 && atomEntryType == ATOM)
+    element = element.substr(0, 1);
+  return element;
+}
+
 void Atom::setTempFactor(float ftemp) {
   tempFactor=ftemp;
 }
@@ -561,7 +648,8 @@ void Atom::output2cif(std::ostream& s, int modelNum) const
     s << "HETATM ";
 
   s << atomId; //_atom_site.id
-  s << " ? "; // we don't save the element (_atom_site.type_symbol)
+  std::string elem = element();
+  s << " " << (elem.empty() ? "?" : elem) << " "; //_atom_site.type_symbol
   s << atomName; // _atom_site.label_atom_id
   s << " . "; // _atom_site.label_alt_id
   s << resName;//_atom_site.label_comp_id
@@ -116,6 +116,10 @@ public:
   //// A constructor that intiate an atom type from a line of a PDB or CIF record
   explicit Atom(const std::string& line, bool cif = false);
 
+  //// Reads an atom that writeBinary wrote from buffer and advances buffer
+  // past it. Throws std::runtime_error if the atom doesn't end before end
+  Atom(const char*& buffer, const char* const end);
+
   static const unsigned short resNameLen;
   static const unsigned short atomNameLen;
   static const float defaultOccupancy;
@@ -170,6 +174,10 @@ public:
   //// Sets new temperature factor
   void setTempFactor(float ftemp);
 
+  //// Returns the element symbol as read from the PDB or CIF record. If the
+  // record has none, it is guessed from the atom name.
+  std::string element() const;
+
   //// Returns true if the atom is backbone atom: N, Ca, C, O
   bool isBackbone() const;
 
@@ -347,6 +355,9 @@ public:
   //// Writing back the PBD line - without the endline
   friend std::ostream& operator<<(std::ostream& s, const Atom& at);
 
+  //// Writes all the members in a binary form, see Atom(buffer, end)
+  void writeBinary(std::ostream& s) const;
+
   ////
   void output2cif(std::ostream& s, int modelNum=1) const;
 
@@ -376,6 +387,7 @@ protected:
   float tempFactor;            // The temperature factor or B-factor can be thought of as a
                               // measure of how much an atom oscillates or vibrates around
                               // the position specified in the model
+  std::string elementSymbol;  // element symbol of the record, empty if it has none
   std::pair<char,short> sseInfo;     // secondary structure information: char sse_type - according to SecondStruct class,
                               // int sse_id - index of SSE in molecule
 
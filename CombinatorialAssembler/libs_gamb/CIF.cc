@@ -7,7 +7,7 @@
 #include <boost/algorithm/string.hpp>
 
 
-std::map<std::string, unsigned int> CIF::atomSiteTable_;
+thread_local std::map<std::string, unsigned int> CIF::atomSiteTable_;
 
 bool CIF::readAtomSiteTable(std::istream& ifile)
 {
@@ -179,3 +179,10 @@ float CIF::getTempFactor(const std::string& CIFline)
 {
   return std::stof(getColumn(CIFline,"B_iso_or_equiv"));
 }
+
+std::string CIF::getElement(const std::string& CIFline)
+{
+  std::string element = getColumn(CIFline,"type_symbol");
+  if(element == "?" || element == ".") return std::string();
+  return element;
+}
@@ -93,6 +93,9 @@ public:
   // oscillates or vibrates around the specified position
   static float getTempFactor(const std::string& CIFline);
 
+  //// Returns the element symbol (type_symbol), an empty string if the record has none
+  static std::string getElement(const std::string& CIFline);
+
   static std::string getColumn(const std::string& CIFline, const std::string& key);
 
   /* TODO:
@@ -155,7 +158,8 @@ private:
   CIF() {}
 
   // A CIF dictionary for ATOM records: key = field_name, value = column number
-  static std::map<std::string, unsigned int> atomSiteTable_;
+  // thread local, so molecules can be read concurrently on different threads
+  static thread_local std::map<std::string, unsigned int> atomSiteTable_;
 
 };
 
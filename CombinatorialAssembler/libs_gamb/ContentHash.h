@@ -0,0 +1,60 @@
+#ifndef _CONTENT_HASH_H
+#define _CONTENT_HASH_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+/*
+CLASS
+  ContentHash
+
+  64 bit FNV-1a hash of a byte stream. It is used to identify file contents
+  and derived data (for example for cache keys), it is not a cryptographic
+  hash.
+
+USAGE
+  EXAMPLE
+  ContentHash hash;
+  hash.update(fileContents.data(), fileContents.size());
+  hash.update(gridResolution);
+  uint64_t key = hash.value();
+  END
+*/
+class ContentHash {
+public:
+  ContentHash() : hash_(14695981039346656037ULL) {}
+
+  //// adds size bytes to the hash
+  void update(const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+      hash_ ^= bytes[i];
+      hash_ *= 1099511628211ULL;
+    }
+  }
+
+  //// adds the binary representation of a plain value to the hash
+  template<class T>
+  void update(const T& value) { update(&value, sizeof(T)); }
+
+  void update(const std::string& str) { update(str.data(), str.size()); }
+
+  //// adds the contents of a file to the hash, returns false if the file can't be read
+  bool updateFile(const std::string& fileName) {
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file)
+      return false;
+    char buffer[1 << 16];
+    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+      update(buffer, file.gcount());
+    return true;
+  }
+
+  uint64_t value() const { return hash_; }
+
+private:
+  uint64_t hash_;
+};
+
+#endif
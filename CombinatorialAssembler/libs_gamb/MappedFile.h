@@ -0,0 +1,67 @@
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+CLASS
+  MappedFile
+
+  Read-only memory mapping of a whole file. The mapping is released when
+  the object is destroyed. An empty file is open with begin() == end().
+
+USAGE
+  EXAMPLE
+  MappedFile file(fileName);
+  if (!file.isOpen())
+    return false;
+  parse(file.begin(), file.end());
+  END
+*/
+class MappedFile {
+public:
+  MappedFile(const std::string& fileName) : data_(NULL), size_(0), open_(false) {
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+      size_ = st.st_size;
+      if (size_ == 0) {
+        open_ = true;
+      } else {
+        void* data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+          data_ = (const char*)data;
+          open_ = true;
+        }
+      }
+    }
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (data_ != NULL)
+      munmap((void*)data_, size_);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool isOpen() const { return open_; }
+  const char* begin() const { return data_; }
+  const char* end() const { return data_ + size_; }
+  size_t size() const { return size_; }
+
+private:
+  const char* data_;
+  size_t size_;
+  bool open_;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include "MoleculeGrid.h"
 #include "Atom.h"
+#include "Parallel.h"
 
 #define MAXIMIZE(a,b) if (a < b) a = b;
 #define MINIMIZE(a,b) if (a > b) a = b;
@@ -32,7 +33,53 @@ MoleculeGrid::MoleculeGrid(const Surface& surface,
   //cerr << " maxEntry " << maxEntry << endl;
 
   grid.insert(grid.end(), maxEntry, (float)MAX_FLOAT) ;
-  int nc = 0;
+  computeNeighbors();
+}
+
+MoleculeGrid::MoleculeGrid(const char*& buffer, const char* const end)
+{
+  readBinary(buffer, end, &delta, sizeof(delta));
+  readBinary(buffer, end, &maxGridRadius, sizeof(maxGridRadius));
+  readBinary(buffer, end, &maxEntry, sizeof(maxEntry));
+  readBinary(buffer, end, &xGridNum, sizeof(xGridNum));
+  readBinary(buffer, end, &yGridNum, sizeof(yGridNum));
+  readBinary(buffer, end, &zGridNum, sizeof(zGridNum));
+  readBinary(buffer, end, &xMin, sizeof(xMin));
+  readBinary(buffer, end, &yMin, sizeof(yMin));
+  readBinary(buffer, end, &zMin, sizeof(zMin));
+  readBinary(buffer, end, &xMax, sizeof(xMax));
+  readBinary(buffer, end, &yMax, sizeof(yMax));
+  readBinary(buffer, end, &zMax, sizeof(zMax));
+  xyGridNum = xGridNum * yGridNum;
+  if (xGridNum < 1 || yGridNum < 1 || zGridNum < 1 || maxEntry != xyGridNum * zGridNum)
+    throw std::runtime_error("MoleculeGrid: invalid binary grid dimensions");
+
+  grid.resize(maxEntry);
+  readBinary(buffer, end, grid.data(), maxEntry * sizeof(float));
+  computeNeighbors();
+}
+
+void MoleculeGrid::writeBinary(std::ostream& out) const
+{
+  out.write((const char*)&delta, sizeof(delta));
+  out.write((const char*)&maxGridRadius, sizeof(maxGridRadius));
+  out.write((const char*)&maxEntry, sizeof(maxEntry));
+  out.write((const char*)&xGridNum, sizeof(xGridNum));
+  out.write((const char*)&yGridNum, sizeof(yGridNum));
+  out.write((const char*)&zGridNum, sizeof(zGridNum));
+  out.write((const char*)&xMin, sizeof(xMin));
+  out.write((const char*)&yMin, sizeof(yMin));
+  out.write((const char*)&zMin, sizeof(zMin));
+  out.write((const char*)&xMax, sizeof(xMax));
+  out.write((const char*)&yMax, sizeof(yMax));
+  out.write((const char*)&zMax, sizeof(zMax));
+  out.write((const char*)grid.data(), maxEntry * sizeof(float));
+}
+
+void MoleculeGrid::computeNeighbors()
+{
+  neigbor.clear();
+  neigborDist.clear();
   for (int x = -1; x <= 1; x++) {
     for (int y = -1; y <= 1; y++) {
       for (int z = -1; z <= 1; z++) {
@@ -40,7 +87,6 @@ MoleculeGrid::MoleculeGrid(const Surface& surface,
         neigbor.push_back(x + xGridNum*y + xyGridNum*z);
         float d = delta * sqrt((float)(x*x + y*y + z*z));
         neigborDist.push_back(d);
-        nc++;
       }
     }
   }
@@ -137,6 +183,84 @@ void MoleculeGrid::computeDistFromSurface(const Surface &surface, bool precise)
   }
 }
 
+namespace {
+const float EDT_INF = 1e20f;
+
+// One dimensional squared distance transform of the n samples f[0],
+// f[stride], ... (lower envelope of parabolas, Felzenszwalb and
+// Huttenlocher). Samples equal to EDT_INF are empty. v, z and d are
+// scratch buffers of n, n + 1 and n entries.
+void distanceTransform1D(float* f, int n, int stride, int* v, double* z, float* d)
+{
+  int k = -1;
+  for (int q = 0; q < n; q++) {
+    float fq = f[q * stride];
+    if (fq >= EDT_INF) continue;
+    if (k < 0) {
+      k = 0;
+      v[0] = q;
+      z[0] = -EDT_INF;
+      z[1] = EDT_INF;
+      continue;
+    }
+    double s;
+    while (true) {
+      int p = v[k];
+      s = ((fq + (double)q * q) - (f[p * stride] + (double)p * p)) / (2.0 * (q - p));
+      if (s > z[k]) break;
+      k--;
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = EDT_INF;
+  }
+  // no samples in this row
+  if (k < 0) return;
+
+  k = 0;
+  for (int q = 0; q < n; q++) {
+    while (z[k + 1] < q) k++;
+    int p = v[k];
+    d[q] = (float)(q - p) * (q - p) + f[p * stride];
+  }
+  for (int q = 0; q < n; q++)
+    f[q * stride] = d[q];
+}
+}
+
+void MoleculeGrid::computeExactDistFromSurface(const Surface &surface, unsigned int threadsNum)
+{
+  // squared distances in voxels, zero at the voxels of the surface points
+  for (int i = 0; i < maxEntry; i++)
+    grid[i] = EDT_INF;
+  for (Surface::const_iterator it = surface.begin(); it!= surface.end(); ++it) {
+    int index = getIndexForPoint(it->position());
+    if (isValidIndex(index))
+      grid[index] = 0.0;
+  }
+
+  int maxGridNum = std::max(xGridNum, std::max(yGridNum, zGridNum));
+  auto transform = [&](int n, int stride, int rowsNum, int rowStride, int base) {
+    std::vector<int> v(maxGridNum);
+    std::vector<double> z(maxGridNum + 1);
+    std::vector<float> d(maxGridNum);
+    for (int row = 0; row < rowsNum; row++)
+      distanceTransform1D(&grid[base + row * rowStride], n, stride, v.data(), z.data(), d.data());
+  };
+  // along x and then y each z slice is independent, along z each y slice
+  parallelFor(zGridNum, threadsNum, [&](unsigned int z) {
+    transform(xGridNum, 1, yGridNum, xGridNum, z * xyGridNum);
+    transform(yGridNum, xGridNum, xGridNum, 1, z * xyGridNum);
+  });
+  parallelFor(yGridNum, threadsNum, [&](unsigned int y) {
+    transform(zGridNum, xyGridNum, xGridNum, 1, y * xGridNum);
+  });
+
+  float maxDist2 = (float)maxGridRadius * maxGridRadius;
+  for (int i = 0; i < maxEntry; i++)
+    grid[i] = grid[i] > maxDist2 ? (float)MAX_FLOAT : delta * sqrtf(grid[i]);
+}
 
 float MoleculeGrid::calcVolumeFunc(const Vector3 &center, const float radius) const
 {
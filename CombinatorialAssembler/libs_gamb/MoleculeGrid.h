@@ -7,6 +7,10 @@
 #include "Surface.h"
 #include <iostream>
 #include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <map>
+#include "Parallel.h"
 
 /*
 CLASS
@@ -58,6 +62,8 @@ GOALS
     each voxel will have the exact distance to the closest surface point.
     Since the algorithm is iterative, the time complexity is linear to the
     number of voxels.
+    computeExactDistFromSurface gives the exact Euclidean distances to the
+    surface voxels, also in time linear to the number of voxels.
 
   Marking the inside of the molecule:
     The same algorithm of grass-fire is used here.
@@ -116,6 +122,14 @@ class MoleculeGrid
   // density and maxRadius - maximum radius for distance function calculation.
   MoleculeGrid(const Surface &surface, const float inDelta, const float maxRadius);
 
+  //// Constructs the grid from the binary representation written by
+  // writeBinary(). The buffer is advanced past the grid data, a
+  // std::runtime_error is thrown if the buffer ends before the grid does.
+  MoleculeGrid(const char*& buffer, const char* const end);
+
+  //// Writes the grid dimensions and distances in a raw binary format
+  void writeBinary(std::ostream& out) const;
+
   // GROUP: Functions
   //// Returns distance from surface for a given point.
   float getDist(const Vector3& point) const {
@@ -146,6 +160,14 @@ class MoleculeGrid
   // If precise value is true, than the exact dist. function is calculated.
   void computeDistFromSurface(const Surface &surface, bool precise = false);
 
+  //// Computes the exact Euclidean distance function: each voxel gets the
+  // distance from its center to the center of the closest voxel that holds a
+  // surface point. Uses a separable distance transform (Felzenszwalb and
+  // Huttenlocher) along the three axes, the rows of each axis are processed on
+  // threadsNum threads (0 - all cores). Voxels farther than the maxRadius of
+  // the constructor keep MAX_FLOAT, as in computeDistFromSurface.
+  void computeExactDistFromSurface(const Surface &surface, unsigned int threadsNum = 1);
+
   //// Marks the inside of the molecule by changing the sign of
   // the distance function for inner voxels to negative.
   // the molecule M shouls contain the coordinates of the centers of all atoms
@@ -186,10 +208,37 @@ class MoleculeGrid
   //// convert radius to grid valid radius (number of voxels)
   int getIntGridRadius( float radius ) const { return (int) (radius / delta + 0.5) ; }
 
+  //// copies size bytes from buffer to out and advances the buffer
+  static void readBinary(const char*& buffer, const char* const end, void* out, size_t size) {
+    if (buffer + size > end)
+      throw std::runtime_error("MoleculeGrid: binary buffer is too short");
+    memcpy(out, buffer, size);
+    buffer += size;
+  }
+
+  //// Assigns the voxels around atoms to the closest atom, as used for
+  // marking residues, atoms and atom types. Atom a covers the voxels within
+  // intRadii[a] voxels of centers[a] (which must be in the grid) and its
+  // weight at a voxel is weightRadii[a] divided by the distance to the center.
+  // assign(index, a) is called when atom a has a higher weight at voxel index
+  // than the atoms before it, or sits exactly on the voxel. If insideOnly is
+  // set, only voxels with a non-positive distance are assigned.
+  // The grid is split to slabs of z that are handled on threadsNum threads
+  // (0 - all cores), the atoms of each slab are handled in order, so the result
+  // is the same as assigning atom after atom.
+  template<class AssignFunc>
+  void assignClosestAtoms(const std::vector<Vector3>& centers,
+                          const std::vector<float>& weightRadii,
+                          const std::vector<int>& intRadii, bool insideOnly,
+                          unsigned int threadsNum, AssignFunc assign) const;
+
  private:
   // computes xMin,yMin,zMin,xMax,yMax,zMax
   void computeBoundingValues(const Surface &surface);
 
+  // computes the offsets and distances of the 26 neighbors of a voxel
+  void computeNeighbors();
+
   // sets distance func. falue for index to be the distance from p.
   bool setDIST(int index, Vector3 &p) {
     float d = getPointForIndex(index).dist(p);
@@ -264,4 +313,83 @@ bool MoleculeGrid::markTheInside(const MoleculeT &M)
   return true;
 }
 
+template<class AssignFunc>
+void MoleculeGrid::assignClosestAtoms(const std::vector<Vector3>& centers,
+                                      const std::vector<float>& weightRadii,
+                                      const std::vector<int>& intRadii, bool insideOnly,
+                                      unsigned int threadsNum, AssignFunc assign) const
+{
+  // the (i, j, k bound) rows of a sphere of each radius, as in calcVolumeFunc
+  struct SphereRow { int i, j, kBound; };
+  std::map<int, std::vector<SphereRow> > spheres;
+  for (unsigned int a = 0; a < intRadii.size(); a++) {
+    int intRadius = intRadii[a];
+    std::vector<SphereRow>& rows = spheres[intRadius];
+    if (!rows.empty()) continue;
+    int radius2 = intRadius * intRadius;
+    for (int i = -intRadius; i <= intRadius; i++) {
+      int jBound = (int)sqrt(radius2 - i * i);
+      for (int j = -jBound; j <= jBound; j++) {
+        SphereRow row = {i, j, (int)sqrt(radius2 - i * i - j * j)};
+        rows.push_back(row);
+      }
+    }
+  }
+
+  // the atoms that may reach each slab, in order
+  int slabDepth = 4;
+  int slabsNum = (zGridNum + slabDepth - 1) / slabDepth;
+  int slabSize = slabDepth * xyGridNum;
+  std::vector<std::vector<int> > slabAtoms(slabsNum);
+  std::vector<int> centerIndices(centers.size());
+  for (unsigned int a = 0; a < centers.size(); a++) {
+    centerIndices[a] = getIndexForPoint(centers[a]);
+    int reach = intRadii[a] * (1 + xGridNum + xyGridNum);
+    int first = std::max(0, centerIndices[a] - reach) / slabSize;
+    int last = std::min(maxEntry - 1, centerIndices[a] + reach) / slabSize;
+    for (int slab = first; slab <= last; slab++)
+      slabAtoms[slab].push_back(a);
+  }
+
+  parallelFor(slabsNum, threadsNum, [&](unsigned int slab) {
+    int slabBegin = slab * slabSize;
+    int slabEnd = std::min(maxEntry, slabBegin + slabSize);
+    std::vector<float> weights(slabEnd - slabBegin, 0.0);
+    for (unsigned int n = 0; n < slabAtoms[slab].size(); n++) {
+      int a = slabAtoms[slab][n];
+      const std::vector<SphereRow>& rows = spheres.find(intRadii[a])->second;
+      for (unsigned int r = 0; r < rows.size(); r++) {
+        // the k range of the row that falls in the slab
+        int base = centerIndices[a] + rows[r].i + xGridNum * rows[r].j;
+        int kMin = -rows[r].kBound, kMax = rows[r].kBound;
+        int beginOffset = slabBegin - base, endOffset = slabEnd - 1 - base;
+        kMin = std::max(kMin, beginOffset >= 0 ? (beginOffset + xyGridNum - 1) / xyGridNum
+                                               : -(-beginOffset / xyGridNum));
+        kMax = std::min(kMax, endOffset >= 0 ? endOffset / xyGridNum
+                                             : -((-endOffset + xyGridNum - 1) / xyGridNum));
+        if (kMin > kMax) continue;
+        // the x and y of the row are fixed, z grows with k
+        int index = base + xyGridNum * kMin;
+        int x = index % xGridNum;
+        int y = (index / xGridNum) % yGridNum;
+        int z = index / xyGridNum;
+        for (int k = kMin; k <= kMax; k++, z++, index += xyGridNum) {
+          if (insideOnly && grid[index] > 0) continue;
+          Vector3 point(x * delta + xMin, y * delta + yMin, z * delta + zMin);
+          float dist = point.dist(centers[a]);
+          if (dist == 0.0) {
+            assign(index, a);
+            continue;
+          }
+          float weight = weightRadii[a] / dist;
+          if (weight <= weights[index - slabBegin])
+            continue;
+          weights[index - slabBegin] = weight;
+          assign(index, a);
+        }
+      }
+    }
+  });
+}
+
 #endif
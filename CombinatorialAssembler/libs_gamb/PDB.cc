@@ -211,6 +211,15 @@ float PDB::getTempFactor(const std::string& PDBline)
   return 0.0;
 }
 
+std::string PDB::getElement(const std::string& PDBline)
+{
+  std::string element;
+  for (unsigned int i = atomElement; i < atomElement + 2 && i < PDBline.length(); i++)
+    if (PDBline[i] != ' ')
+      element += PDBline[i];
+  return element;
+}
+
 std::vector<unsigned short> PDB::connectedAtoms(const std::string& PDBline)
 {
   std::vector<unsigned short> connAtoms;
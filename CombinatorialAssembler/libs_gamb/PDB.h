@@ -127,6 +127,7 @@ public:
   static const unsigned short atomZCoordField   =  46;
   static const unsigned short atomOccupancy     =  54;
   static const unsigned short atomTempFactor    =  60;
+  static const unsigned short atomElement       =  76;
 
   //// Returns an ATOM record's X coordinate.
   static float atomXCoord(const std::string& pdb_line);
@@ -199,6 +200,10 @@ public:
   // oscillates or vibrates around the specified position
   static float getTempFactor(const std::string& pdb_line);
 
+  //// Returns the element symbol (columns 77-78) without blanks, an empty
+  // string if the record has none
+  static std::string getElement(const std::string& pdb_line);
+
   ////
   // Given a charachter string with a PDB residue type code, the
   // method returns a one-letter abbreviation of the type of the
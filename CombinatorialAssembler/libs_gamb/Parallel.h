@@ -0,0 +1,69 @@
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+  Parallel
+
+  Minimal helpers for running independent work items on a bounded number of
+  std::threads. Work items are handed out in increasing index order, so with a
+  single thread the execution order is the same as a plain for loop.
+
+  USAGE
+  EXAMPLE
+  parallelFor(items.size(), threadsNum, [&](unsigned int i) { process(items[i]); });
+  END
+*/
+
+//// Number of threads to use when the user did not ask for a specific number
+inline unsigned int defaultThreadsNum() {
+  unsigned int n = std::thread::hardware_concurrency();
+  return n == 0 ? 1 : n;
+}
+
+//// Calls func(i) for each i in [0, n) using at most threadsNum threads
+// (0 means defaultThreadsNum()). The first exception thrown by func is
+// rethrown in the calling thread after all workers finished.
+template<class Func>
+void parallelFor(unsigned int n, unsigned int threadsNum, Func func)
+{
+  if (threadsNum == 0)
+    threadsNum = defaultThreadsNum();
+  threadsNum = std::min(threadsNum, n);
+  if (threadsNum <= 1) {
+    for (unsigned int i = 0; i < n; i++)
+      func(i);
+    return;
+  }
+
+  std::atomic<unsigned int> next(0);
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  auto worker = [&]() {
+    for (unsigned int i = next++; i < n; i = next++) {
+      try {
+        func(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!error)
+          error = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < threadsNum; t++)
+    threads.emplace_back(worker);
+  for (std::thread &t : threads)
+    t.join();
+  if (error)
+    std::rethrow_exception(error);
+}
+
+#endif
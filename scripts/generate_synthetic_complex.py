@@ -0,0 +1,346 @@
+import argparse
+import json
+import os
+from typing import List, Tuple
+
+import numpy as np
+import scipy.sparse
+import scipy.sparse.csgraph
+import scipy.spatial
+import scipy.spatial.distance
+
+from libs.utils_classes import SubunitInfo, save_subunits_info, INTERFACE_MIN_ATOM_DIST
+
+# Builds a synthetic rigid-body complex with a known ground truth, as input for the combinatorial assembler, so its
+# scaling with the number of subunits, bestK and transformations can be measured without AlphaFold. Each subunit is a
+# helix bundle written in its own random frame, the subunits are placed on a lattice or a symmetric shell and the
+# pairwise transformation files hold the true transformation of each touching pair (with noise) and decoys.
+
+CHAIN_NAMES = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789"
+
+HELIX_LENGTH = 18  # residues
+HELIX_RADIUS = 2.3
+HELIX_RISE = 1.5
+HELIX_TURN = np.radians(100.0)
+HELICES_SPACING = 10.0
+MIN_ATOM_DIST = 3.0  # between atoms of subunits placed next to each other
+
+
+# Rotation matrix of the euler angles of a transformation, as gamb::Matrix3 (and _rotate_atom of prepare_complex)
+def euler_to_matrix(angles: np.ndarray) -> np.ndarray:
+    x, y, z = angles
+    cx, cy, cz = np.cos(x), np.cos(y), np.cos(z)
+    sx, sy, sz = np.sin(x), np.sin(y), np.sin(z)
+    return np.array([[cz * cy, -sy * sx * cz - sz * cx, -sy * cx * cz + sz * sx],
+                     [sz * cy, -sy * sx * sz + cx * cz, -sy * cx * sz - sx * cz],
+                     [sy, cy * sx, cy * cx]])
+
+
+def matrix_to_euler(rotation: np.ndarray) -> np.ndarray:
+    return np.array([np.arctan2(rotation[2, 1], rotation[2, 2]), np.arcsin(np.clip(rotation[2, 0], -1, 1)),
+                     np.arctan2(rotation[1, 0], rotation[0, 0])])
+
+
+def random_rotation(rng: np.random.Generator) -> np.ndarray:
+    q = rng.normal(size=4)
+    a, b, c, d = q / np.linalg.norm(q)
+    return np.array([[a * a + b * b - c * c - d * d, 2 * (b * c - a * d), 2 * (b * d + a * c)],
+                     [2 * (b * c + a * d), a * a - b * b + c * c - d * d, 2 * (c * d - a * b)],
+                     [2 * (b * d - a * c), 2 * (c * d + a * b), a * a - b * b - c * c + d * d]])
+
+
+def axis_rotation(axis: np.ndarray, angle: float) -> np.ndarray:
+    x, y, z = axis / np.linalg.norm(axis)
+    k = np.array([[0, -z, y], [z, 0, -x], [-y, x, 0]])
+    return np.eye(3) + np.sin(angle) * k + (1 - np.cos(angle)) * k @ k
+
+
+# A transformation is (rotation matrix, translation), applied as rotation @ coord + translation
+Transformation = Tuple[np.ndarray, np.ndarray]
+
+
+def compose(t1: Transformation, t2: Transformation) -> Transformation:
+    return t1[0] @ t2[0], t1[0] @ t2[1] + t1[1]
+
+
+def inverse(t: Transformation) -> Transformation:
+    return t[0].T, -t[0].T @ t[1]
+
+
+def apply(t: Transformation, coords: np.ndarray) -> np.ndarray:
+    return coords @ t[0].T + t[1]
+
+
+def transformation_numbers(t: Transformation) -> List[float]:
+    return list(matrix_to_euler(t[0])) + list(t[1])
+
+
+def build_subunit(residues_num: int, rng: np.random.Generator) -> np.ndarray:
+    """Returns the N, CA, C, O, CB coordinates (residues_num x 5 x 3) of an antiparallel helix bundle centered on the
+    origin, in a random orientation"""
+    helices_num = (residues_num + HELIX_LENGTH - 1) // HELIX_LENGTH
+    # helix axes on a hexagonal grid, the closest ones to the center first
+    axes = []
+    for ring in range(helices_num):
+        for i in range(-ring, ring + 1):
+            for j in range(-ring, ring + 1):
+                if max(abs(i), abs(j), abs(i + j)) == ring:
+                    axes.append(HELICES_SPACING * np.array([i + j / 2, j * np.sqrt(3) / 2]))
+        if len(axes) >= helices_num:
+            break
+    axes = sorted(axes, key=lambda a: (np.linalg.norm(a), np.arctan2(a[1], a[0])))[:helices_num]
+
+    ca, radial = [], []
+    for r in range(residues_num):
+        helix, k = divmod(r, HELIX_LENGTH)
+        direction = 1 if helix % 2 == 0 else -1
+        angle = k * HELIX_TURN
+        out = np.array([np.cos(angle), np.sin(angle), 0.0])
+        z = direction * (k - HELIX_LENGTH / 2) * HELIX_RISE
+        ca.append(np.array([axes[helix][0], axes[helix][1], z]) + HELIX_RADIUS * out)
+        radial.append(out)
+    ca = np.array(ca)
+
+    atoms = np.zeros((residues_num, 5, 3))
+    for r in range(residues_num):
+        prev_ca = ca[r - 1] if r > 0 else 2 * ca[r] - ca[r + 1]
+        next_ca = ca[r + 1] if r + 1 < residues_num else 2 * ca[r] - ca[r - 1]
+        to_prev, to_next = prev_ca - ca[r], next_ca - ca[r]
+        side = np.cross(to_next, radial[r])
+        atoms[r, 0] = ca[r] + 1.45 * to_prev / np.linalg.norm(to_prev)
+        atoms[r, 1] = ca[r]
+        atoms[r, 2] = ca[r] + 1.52 * to_next / np.linalg.norm(to_next)
+        atoms[r, 3] = atoms[r, 2] + 1.23 * side / np.linalg.norm(side)
+        atoms[r, 4] = ca[r] + 1.53 * radial[r]
+
+    atoms -= ca.mean(axis=0)
+    return apply((random_rotation(rng), np.zeros(3)), atoms.reshape(-1, 3)).reshape(atoms.shape)
+
+
+def write_pdb(atoms: np.ndarray, chain_name: str, output_path: str):
+    names = ["N", "CA", "C", "O", "CB"]
+    elements = ["N", "C", "C", "O", "C"]
+    with open(output_path, "w") as f:
+        serial = 1
+        for r in range(len(atoms)):
+            for a in range(5):
+                x, y, z = atoms[r, a]
+                f.write(f"ATOM  {serial:5d}  {names[a]:<3s} ALA {chain_name}{r + 1:4d}    {x:8.3f}{y:8.3f}{z:8.3f}"
+                        f"  1.00 80.00           {elements[a]}  \n")
+                serial += 1
+        f.write("TER\nEND\n")
+
+
+def layout_positions(layout: str, subunits_num: int) -> np.ndarray:
+    """Returns the centers of the subunits for a spacing of 1"""
+    if layout == "lattice":
+        side = int(np.ceil(subunits_num ** (1 / 3)))
+        points = [np.array([i, j, k], dtype=float) for i in range(side) for j in range(side) for k in range(side)]
+        # the points closest to the center of the cube, so the complex is compact
+        center = np.full(3, (side - 1) / 2)
+        points = sorted(points, key=lambda p: (np.linalg.norm(p - center), tuple(p)))[:subunits_num]
+        return np.array(points) - np.mean(points, axis=0)
+
+    # a Fibonacci sphere, scaled so its nearest neighbors are 1 apart
+    indices = np.arange(subunits_num) + 0.5
+    phi = np.arccos(1 - 2 * indices / subunits_num)
+    theta = np.pi * (1 + 5 ** 0.5) * indices
+    points = np.stack([np.cos(theta) * np.sin(phi), np.sin(theta) * np.sin(phi), np.cos(phi)], axis=1)
+    if subunits_num > 1:
+        distances = scipy.spatial.distance.cdist(points, points)
+        np.fill_diagonal(distances, np.inf)
+        points /= distances.min(axis=1).mean()
+    return points
+
+
+def place_subunits(subunits: List[np.ndarray], layout: str, rng: np.random.Generator) -> List[Transformation]:
+    """Returns the ground truth placement of each subunit, on the layout packed so that neighbors touch"""
+    positions = layout_positions(layout, len(subunits))
+    rotations = []
+    for position in positions:
+        if layout == "shell" and np.linalg.norm(position) > 0:
+            # every copy faces the center the same way, turned around its radial axis
+            radial = position / np.linalg.norm(position)
+            axis = np.cross([0.0, 0.0, 1.0], radial)
+            angle = np.arccos(np.clip(radial[2], -1, 1))
+            base = axis_rotation(axis, angle) if np.linalg.norm(axis) > 1e-6 else np.eye(3) * np.sign(radial[2])
+            rotations.append(axis_rotation(radial, rng.uniform(0, 2 * np.pi)) @ base)
+        else:
+            rotations.append(random_rotation(rng))
+
+    labels = np.concatenate([np.full(len(s.reshape(-1, 3)), i) for i, s in enumerate(subunits)])
+
+    def clashes(translations: List[np.ndarray]) -> bool:
+        coords = np.concatenate([apply((rotations[i], translations[i]), subunits[i].reshape(-1, 3))
+                                 for i in range(len(subunits))])
+        pairs = scipy.spatial.cKDTree(coords).query_pairs(MIN_ATOM_DIST, output_type="ndarray")
+        return bool(np.any(labels[pairs[:, 0]] != labels[pairs[:, 1]]))
+
+    # the smallest spacing of the layout that keeps the subunits MIN_ATOM_DIST apart
+    low, high = 0.0, 2 * max(np.linalg.norm(s.reshape(-1, 3), axis=1).max() for s in subunits) + MIN_ATOM_DIST
+    while clashes([high * p for p in positions]):
+        high *= 2
+    for _ in range(20):
+        middle = (low + high) / 2
+        if clashes([middle * p for p in positions]):
+            low = middle
+        else:
+            high = middle
+
+    # the spacing is set by the closest pair, pack each subunit toward the center until it touches its neighbors
+    translations = [high * p for p in positions]
+    for _ in range(3):
+        for i in range(len(subunits)):
+            others = scipy.spatial.cKDTree(np.concatenate(
+                [apply((rotations[j], translations[j]), subunits[j].reshape(-1, 3))
+                 for j in range(len(subunits)) if j != i]))
+            coords = apply((rotations[i], np.zeros(3)), subunits[i].reshape(-1, 3))
+            low, high = 0.0, 1.0
+            for _ in range(12):
+                middle = (low + high) / 2
+                distances, _ = others.query(coords + (1 - middle) * translations[i],
+                                            distance_upper_bound=MIN_ATOM_DIST)
+                if np.isfinite(distances).any():
+                    high = middle
+                else:
+                    low = middle
+            translations[i] = (1 - low) * translations[i]
+    return [(rotations[i], translations[i]) for i in range(len(subunits))]
+
+
+def noisy(t: Transformation, rotation_noise: float, translation_noise: float,
+          rng: np.random.Generator) -> Transformation:
+    rotation = axis_rotation(rng.normal(size=3), rng.normal(0, rotation_noise)) if rotation_noise > 0 else np.eye(3)
+    return rotation @ t[0], t[1] + rng.normal(0, translation_noise, size=3)
+
+
+def decoy(subunit1: np.ndarray, subunit2: np.ndarray, rng: np.random.Generator) -> Transformation:
+    """A random orientation of subunit2 placed next to subunit1, in the frame of subunit1"""
+    radius = np.linalg.norm(subunit1[:, 1], axis=1).max() + np.linalg.norm(subunit2[:, 1], axis=1).max()
+    direction = rng.normal(size=3)
+    return random_rotation(rng), rng.uniform(0.7, 1.0) * radius * direction / np.linalg.norm(direction)
+
+
+def draw_score(mean: float, std: float, rng: np.random.Generator) -> float:
+    return float(np.clip(rng.normal(mean, std), 0, 100))
+
+
+def write_transformations(output_path: str, transformations: List[Tuple[float, Transformation]]):
+    with open(output_path, "w") as f:
+        for i, (score, t) in enumerate(sorted(transformations, key=lambda st: -st[0])):
+            numbers = " ".join(f"{n:.6g}" for n in transformation_numbers(t))
+            f.write(f"{i + 1} | {score:.4f} | synthetic | {numbers}\n")
+
+
+def generate(output_folder: str, subunits_num: int, residues_num: int, layout: str, identical: bool,
+             decoys_num: int, non_contact_decoys_num: int, rotation_noise: float, translation_noise: float,
+             true_score: Tuple[float, float], decoy_score: Tuple[float, float], crosslinks_num: int,
+             false_crosslinks_ratio: float, seed: int):
+    assert 1 < subunits_num <= len(CHAIN_NAMES), f"the number of subunits should be 2 to {len(CHAIN_NAMES)}"
+    rng = np.random.default_rng(seed)
+    transformations_path = os.path.join(output_folder, "transformations")
+    os.makedirs(transformations_path)
+
+    # identical copies share the coordinates of their PDBs, so the assembler finds them identical
+    if identical:
+        subunits = [build_subunit(residues_num, rng)] * subunits_num
+        names = [f"S0_{CHAIN_NAMES[i]}" for i in range(subunits_num)]
+        subunits_info = {"S0": SubunitInfo(name="S0", chain_names=list(CHAIN_NAMES[:subunits_num]), start_res=1,
+                                           sequence="A" * residues_num)}
+    else:
+        subunits = [build_subunit(residues_num, rng) for _ in range(subunits_num)]
+        names = [f"S{i}_{CHAIN_NAMES[i]}" for i in range(subunits_num)]
+        subunits_info = {f"S{i}": SubunitInfo(name=f"S{i}", chain_names=[CHAIN_NAMES[i]], start_res=1,
+                                              sequence="A" * residues_num) for i in range(subunits_num)}
+    save_subunits_info(subunits_info, os.path.join(output_folder, "subunits.json"))
+    with open(os.path.join(output_folder, "chain.list"), "w") as f:
+        for i, name in enumerate(names):
+            write_pdb(subunits[i], CHAIN_NAMES[i], os.path.join(output_folder, f"{name}.pdb"))
+            f.write(f"{name}.pdb\n")
+
+    placements = place_subunits(subunits, layout, rng)
+    placed_ca = [apply(placements[i], subunits[i][:, 1]) for i in range(subunits_num)]
+    contacts = [(i, j) for i in range(subunits_num) for j in range(i + 1, subunits_num)
+                if scipy.spatial.distance.cdist(placed_ca[i], placed_ca[j]).min() < INTERFACE_MIN_ATOM_DIST]
+    graph = scipy.sparse.coo_matrix((np.ones(len(contacts)), tuple(np.array(contacts).T) if contacts else ([], [])),
+                                    shape=(subunits_num, subunits_num))
+    if scipy.sparse.csgraph.connected_components(graph, directed=False)[0] != 1:
+        print("Warning: the touching pairs don't connect all subunits, the assembler can't assemble the complex")
+
+    # the transformations of file i_plus_j move subunit j to the frame of subunit i
+    for i in range(subunits_num):
+        for j in range(i + 1, subunits_num):
+            transformations = []
+            if (i, j) in contacts:
+                true_trans = compose(inverse(placements[i]), placements[j])
+                transformations.append((draw_score(*true_score, rng),
+                                        noisy(true_trans, rotation_noise, translation_noise, rng)))
+            for _ in range(decoys_num if (i, j) in contacts else non_contact_decoys_num):
+                transformations.append((draw_score(*decoy_score, rng), decoy(subunits[i], subunits[j], rng)))
+            if transformations:
+                write_transformations(os.path.join(transformations_path, f"{names[i]}_plus_{names[j]}"),
+                                      transformations)
+
+    # crosslinks of residues of touching subunits, a part of them between random residues
+    crosslinks = []
+    for _ in range(crosslinks_num if contacts else 0):
+        i, j = contacts[rng.integers(len(contacts))]
+        if rng.uniform() < false_crosslinks_ratio:
+            res1, res2, confidence = rng.integers(residues_num), rng.integers(residues_num), rng.uniform(0.2, 0.6)
+        else:
+            close = np.argwhere(scipy.spatial.distance.cdist(placed_ca[i], placed_ca[j]) < 25.0)
+            res1, res2 = close[rng.integers(len(close))]
+            confidence = rng.uniform(0.6, 1.0)
+        crosslinks.append(f"{res1 + 1} {CHAIN_NAMES[i]} {res2 + 1} {CHAIN_NAMES[j]} 0 30 {confidence:.2f}\n")
+    with open(os.path.join(output_folder, "xlink_consts.txt"), "w") as f:
+        f.writelines(crosslinks)
+
+    # the ground truth in the frame of the first subunit, as a line of the assembler output
+    ground_truth = [compose(inverse(placements[0]), placement) for placement in placements]
+    bbs = ",".join(f"{i}(" + " ".join(f"{n:.6g}" for n in transformation_numbers(t)) + ")"
+                   for i, t in enumerate(ground_truth))
+    with open(os.path.join(output_folder, "ground_truth.res"), "w") as f:
+        f.write(f"size_ {subunits_num} transScore_ 0 multPen_ 0 singlePen_ 0 diffPen 0 backBonePen_ 0 maxPen_ 0 "
+                f"restraintsRatio_ 1 weightedTransScore 0 [{bbs}]  0 0 0 0 0 0foldSteps:\n")
+
+    with open(os.path.join(output_folder, "synthetic.json"), "w") as f:
+        json.dump({"subunits": names, "layout": layout, "identical": identical, "residues": residues_num,
+                   "contacts": contacts, "decoys": decoys_num, "non_contact_decoys": non_contact_decoys_num,
+                   "rotation_noise": rotation_noise, "translation_noise": translation_noise,
+                   "true_score": true_score, "decoy_score": decoy_score, "crosslinks": len(crosslinks),
+                   "seed": seed}, f, indent=2)
+    print(f"{subunits_num} subunits, {len(contacts)} touching pairs, {len(crosslinks)} crosslinks, run in "
+          f"{output_folder}:\nCombinatorialAssembler.out chain.list transformations/ "
+          f"{decoys_num + 1} 100 xlink_consts.txt")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a synthetic complex with a known ground truth as input "
+                                                 "for the combinatorial assembler")
+    parser.add_argument("output_folder", type=str)
+    parser.add_argument("--subunits", type=int, default=8)
+    parser.add_argument("--residues", type=int, default=72, help="residues of each subunit")
+    parser.add_argument("--layout", type=str, choices=["lattice", "shell"], default="lattice")
+    parser.add_argument("--identical", action="store_true", help="all subunits are copies of one subunit")
+    parser.add_argument("--decoys", type=int, default=20, help="decoy transformations of each touching pair")
+    parser.add_argument("--non-contact-decoys", type=int, default=0,
+                        help="decoy transformations of each pair that doesn't touch")
+    parser.add_argument("--rotation-noise", type=float, default=2.0, help="degrees, std of the true transformations")
+    parser.add_argument("--translation-noise", type=float, default=0.5, help="std of the true transformations")
+    parser.add_argument("--true-score", type=float, nargs=2, default=[80.0, 5.0], metavar=("MEAN", "STD"))
+    parser.add_argument("--decoy-score", type=float, nargs=2, default=[50.0, 15.0], metavar=("MEAN", "STD"))
+    parser.add_argument("--crosslinks", type=int, default=0)
+    parser.add_argument("--false-crosslinks", type=float, default=0.1, help="ratio of random crosslinks")
+    parser.add_argument("--seed", type=int, default=0)
+    args = parser.parse_args()
+
+    if os.path.exists(args.output_folder):
+        print("Output folder already exists, exiting")
+        return
+    generate(args.output_folder, args.subunits, args.residues, args.layout, args.identical, args.decoys,
+             args.non_contact_decoys, np.radians(args.rotation_noise), args.translation_noise,
+             tuple(args.true_score), tuple(args.decoy_score), args.crosslinks, args.false_crosslinks, args.seed)
+
+
+if __name__ == "__main__":
+    main()
@@ -127,39 +127,69 @@ def score_transformation(pdb_path1: str, pdb_path2: str) -> Optional[float]:
     return sum(bfactors) / len(bfactors)
 
 
-def get_transformation_from_partials(partial_subunit1: PartialSubunit, partial_subunit2: PartialSubunit,
-                                     representative_subunits_path: str, temp_folder: str,
-                                     subunits_info: SubunitsInfo) -> Optional[TransformationInfo]:
-    rep_struct1_path = extract_partial_from_representative(partial_subunit1, representative_subunits_path,
-                                                           temp_folder, subunits_info)
-    rep_struct2_path = extract_partial_from_representative(partial_subunit2, representative_subunits_path,
-                                                           temp_folder, subunits_info)
+# One AF2trans job: the representative and sample structures of an interacting pair of partial subunits
+@dataclasses.dataclass
+class AF2transJob:
+    partial_subunits: Tuple[PartialSubunit, PartialSubunit]
+    rep_struct_paths: Tuple[str, str]
+    sample_struct_paths: Tuple[str, str]
+    score: float
 
-    sample_struct1_path = os.path.join(temp_folder, f"sample1_{partial_subunit1.subunit_name}.pdb")
-    extract_partial_subunit(partial_subunit1, sample_struct1_path)
 
-    sample_struct2_path = os.path.join(temp_folder, f"sample2_{partial_subunit2.subunit_name}.pdb")
-    extract_partial_subunit(partial_subunit2, sample_struct2_path)
+def extract_sample_partial_subunit(partial_subunit: PartialSubunit, sample_folder: str) -> str:
+    output_pdb_path = os.path.join(sample_folder, f"sample_{partial_subunit.chain_id}_"
+                                                  f"{partial_subunit.start_residue_id}_"
+                                                  f"{partial_subunit.end_residue_id}.pdb")
+    if not os.path.exists(output_pdb_path):
+        extract_partial_subunit(partial_subunit, output_pdb_path)
+    return output_pdb_path
+
+
+def get_af2trans_job_from_partials(partial_subunit1: PartialSubunit, partial_subunit2: PartialSubunit,
+                                   representative_subunits_path: str, temp_folder: str, sample_folder: str,
+                                   subunits_info: SubunitsInfo) -> Optional[AF2transJob]:
+    sample_struct1_path = extract_sample_partial_subunit(partial_subunit1, sample_folder)
+    sample_struct2_path = extract_sample_partial_subunit(partial_subunit2, sample_folder)
 
     score = score_transformation(sample_struct1_path, sample_struct2_path)
     if score is None:
         return None
 
-    af2trans_output = subprocess.check_output([AF2TRANS_BIN_PATH, rep_struct1_path, rep_struct2_path,
-                                               sample_struct1_path, sample_struct2_path]).decode()
-    assert af2trans_output.count(" | ") == 3, f"Unexpected output from AF2mer2trans {af2trans_output}"
-
-    _, su1_desc, su2_desc, trans_nums = af2trans_output.split(" | ")
-    rep_imposed_rmsds = (float(su1_desc.split("_")[0]), float(su2_desc.split("_")[0]))
-
-    return TransformationInfo(
-        subunit_names=(partial_subunit1.subunit_name, partial_subunit2.subunit_name),
-        pdb_path=partial_subunit1.pdb_path,
-        pdb_chain_ids=(partial_subunit1.chain_id, partial_subunit2.chain_id),
-        transformation_numbers=trans_nums,
-        rep_imposed_rmsds=rep_imposed_rmsds,
-        score=score
-    )
+    rep_struct1_path = extract_partial_from_representative(partial_subunit1, representative_subunits_path,
+                                                           temp_folder, subunits_info)
+    rep_struct2_path = extract_partial_from_representative(partial_subunit2, representative_subunits_path,
+                                                           temp_folder, subunits_info)
+    return AF2transJob(partial_subunits=(partial_subunit1, partial_subunit2),
+                       rep_struct_paths=(rep_struct1_path, rep_struct2_path),
+                       sample_struct_paths=(sample_struct1_path, sample_struct2_path),
+                       score=score)
+
+
+def run_af2trans_jobs(jobs: List[AF2transJob]) -> List[TransformationInfo]:
+    """Runs all the jobs in one AF2trans process, which reads every representative structure once"""
+    if not jobs:
+        return []
+    jobs_text = "".join(f"{job.rep_struct_paths[0]} {job.rep_struct_paths[1]} "
+                        f"{job.sample_struct_paths[0]} {job.sample_struct_paths[1]}\n" for job in jobs)
+    af2trans_output = subprocess.check_output([AF2TRANS_BIN_PATH, "--jobs", "-"], input=jobs_text.encode()).decode()
+    output_lines = af2trans_output.splitlines()
+    assert len(output_lines) == len(jobs), f"Unexpected output from AF2mer2trans {af2trans_output}"
+
+    transformations = []
+    for job, line in zip(jobs, output_lines):
+        assert line.count(" | ") == 3, f"Unexpected output from AF2mer2trans {line}"
+        _, su1_desc, su2_desc, trans_nums = line.split(" | ")
+        rep_imposed_rmsds = (float(su1_desc.split("_")[0]), float(su2_desc.split("_")[0]))
+        partial_subunit1, partial_subunit2 = job.partial_subunits
+        transformations.append(TransformationInfo(
+            subunit_names=(partial_subunit1.subunit_name, partial_subunit2.subunit_name),
+            pdb_path=partial_subunit1.pdb_path,
+            pdb_chain_ids=(partial_subunit1.chain_id, partial_subunit2.chain_id),
+            transformation_numbers=trans_nums,
+            rep_imposed_rmsds=rep_imposed_rmsds,
+            score=job.score
+        ))
+    return transformations
 
 
 def get_pdb_to_partial_subunits(pdbs_folder: str, subunits_info: SubunitsInfo) -> Dict[str, List[PartialSubunit]]:
@@ -273,31 +303,34 @@ def extract_representative_subunits(pdb_path_to_partial_subunits: Dict[str, List
 def extract_transformations(pdb_path_to_partial_subunits: Dict[str, List[PartialSubunit]], subunits_info: SubunitsInfo,
                             representative_subunits_path: str, transformations_path: str):
     temp_folder = os.path.join(transformations_path, "temp_transformations")
-    transformations_by_pdb_path: Dict[str, List[TransformationInfo]] = {}
-    for pdb_path, partial_subunits in pdb_path_to_partial_subunits.items():
+    if os.path.exists(temp_folder):
+        print("removing temp folder")
+        shutil.rmtree(temp_folder)
+    os.makedirs(temp_folder)
+
+    # the representative partial subunits are shared by all the pdbs, the samples are kept per pdb
+    jobs: List[AF2transJob] = []
+    for pdb_ind, (pdb_path, partial_subunits) in enumerate(pdb_path_to_partial_subunits.items()):
         print("- Extracting pairwise transformations from file", pdb_path)
-        if os.path.exists(temp_folder):
-            print("removing temp folder")
-            shutil.rmtree(temp_folder)
-        os.makedirs(temp_folder)
-        transformations_by_pdb_path[pdb_path] = []
+        sample_folder = os.path.join(temp_folder, f"samples_{pdb_ind}")
+        os.makedirs(sample_folder)
         for partial_subunit_ind_i in range(len(partial_subunits)):
             partial_subunit1 = partial_subunits[partial_subunit_ind_i]
 
             for partial_subunit_ind_j in range(partial_subunit_ind_i + 1, len(partial_subunits)):
                 partial_subunit2 = partial_subunits[partial_subunit_ind_j]
 
-                transformation_info = get_transformation_from_partials(partial_subunit1, partial_subunit2,
-                                                                       representative_subunits_path, temp_folder,
-                                                                       subunits_info)
-                if transformation_info is not None:
-                    transformations_by_pdb_path[pdb_path].append(transformation_info)
-        shutil.rmtree(temp_folder)
+                job = get_af2trans_job_from_partials(partial_subunit1, partial_subunit2, representative_subunits_path,
+                                                     temp_folder, sample_folder, subunits_info)
+                if job is not None:
+                    jobs.append(job)
+    print(f"- Running AF2trans on {len(jobs)} interacting pairs")
+    transformations = run_af2trans_jobs(jobs)
+    shutil.rmtree(temp_folder)
 
     transformations_by_subunit_pair: Dict[Tuple[str, str], List[TransformationInfo]] = defaultdict(list)
-    for pdb_path, transformations in transformations_by_pdb_path.items():
-        for transformation in transformations:
-            transformations_by_subunit_pair[transformation.subunit_names].append(transformation)
+    for transformation in transformations:
+        transformations_by_subunit_pair[transformation.subunit_names].append(transformation)
 
     for (subunit_name1, subunit_name2), transformations in transformations_by_subunit_pair.items():
         print(f"found {len(transformations)} transformations between {subunit_name1} and {subunit_name2}")
@@ -322,8 +355,30 @@ def extract_transformations(pdb_path_to_partial_subunits: Dict[str, List[Partial
         os.remove(output_file_path)
 
 
+def extract_unified_representation_native(subunits_json_path: str, pdbs_folder: str,
+                                          representative_subunits_path: str, transformations_path: str):
+    """Same as get_pdb_to_partial_subunits, extract_representative_subunits and extract_transformations, in one
+    multi-threaded AF2trans run"""
+    subprocess.run([AF2TRANS_BIN_PATH, "--subunits", subunits_json_path, "--models", pdbs_folder,
+                    "--representatives", representative_subunits_path, "--transformations", transformations_path],
+                   check=True)
+
+
+def move_native_models(assembly_path: str, output_folder: str, output_cif: bool) -> List[str]:
+    # models written by the assembler with --write-models, output_clustered_<i>.pdb by rank
+    os.makedirs(output_folder, exist_ok=True)
+    file_ext = ".cif" if output_cif else ".pdb"
+    output_files = []
+    while os.path.exists(os.path.join(assembly_path, f"output_clustered_{len(output_files)}{file_ext}")):
+        filename = f"output_clustered_{len(output_files)}{file_ext}"
+        shutil.move(os.path.join(assembly_path, filename), os.path.join(output_folder, filename))
+        output_files.append(os.path.join(output_folder, filename))
+    return output_files
+
+
 def run_on_pdbs_folder(subunits_json_path: str, pdbs_folder: str, output_path: str,
-                       crosslinks_path: Optional[str] = None, output_cif: bool = False, max_results_number: int = 5):
+                       crosslinks_path: Optional[str] = None, output_cif: bool = False, max_results_number: int = 5,
+                       native_extraction: bool = True, native_models: bool = False):
     pdbs_folder = os.path.abspath(pdbs_folder)
     output_path = os.path.abspath(output_path)
 
@@ -344,15 +399,20 @@ def run_on_pdbs_folder(subunits_json_path: str, pdbs_folder: str, output_path: s
     os.makedirs(representative_subunits_path, exist_ok=True)
     os.makedirs(transformations_path, exist_ok=True)
 
-    print("--- Searching for subunits in supplied PDB files")
-    pdb_path_to_partial_subunits = get_pdb_to_partial_subunits(pdbs_folder, subunits_info)
+    if native_extraction:
+        print("--- Extracting representative subunits and pairwise transformations from the supplied PDB files")
+        extract_unified_representation_native(subunits_json_path, pdbs_folder, representative_subunits_path,
+                                              transformations_path)
+    else:
+        print("--- Searching for subunits in supplied PDB files")
+        pdb_path_to_partial_subunits = get_pdb_to_partial_subunits(pdbs_folder, subunits_info)
 
-    print("--- Extracting representative subunits (for each subunit, its best scored model in the PDBs folder)")
-    extract_representative_subunits(pdb_path_to_partial_subunits, subunits_info, representative_subunits_path)
+        print("--- Extracting representative subunits (for each subunit, its best scored model in the PDBs folder)")
+        extract_representative_subunits(pdb_path_to_partial_subunits, subunits_info, representative_subunits_path)
 
-    print("--- Extracting pairwise transformations between subunits (from each PDB file with 2 or more subunits)")
-    extract_transformations(pdb_path_to_partial_subunits, subunits_info, representative_subunits_path,
-                            transformations_path)
+        print("--- Extracting pairwise transformations between subunits (from each PDB file with 2 or more subunits)")
+        extract_transformations(pdb_path_to_partial_subunits, subunits_info, representative_subunits_path,
+                                transformations_path)
 
     print("--- Finished building unified representation")
 
@@ -368,8 +428,11 @@ def run_on_pdbs_folder(subunits_json_path: str, pdbs_folder: str, output_path: s
     else:
         open("xlink_consts.txt", "w").close()
 
+    # with native_models the assembler writes the output models itself
+    models_args = f" --write-models {max_results_number} --format {'cif' if output_cif else 'pdb'}" \
+        if native_models else ""
     subprocess.run(f"{COMB_ASSEMBLY_BIN_PATH} chain.list {transformations_path}/ 900 100 xlink_consts.txt "
-                   f"-b 0.05 -t 80 > output.log 2>&1", shell=True)
+                   f"-b 0.05 -t 80{models_args} > output.log 2>&1", shell=True)
     print("--- Finished combinatorial assembly, writing output models")
 
     # build pdbs from assembly output
@@ -377,9 +440,13 @@ def run_on_pdbs_folder(subunits_json_path: str, pdbs_folder: str, output_path: s
     if not os.path.exists(clusters_path):
         print(f"Could not assemble, exiting")
         return
-    assembled_files = create_complexes(clusters_path, first_result=0, last_result=max_results_number,
-                                       output_folder=os.path.join(output_path, "assembled_results"),
-                                       output_cif=output_cif)
+    if native_models:
+        assembled_files = move_native_models(representative_subunits_path,
+                                             os.path.join(output_path, "assembled_results"), output_cif)
+    else:
+        assembled_files = create_complexes(clusters_path, first_result=0, last_result=max_results_number,
+                                           output_folder=os.path.join(output_path, "assembled_results"),
+                                           output_cif=output_cif)
 
     confidence = []
     for result_as_str in open(clusters_path, "r").read().split("\n")[:len(assembled_files)]: